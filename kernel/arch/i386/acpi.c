@@ -0,0 +1,207 @@
+/**
+ * Code for finding the ACPI tables.
+ * 
+ * Only the static tables are read, there's no AML interpreter. The RSDT is used
+ * rather than the XSDT, as its 32-bit addresses are all this kernel can use.
+ * 
+ * Refer to:
+ * ACPI Specification, Chapter 5.2: ACPI System Description Tables
+ * https://wiki.osdev.org/RSDP
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/arch/i386/acpi.h>
+#include <kernel/mm/mm.h>
+#include <kernel/mm/vmalloc.h>
+
+/* Must be defined: phys_addr_t */
+#include <kernel/arch/i386/paging.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* The RSDP is on a 16 byte boundary in the first 1KB of the EBDA or in the BIOS ROM */
+#define EBDA_SEGMENT_PTR	0x40E
+#define EBDA_SEARCH_SIZE	1024
+#define BIOS_ROM_START		0xE0000
+#define BIOS_ROM_END		0x100000
+#define RSDP_ALIGNMENT		16
+
+#define RSDP_SIGNATURE		"RSD PTR "
+
+
+/* Root System Description Pointer, version 1 */
+typedef struct rsdp_s {
+	char signature[8];
+	uint8_t checksum;
+	char oem_id[6];
+	uint8_t revision;
+	uint32_t rsdt_addr;
+} __attribute__ ((packed)) rsdp_t;
+
+/* Root System Description Table */
+typedef struct rsdt_s {
+	acpi_sdt_header_t header;
+	uint32_t tables[];			/* Physical addresses of the other tables */
+} __attribute__ ((packed)) rsdt_t;
+
+
+static rsdt_t* rsdt;
+
+
+bool acpi_init(void);
+acpi_sdt_header_t* acpi_find_table(const char* signature);
+
+static rsdp_t* find_rsdp(uintptr_t start, uintptr_t end);
+static void* acpi_map(phys_addr_t addr, size_t size);
+static void acpi_unmap(void* addr);
+static acpi_sdt_header_t* map_table(phys_addr_t addr);
+static bool checksum_valid(const void* data, size_t size);
+
+
+/* Global Functions */
+
+bool acpi_init(void)
+{
+	uintptr_t ebda = (uintptr_t) *(uint16_t*) P2V(EBDA_SEGMENT_PTR) << 4;
+
+	rsdp_t* rsdp = NULL;
+	if (ebda != 0)
+		rsdp = find_rsdp(ebda, ebda + EBDA_SEARCH_SIZE);
+	if (rsdp == NULL)
+		rsdp = find_rsdp(BIOS_ROM_START, BIOS_ROM_END);
+	if (rsdp == NULL)
+		return false;
+
+	rsdt = (rsdt_t*) map_table(rsdp->rsdt_addr);
+
+	return rsdt != NULL && memcmp(rsdt->header.signature, "RSDT", 4) == 0;
+}
+
+acpi_sdt_header_t* acpi_find_table(const char* signature)
+{
+	if (rsdt == NULL)
+		return NULL;
+
+	size_t num_tables = (rsdt->header.length - sizeof(acpi_sdt_header_t)) / sizeof(uint32_t);
+
+	for (size_t i = 0; i < num_tables; i++)
+	{
+		acpi_sdt_header_t* header = acpi_map(rsdt->tables[i], sizeof(acpi_sdt_header_t));
+		if (header == NULL)
+			continue;
+
+		bool found = memcmp(header->signature, signature, 4) == 0;
+		acpi_unmap(header);
+
+		if (found)
+			return map_table(rsdt->tables[i]);
+	}
+
+	return NULL;
+}
+
+
+/* Helper Functions */
+
+/**
+ * Searches a range of low memory for the RSDP.
+ * 
+ * @param start the physical address the search starts at
+ * @param end the physical address the search ends at
+ * 
+ * @return the RSDP or NULL if it isn't in the range
+*/
+static rsdp_t* find_rsdp(uintptr_t start, uintptr_t end)
+{
+	for (uintptr_t addr = start; addr + sizeof(rsdp_t) <= end; addr += RSDP_ALIGNMENT)
+	{
+		rsdp_t* rsdp = (rsdp_t*) P2V(addr);
+
+		if (memcmp(rsdp->signature, RSDP_SIGNATURE, 8) == 0 && checksum_valid(rsdp, sizeof(rsdp_t)))
+			return rsdp;
+	}
+
+	return NULL;
+}
+
+/**
+ * Maps physical memory holding ACPI tables, which are usually near the end of
+ * RAM, above low memory on larger machines.
+ * 
+ * @param addr the physical address
+ * @param size the number of bytes
+ * 
+ * @return the virtual address or NULL if it couldn't be mapped
+*/
+static void* acpi_map(phys_addr_t addr, size_t size)
+{
+	if (addr + size <= HIGH_MEM_START)
+		return (void*) P2V((uintptr_t) addr);
+
+	return ioremap(addr, size);
+}
+
+/**
+ * Unmaps memory mapped by acpi_map().
+ * 
+ * @param addr the virtual address
+*/
+static void acpi_unmap(void* addr)
+{
+	if ((uintptr_t) addr >= P2V(HIGH_MEM_START))
+		iounmap(addr);
+}
+
+/**
+ * Maps a whole table, once its header gives its length.
+ * 
+ * @param addr the physical address of the table
+ * 
+ * @return the table or NULL if it couldn't be mapped or its checksum is wrong
+*/
+static acpi_sdt_header_t* map_table(phys_addr_t addr)
+{
+	acpi_sdt_header_t* header = acpi_map(addr, sizeof(acpi_sdt_header_t));
+	if (header == NULL)
+		return NULL;
+
+	uint32_t length = header->length;
+	acpi_unmap(header);
+
+	if (length < sizeof(acpi_sdt_header_t))
+		return NULL;
+
+	header = acpi_map(addr, length);
+	if (header == NULL)
+		return NULL;
+
+	if (!checksum_valid(header, length)) {
+		acpi_unmap(header);
+		return NULL;
+	}
+
+	return header;
+}
+
+/**
+ * Checks that the bytes of an ACPI structure sum to 0.
+ * 
+ * @param data the structure
+ * @param size the size of the structure
+ * 
+ * @return true if the checksum is valid, false otherwise
+*/
+static bool checksum_valid(const void* data, size_t size)
+{
+	const uint8_t* bytes = data;
+	uint8_t sum = 0;
+
+	for (size_t i = 0; i < size; i++)
+		sum += bytes[i];
+
+	return sum == 0;
+}
@@ -0,0 +1,45 @@
+/**
+ * Code for detecting the features of the CPU.
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/arch/i386/cpu.h>
+#include <kernel/arch/i386/fpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+
+/* Copies past the size of the L2 cache would only evict useful data from it */
+#define MEM_NT_THRESHOLD	(256 * 1024)
+
+
+cpu_info_t cpu_info;
+
+
+extern size_t __mem_nt_threshold;
+
+
+void cpu_init(void)
+{
+	uint32_t ebx, ecx, edx, unused;
+
+	cpuid(0, &cpu_info.max_leaf, &ebx, &ecx, &edx);
+
+	/* The vendor string is stored in EBX, EDX and ECX, in that order */
+	memcpy(cpu_info.vendor, &ebx, 4);
+	memcpy(cpu_info.vendor + 4, &edx, 4);
+	memcpy(cpu_info.vendor + 8, &ecx, 4);
+	cpu_info.vendor[12] = '\0';
+
+	if (cpu_info.max_leaf >= 1)
+		cpuid(1, &unused, &unused, &cpu_info.features_ecx, &cpu_info.features_edx);
+
+	/* memcpy() and memset() use movnti for large buffers */
+	if (cpu_info.features_edx & CPUID_EDX_SSE2)
+		__mem_nt_threshold = MEM_NT_THRESHOLD;
+
+	fpu_enable();
+}
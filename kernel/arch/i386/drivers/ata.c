@@ -13,6 +13,8 @@
 
 #include <kernel/system.h>
 #include <kernel/mm/mm.h>
+#include <kernel/time/timer.h>
+#include <kernel/sync/mutex.h>
 
 #include <kernel/arch/i386/io.h>
 
@@ -56,6 +58,10 @@
 
 #define POLL_ERR_MASK			(STATUS_ERR | STATUS_DF)
 
+/* How long the Status port is polled before giving up on the device */
+#define ATA_TIMEOUT_NS			(1 * NSEC_PER_SEC)
+#define ATA_FLUSH_TIMEOUT_NS	(30 * NSEC_PER_SEC)
+
 #define LBA28_MAX_SECTOR_COUNT	256
 #define LBA48_MAX_SECTOR_COUNT	65536
 
@@ -63,6 +69,9 @@
 /* The ID of the currently selected device */
 unsigned char selected_dev_id;
 
+/* Protects selected_dev_id and keeps each command sequence from being interleaved */
+static mutex_t ata_lock = MUTEX_INIT(ata_lock, "ata");
+
 
 static int ata_dev_init(ata_dev_t* dev, uint16_t port_base, bool master);
 static int ata_identify(const ata_dev_t* dev, uint16_t* buf);
@@ -80,6 +89,7 @@ static int ata_write_transfer(const ata_dev_t* dev, const uint16_t* data, uint32
 static void ata_select(const ata_dev_t* dev);
 static void ata_io_wait(const ata_dev_t* dev);
 static int ata_poll(const ata_dev_t* dev);
+static int ata_wait(const ata_dev_t* dev, uint8_t mask, uint8_t value, uint8_t err_mask, uint64_t timeout_ns);
 
 
 /* Global Functions */
@@ -113,15 +123,21 @@ int ata_read(const ata_dev_t* dev, void* buf, uint64_t lba, uint16_t sector_coun
 	if (lba + sector_count > ATA_NUM_SECTORS(dev))
 		return -1;
 		
+	int ret = -1;
+
+	mutex_lock(&ata_lock);
+
 	if (dev->id != selected_dev_id)
 		ata_select(dev);
 
 	if (lba < dev->lba28_num_sectors && !(sector_count & 0xFF00))
-		return ata_read28(dev, buf, lba, sector_count);
-	if (lba < dev->lba48_num_sectors)
-		return ata_read48(dev, buf, lba, sector_count);
-	
-	return -1;
+		ret = ata_read28(dev, buf, lba, sector_count);
+	else if (lba < dev->lba48_num_sectors)
+		ret = ata_read48(dev, buf, lba, sector_count);
+
+	mutex_unlock(&ata_lock);
+
+	return ret;
 }
 
 int ata_write(const ata_dev_t* dev, const void* data, uint64_t lba, uint16_t sector_count)
@@ -134,15 +150,21 @@ int ata_write(const ata_dev_t* dev, const void* data, uint64_t lba, uint16_t sec
 	if (lba + sector_count > ATA_NUM_SECTORS(dev))
 		return -1;
 
+	int ret = -1;
+
+	mutex_lock(&ata_lock);
+
 	if (dev->id != selected_dev_id)
 		ata_select(dev);
 
 	if (lba < dev->lba28_num_sectors && !(sector_count & 0xFF00))
-		return ata_write28(dev, data, lba, sector_count);
-	if (lba < dev->lba48_num_sectors)
-		return ata_write48(dev, data, lba, sector_count);
-	
-	return -1;
+		ret = ata_write28(dev, data, lba, sector_count);
+	else if (lba < dev->lba48_num_sectors)
+		ret = ata_write48(dev, data, lba, sector_count);
+
+	mutex_unlock(&ata_lock);
+
+	return ret;
 }
 
 
@@ -238,21 +260,8 @@ static int ata_identify(const ata_dev_t* dev, uint16_t* buf)
 	if (!inb(dev->port_base + PORT_STATUS))
 		return -1;
 
-	uint8_t status;
-
 	/* Poll the Status port until BSY clears */
-	unsigned int timer = 0xFFFFFF;
-	while (--timer) {
-		status = inb(dev->port_base + PORT_STATUS);
-
-		if (!(status & STATUS_BSY))
-			break;
-
-		if (status & STATUS_ERR)
-			return -1;
-	}
-
-	if (timer == 0)
+	if (ata_wait(dev, STATUS_BSY, 0, STATUS_ERR, ATA_TIMEOUT_NS) < 0)
 		return -1;
 
 	/* Check the LBAmid and LBAhi ports to see if they are non-zero. If so, the drive is not ATA */
@@ -260,18 +269,7 @@ static int ata_identify(const ata_dev_t* dev, uint16_t* buf)
 		return -1;
 
 	/* Poll the Status port until DRQ sets */
-	timer = 0xFFFFFF;
-	while (--timer) {
-		status = inb(dev->port_base + PORT_STATUS);
-
-		if (status & STATUS_DRQ)
-			break;
-
-		if (status & STATUS_ERR)
-			return -1;
-	}
-
-	if (timer == 0)
+	if (ata_wait(dev, STATUS_DRQ, STATUS_DRQ, STATUS_ERR, ATA_TIMEOUT_NS) < 0)
 		return -1;
 
 	/* Read the data from the IDENTIFY command */
@@ -464,7 +462,8 @@ static int ata_write_transfer(const ata_dev_t* dev, const uint16_t* data, uint32
 
 		/* Flush the data */
 		outb(dev->port_base + PORT_COMMAND, COMMAND_FLUSH);
-		while (inb(dev->port_base + PORT_STATUS) & STATUS_BSY) {}
+		if (ata_wait(dev, STATUS_BSY, 0, 0, ATA_FLUSH_TIMEOUT_NS) < 0)
+			return -1;
 	}
 
 	return 0;
@@ -498,18 +497,40 @@ static int ata_poll(const ata_dev_t* dev)
 {
 	/* Read the Regular Status port until the BSY bit clears, and the DRQ bit sets or until the ERR bit or DF bit sets.
 	   If neither error bit is set, the device is ready. */
-	int timer = 0xFFFFFF;
-	while (--timer) {
+	return ata_wait(dev, STATUS_BSY | STATUS_DRQ, STATUS_DRQ, POLL_ERR_MASK, ATA_TIMEOUT_NS) < 0 ? -1 : 0;
+}
+
+/**
+ * Polls the Status port until the given bits take the given values.
+ * 
+ * The timeout is measured in time rather than iterations, as the time a port read
+ * takes varies a lot between machines and emulators.
+ * 
+ * @param dev the dev
+ * @param mask the bits to check
+ * @param value the values the bits must take
+ * @param err_mask the bits that indicate an error
+ * @param timeout_ns how long to poll for, in nanoseconds
+ * 
+ * @return the last status read, or -1 if an error bit set or the timeout passed
+*/
+static int ata_wait(const ata_dev_t* dev, uint8_t mask, uint8_t value, uint8_t err_mask, uint64_t timeout_ns)
+{
+	uint64_t deadline = ktime_get_ns() + timeout_ns;
+
+	while (1)
+	{
 		uint8_t status = inb(dev->port_base + PORT_STATUS);
 
-		if (!(status & STATUS_BSY) && (status & STATUS_DRQ))
-			break;
+		if ((status & mask) == value)
+			return status;
 
-		if (status & POLL_ERR_MASK)
+		if (status & err_mask)
 			return -1;
-	}
 
-	return timer > 0 ? 0 : -1;
+		if (ktime_get_ns() > deadline)
+			return -1;
+	}
 }
 
 static void ata_io_wait(const ata_dev_t* dev)
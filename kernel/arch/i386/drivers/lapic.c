@@ -0,0 +1,229 @@
+/**
+ * Code for the local APIC.
+ * 
+ * Its timer is used for timer interrupts and its ICR to start the other CPUs
+ * and to send them TLB shootdowns and reschedule requests.
+ * The PIC still delivers the IRQs through the boot CPU's LINT0 pin, which the
+ * BIOS leaves in virtual wire mode.
+ * 
+ * Refer to:
+ * Intel Software Developer Manual, Volume 3-A: Chapter 10: Advanced Programmable Interrupt Controller (APIC)
+ * https://wiki.osdev.org/APIC_Timer
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/arch/i386/drivers/lapic.h>
+#include <kernel/arch/i386/cpu.h>
+#include <kernel/mm/vmalloc.h>
+#include <kernel/time/timer.h>
+#include <kernel/time/ktime.h>
+#include <kernel/system.h>
+
+/* Must be defined: PAGE_SIZE */
+#include <kernel/arch/i386/paging.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IA32_APIC_BASE_MSR		0x1B
+#define APIC_BASE_ENABLE		(1 << 11)
+#define APIC_BASE_ADDR_MASK		0xFFFFFF000ULL
+
+/* Register offsets */
+#define LAPIC_ID				0x020
+#define LAPIC_TPR				0x080	/* Task Priority */
+#define LAPIC_EOI				0x0B0
+#define LAPIC_SVR				0x0F0	/* Spurious Interrupt Vector */
+#define LAPIC_ICR_LOW			0x300	/* Interrupt Command */
+#define LAPIC_ICR_HIGH			0x310
+#define LAPIC_LVT_TIMER			0x320
+#define LAPIC_TIMER_INIT		0x380	/* Initial Count */
+#define LAPIC_TIMER_CURRENT		0x390	/* Current Count */
+#define LAPIC_TIMER_DIVIDE		0x3E0
+
+#define SVR_ENABLE				(1 << 8)
+#define LVT_MASKED				(1 << 16)	/* One-shot mode is 0 */
+#define TIMER_DIVIDE_BY_16		0x3
+
+#define ICR_INIT				(5 << 8)
+#define ICR_STARTUP				(6 << 8)
+#define ICR_DELIVERY_PENDING	(1 << 12)
+#define ICR_ASSERT				(1 << 14)
+#define ICR_LEVEL_TRIGGER		(1 << 15)
+#define ICR_ALL_BUT_SELF		(3 << 18)	/* Destination shorthand, the destination field is ignored */
+#define ICR_DEST_SHIFT			24
+
+/* The ICR's delivery status is cleared within microseconds */
+#define ICR_TIMEOUT_NS			(10 * NSEC_PER_MSEC)
+
+#define MAX_COUNT				0xFFFFFFFF
+
+
+static volatile uint32_t* lapic_regs;
+
+
+static bool lapic_send_ipi(uint32_t apic_id, uint32_t command);
+static void lapic_set_next_event(uint32_t ticks);
+static void lapic_stop(void);
+static inline uint32_t lapic_read(uint32_t reg);
+static inline void lapic_write(uint32_t reg, uint32_t value);
+
+
+static clock_event_t lapic_clock_event = {
+	.name = "LAPIC",
+	.set_next_event = lapic_set_next_event,
+	.stop = lapic_stop,
+};
+
+
+/* Global Functions */
+
+bool lapic_init(void)
+{
+	if (!(cpu_info.features_edx & CPUID_EDX_APIC) || !(cpu_info.features_edx & CPUID_EDX_MSR))
+		return false;
+
+	uint64_t apic_base = rdmsr(IA32_APIC_BASE_MSR);
+
+	if (!(apic_base & APIC_BASE_ENABLE))
+		wrmsr(IA32_APIC_BASE_MSR, apic_base | APIC_BASE_ENABLE);
+
+	/* Every CPU sees its own local APIC at the same address, so it's only mapped once */
+	if (lapic_regs == NULL)
+		lapic_regs = ioremap((phys_addr_t) (apic_base & APIC_BASE_ADDR_MASK), PAGE_SIZE);
+	if (lapic_regs == NULL)
+		return false;
+
+	/* Accept every interrupt and keep the timer quiet until it's used */
+	lapic_write(LAPIC_TPR, 0);
+	lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER_VECTOR);
+	lapic_write(LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+	return true;
+}
+
+bool lapic_available(void)
+{
+	return lapic_regs != NULL;
+}
+
+void lapic_eoi(void)
+{
+	lapic_write(LAPIC_EOI, 0);
+}
+
+uint32_t lapic_id(void)
+{
+	return lapic_read(LAPIC_ID) >> 24;
+}
+
+
+bool lapic_send_init(uint32_t apic_id)
+{
+	return lapic_send_ipi(apic_id, ICR_INIT | ICR_ASSERT | ICR_LEVEL_TRIGGER);
+}
+
+bool lapic_send_startup(uint32_t apic_id, phys_addr_t addr)
+{
+	ASSERT(addr < 0x100000 && !(addr & (PAGE_SIZE - 1)));
+
+	return lapic_send_ipi(apic_id, ICR_STARTUP | (uint32_t) (addr / PAGE_SIZE));
+}
+
+bool lapic_send_ipi_others(uint8_t vector)
+{
+	return lapic_send_ipi(0, ICR_ALL_BUT_SELF | vector);
+}
+
+bool lapic_send_ipi_to(uint32_t apic_id, uint8_t vector)
+{
+	return lapic_send_ipi(apic_id, vector);
+}
+
+
+void lapic_timer_calibrate_start(void)
+{
+	lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+	lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER_VECTOR);
+	lapic_write(LAPIC_TIMER_INIT, MAX_COUNT);
+}
+
+uint32_t lapic_timer_calibrate_end(void)
+{
+	uint32_t elapsed = MAX_COUNT - lapic_read(LAPIC_TIMER_CURRENT);
+	lapic_write(LAPIC_TIMER_INIT, 0);
+
+	return elapsed;
+}
+
+clock_event_t* lapic_clock_event_init(uint32_t freq)
+{
+	/* Events closer than a microsecond are late anyway, by the time the interrupt is handled */
+	uint32_t min_ticks = freq / 1000000 ? freq / 1000000 : 1;
+
+	clock_event_config(&lapic_clock_event, freq, min_ticks, MAX_COUNT);
+	lapic_timer_setup();
+
+	return &lapic_clock_event;
+}
+
+void lapic_timer_setup(void)
+{
+	lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR);
+}
+
+
+/* Helper Functions */
+
+/**
+ * Sends an interrupt to another CPU and waits for it to be accepted.
+ * 
+ * @param apic_id the local APIC ID of the target CPU
+ * @param command the low half of the ICR, its delivery mode and vector
+ * 
+ * @return true if the interrupt was delivered, false if it timed out
+*/
+static bool lapic_send_ipi(uint32_t apic_id, uint32_t command)
+{
+	/* Writing the low half sends the interrupt */
+	lapic_write(LAPIC_ICR_HIGH, apic_id << ICR_DEST_SHIFT);
+	lapic_write(LAPIC_ICR_LOW, command);
+
+	uint64_t deadline = ktime_get_ns() + ICR_TIMEOUT_NS;
+
+	while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING)
+		if (ktime_get_ns() > deadline)
+			return false;
+
+	return true;
+}
+
+/**
+ * Raises the timer interrupt once after the given number of ticks.
+ * 
+ * @param ticks the number of ticks
+*/
+static void lapic_set_next_event(uint32_t ticks)
+{
+	lapic_write(LAPIC_TIMER_INIT, ticks);
+}
+
+/**
+ * Stops the timer, writing a count of 0 disarms it.
+*/
+static void lapic_stop(void)
+{
+	lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+static inline uint32_t lapic_read(uint32_t reg)
+{
+	return lapic_regs[reg / sizeof(uint32_t)];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value)
+{
+	lapic_regs[reg / sizeof(uint32_t)] = value;
+}
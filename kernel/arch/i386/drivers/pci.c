@@ -28,6 +28,8 @@
 
 list_t connected_devices_list;
 
+static struct kmem_cache_s* pci_device_descriptor_cache;
+
 
 static uint16_t pci_config_read(uint8_t bus, uint8_t device, uint8_t func, uint8_t offset);
 static void pci_config_write(uint8_t bus, uint8_t device, uint8_t func, uint8_t offset, uint32_t data) __attribute__((unused));
@@ -99,7 +101,7 @@ static void detect_connected_devices(void)
 
 	/* Initialize list and cache */
 	LIST_INIT(connected_devices_list);
-
+	pci_device_descriptor_cache = kmem_cache_create("pci_device_descriptor", sizeof(pci_device_descriptor_t), 0, 0, NULL, NULL);
 
 	/* Loop through each possible device ID to find the ones connected */
 	for (int bus = 0; bus < 8; bus++) {
@@ -137,7 +139,7 @@ static void detect_connected_devices(void)
 */
 static pci_device_descriptor_t* create_device_descriptor(uint8_t bus, uint8_t device, uint8_t function)
 {
-	pci_device_descriptor_t* pdd = kmalloc(sizeof(pci_device_descriptor_t));
+	pci_device_descriptor_t* pdd = kmem_cache_alloc(pci_device_descriptor_cache);
     
     pdd->bus = bus;
     pdd->device = device;
@@ -67,6 +67,13 @@ void pic_set_mask(uint16_t mask)
 	outb(SLAVE_DATA_PORT, ((mask >> 8) & 0xFF));
 }
 
+void pic_unmask_irq(uint8_t irq)
+{
+	uint16_t port = irq < 8 ? MASTER_DATA_PORT : SLAVE_DATA_PORT;
+
+	outb(port, inb(port) & ~(1 << (irq % 8)));
+}
+
 void pic_send_eoi(uint8_t irq)
 {
 	// it's only necessary to send an eoi to the slave if the IRQ came from it
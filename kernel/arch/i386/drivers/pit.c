@@ -0,0 +1,96 @@
+/**
+ * Code for the Programmable Interval Timer.
+ * 
+ * Refer to:
+ * https://wiki.osdev.org/Programmable_Interval_Timer
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/arch/i386/drivers/pit.h>
+#include <kernel/arch/i386/drivers/pic.h>
+#include <kernel/arch/i386/io.h>
+#include <kernel/time/timer.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CHANNEL0_DATA_PORT	0x40
+#define CHANNEL2_DATA_PORT	0x42
+#define COMMAND_PORT		0x43
+#define CHANNEL2_GATE_PORT	0x61
+
+/* Access the low and then the high byte of the count, mode 0 (interrupt on terminal count) */
+#define CHANNEL0_ONESHOT	0x30
+#define CHANNEL2_ONESHOT	0xB0
+
+#define GATE_CHANNEL2		(1 << 0)	/* Channel 2 counts while set */
+#define GATE_SPEAKER		(1 << 1)
+#define GATE_OUT2			(1 << 5)	/* Channel 2's output, set once the count reaches 0 */
+
+#define TIMER_IRQ			0
+
+#define MAX_COUNT			0xFFFF
+#define MIN_COUNT			2
+
+
+static void pit_set_next_event(uint32_t ticks);
+static void pit_stop(void);
+
+
+static clock_event_t pit_clock_event = {
+	.name = "PIT",
+	.set_next_event = pit_set_next_event,
+	.stop = pit_stop,
+};
+
+
+clock_event_t* pit_clock_event_init(void)
+{
+	clock_event_config(&pit_clock_event, PIT_FREQUENCY, MIN_COUNT, MAX_COUNT);
+
+	pit_stop();
+	pic_unmask_irq(TIMER_IRQ);
+
+	return &pit_clock_event;
+}
+
+
+void pit_channel2_start(uint16_t count)
+{
+	/* Disable the speaker and stop the count while it's programmed */
+	uint8_t gate = inb(CHANNEL2_GATE_PORT) & ~(GATE_SPEAKER | GATE_CHANNEL2);
+	outb(CHANNEL2_GATE_PORT, gate);
+
+	outb(COMMAND_PORT, CHANNEL2_ONESHOT);
+	outb(CHANNEL2_DATA_PORT, (uint8_t) (count & 0xFF));
+	outb(CHANNEL2_DATA_PORT, (uint8_t) ((count >> 8) & 0xFF));
+
+	outb(CHANNEL2_GATE_PORT, gate | GATE_CHANNEL2);
+}
+
+bool pit_channel2_done(void)
+{
+	return inb(CHANNEL2_GATE_PORT) & GATE_OUT2;
+}
+
+
+/**
+ * Raises IRQ0 once after the given number of PIT ticks.
+ * 
+ * @param ticks the number of ticks, at most MAX_COUNT
+*/
+static void pit_set_next_event(uint32_t ticks)
+{
+	outb(COMMAND_PORT, CHANNEL0_ONESHOT);
+	outb(CHANNEL0_DATA_PORT, (uint8_t) (ticks & 0xFF));
+	outb(CHANNEL0_DATA_PORT, (uint8_t) ((ticks >> 8) & 0xFF));
+}
+
+/**
+ * Stops channel 0, which doesn't count again until a new count is written.
+*/
+static void pit_stop(void)
+{
+	outb(COMMAND_PORT, CHANNEL0_ONESHOT);
+}
@@ -0,0 +1,142 @@
+/**
+ * Code for the CMOS Real-Time Clock.
+ * 
+ * The RTC is only read once at boot to set the wall-clock time, which is then
+ * kept by the clocksource.
+ * 
+ * Refer to:
+ * https://wiki.osdev.org/CMOS
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/arch/i386/drivers/rtc.h>
+#include <kernel/arch/i386/io.h>
+#include <kernel/arch/i386/system.h>
+#include <kernel/time/ktime.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define CMOS_ADDRESS_PORT	0x70
+#define CMOS_DATA_PORT		0x71
+
+/* Setting bit 7 of the address disables NMIs while the CMOS is accessed */
+#define CMOS_NMI_DISABLE	0x80
+
+#define REG_SECONDS			0x00
+#define REG_MINUTES			0x02
+#define REG_HOURS			0x04
+#define REG_DAY				0x07
+#define REG_MONTH			0x08
+#define REG_YEAR			0x09
+#define REG_STATUS_A		0x0A
+#define REG_STATUS_B		0x0B
+#define REG_CENTURY			0x32	/* Not guaranteed to exist, see ACPI's FADT */
+
+#define STATUS_A_UIP		(1 << 7)	/* An update is in progress */
+#define STATUS_B_24H		(1 << 1)
+#define STATUS_B_BINARY		(1 << 2)
+
+#define HOUR_PM				0x80
+
+#define BCD_TO_BIN(v)		(((v) & 0x0F) + ((v) >> 4) * 10)
+
+
+typedef struct rtc_time_s {
+	uint8_t sec;
+	uint8_t min;
+	uint8_t hour;
+	uint8_t day;
+	uint8_t month;
+	uint8_t year;
+	uint8_t century;
+} rtc_time_t;
+
+
+uint64_t rtc_read_time(void);
+
+static void rtc_read_regs(rtc_time_t* time);
+static uint8_t cmos_read(uint8_t reg);
+
+
+/* Global Functions */
+
+uint64_t rtc_read_time(void)
+{
+	rtc_time_t time, last;
+
+	uint32_t flags = irq_save();
+
+	/*
+	 * The registers may be read while the RTC is updating them, so they're read
+	 * until two reads in a row agree.
+	*/
+	rtc_read_regs(&time);
+	do {
+		last = time;
+		rtc_read_regs(&time);
+	} while (memcmp(&time, &last, sizeof(rtc_time_t)) != 0);
+
+	uint8_t status_b = cmos_read(REG_STATUS_B);
+
+	irq_restore(flags);
+
+	bool pm = time.hour & HOUR_PM;
+	time.hour &= ~HOUR_PM;
+
+	if (!(status_b & STATUS_B_BINARY)) {
+		time.sec = BCD_TO_BIN(time.sec);
+		time.min = BCD_TO_BIN(time.min);
+		time.hour = BCD_TO_BIN(time.hour);
+		time.day = BCD_TO_BIN(time.day);
+		time.month = BCD_TO_BIN(time.month);
+		time.year = BCD_TO_BIN(time.year);
+		time.century = BCD_TO_BIN(time.century);
+	}
+
+	/* 12 hour mode goes from 12 AM to 11 PM */
+	if (!(status_b & STATUS_B_24H))
+		time.hour = (time.hour % 12) + (pm ? 12 : 0);
+
+	unsigned int year = time.century >= 19 && time.century <= 99 ?
+						time.century * 100 + time.year :
+						2000 + time.year;
+
+	return mktime64(year, time.month, time.day, time.hour, time.min, time.sec);
+}
+
+
+/* Helper Functions */
+
+/**
+ * Reads the date and time registers, once no update is in progress.
+ * 
+ * @param time where the values of the registers are stored
+*/
+static void rtc_read_regs(rtc_time_t* time)
+{
+	while (cmos_read(REG_STATUS_A) & STATUS_A_UIP) {}
+
+	time->sec = cmos_read(REG_SECONDS);
+	time->min = cmos_read(REG_MINUTES);
+	time->hour = cmos_read(REG_HOURS);
+	time->day = cmos_read(REG_DAY);
+	time->month = cmos_read(REG_MONTH);
+	time->year = cmos_read(REG_YEAR);
+	time->century = cmos_read(REG_CENTURY);
+}
+
+/**
+ * Reads a CMOS register.
+ * 
+ * @param reg the register
+ * 
+ * @return the value of the register
+*/
+static uint8_t cmos_read(uint8_t reg)
+{
+	outb(CMOS_ADDRESS_PORT, CMOS_NMI_DISABLE | reg);
+	return inb(CMOS_DATA_PORT);
+}
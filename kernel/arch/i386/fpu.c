@@ -0,0 +1,215 @@
+/**
+ * Code for managing the FPU/SSE state of threads.
+ * 
+ * The state is switched lazily: the registers stay loaded with the state of the
+ * thread that last used them, and switching to any other thread only sets CR0.TS.
+ * The first FPU/SSE instruction of that thread then raises #NM, which saves the
+ * owner's state and loads the thread's own, so threads that never use the FPU
+ * don't pay for it on context switches.
+ * 
+ * The kernel uses the registers between kernel_fpu_begin() and kernel_fpu_end(),
+ * which save the owner's state up front.
+ * 
+ * Refer to:
+ * Intel Software Developer Manual, Volume 1: Chapter 13.4: Designing OS Facilities for Saving x87 FPU, SSE and Extended States
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/arch/i386/fpu.h>
+#include <kernel/arch/i386/cpu.h>
+#include <kernel/arch/i386/system.h>
+#include <kernel/sched/sched.h>
+#include <kernel/mm/slab.h>
+#include <kernel/smp.h>
+#include <kernel/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+static bool fpu_enabled;
+
+static struct kmem_cache_s* fpu_state_cache;
+
+static thread_t* fpu_owners[MAX_CPUS];		/* The thread whose state is in the registers */
+static bool fpu_ts[MAX_CPUS];				/* CR0.TS is set */
+static bool kernel_fpu_active[MAX_CPUS];
+
+
+void fpu_enable(void);
+void fpu_init(void);
+void fpu_init_cpu(void);
+void fpu_switch(thread_t* next);
+void fpu_handle_nm(void);
+void fpu_release(thread_t* thread);
+
+bool kernel_fpu_usable(void);
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+static void fpu_save(thread_t* thread);
+static void set_ts(unsigned int cpu, bool ts);
+
+
+/* Global Functions */
+
+void fpu_enable(void)
+{
+	if (!(cpu_info.features_edx & CPUID_EDX_FXSR) || !(cpu_info.features_edx & CPUID_EDX_SSE))
+		return;
+
+	write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE);
+
+	uint32_t cr4;
+	asm volatile("mov %0, cr4" : "=r" (cr4));
+	asm volatile("mov cr4, %0" : : "r" (cr4 | CR4_OSFXSR | CR4_OSXMMEXCPT));
+
+	asm volatile("fninit");
+
+	fpu_enabled = true;
+}
+
+void fpu_init(void)
+{
+	if (!fpu_enabled)
+		return;
+
+	fpu_state_cache = kmem_cache_create("fpu_state", FPU_STATE_SIZE, FPU_STATE_ALIGN, 0, NULL, NULL);
+
+	/* No thread owns the registers yet */
+	set_ts(smp_cpu_id(), true);
+}
+
+void fpu_init_cpu(void)
+{
+	fpu_enable();
+
+	if (fpu_enabled)
+		set_ts(smp_cpu_id(), true);
+}
+
+
+void fpu_switch(thread_t* next)
+{
+	if (!fpu_enabled)
+		return;
+
+	unsigned int cpu = smp_cpu_id();
+
+	set_ts(cpu, next != fpu_owners[cpu]);
+}
+
+void fpu_handle_nm(void)
+{
+	ASSERT(fpu_enabled);
+
+	unsigned int cpu = smp_cpu_id();
+	thread_t* thread = thread_current();
+
+	set_ts(cpu, false);
+
+	if (fpu_owners[cpu] == thread)
+		return;
+
+	if (fpu_owners[cpu] != NULL)
+		fpu_save(fpu_owners[cpu]);
+
+	if (thread->fpu_state != NULL)
+		asm volatile("fxrstor [%0]" : : "r" (thread->fpu_state));
+	else
+	{
+		/* First use, the thread starts with a clean state */
+		thread->fpu_state = kmem_cache_alloc(fpu_state_cache);
+
+		uint32_t mxcsr = MXCSR_DEFAULT;
+		asm volatile("fninit\n\t" "ldmxcsr [%0]" : : "r" (&mxcsr));
+	}
+
+	fpu_owners[cpu] = thread;
+}
+
+void fpu_release(thread_t* thread)
+{
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+		if (fpu_owners[cpu] == thread)
+			fpu_owners[cpu] = NULL;
+
+	if (thread->fpu_state != NULL) {
+		kmem_cache_free(fpu_state_cache, thread->fpu_state);
+		thread->fpu_state = NULL;
+	}
+}
+
+
+bool kernel_fpu_usable(void)
+{
+	return fpu_enabled && !kernel_fpu_active[smp_cpu_id()];
+}
+
+void kernel_fpu_begin(void)
+{
+	preempt_disable();
+
+	uint32_t flags = irq_save();
+	unsigned int cpu = smp_cpu_id();
+
+	ASSERT(fpu_enabled && !kernel_fpu_active[cpu]);
+	kernel_fpu_active[cpu] = true;
+
+	set_ts(cpu, false);
+
+	/* The owner reloads its state through #NM the next time it uses it */
+	if (fpu_owners[cpu] != NULL) {
+		fpu_save(fpu_owners[cpu]);
+		fpu_owners[cpu] = NULL;
+	}
+
+	irq_restore(flags);
+}
+
+void kernel_fpu_end(void)
+{
+	uint32_t flags = irq_save();
+	unsigned int cpu = smp_cpu_id();
+
+	set_ts(cpu, true);
+	kernel_fpu_active[cpu] = false;
+
+	irq_restore(flags);
+
+	preempt_enable();
+}
+
+
+/* Helper Functions */
+
+/**
+ * Saves the FPU/SSE registers to a thread's state.
+ * 
+ * @param thread the thread owning the registers
+*/
+static void fpu_save(thread_t* thread)
+{
+	asm volatile("fxsave [%0]" : : "r" (thread->fpu_state) : "memory");
+}
+
+/**
+ * Sets or clears CR0.TS, skipping the write if it's already in that state.
+ * 
+ * @param cpu the current CPU
+ * @param ts true to set CR0.TS
+*/
+static void set_ts(unsigned int cpu, bool ts)
+{
+	if (fpu_ts[cpu] == ts)
+		return;
+
+	if (ts)
+		stts();
+	else
+		clts();
+
+	fpu_ts[cpu] = ts;
+}
@@ -1,6 +1,9 @@
 /**
  * Code for setting up the Global Descriptor Table.
  * 
+ * Each CPU has its own GDT and TSS, as the TSS holds the CPU's kernel stack, and
+ * its own per-CPU data segment. The selectors are the same on every CPU.
+ * 
  * Refer to:
  * Intel Software Developer Manual, Volume 3-A: Chapter 3.4.5: Segment Descriptors
  * https://wiki.osdev.org/Global_Descriptor_Table
@@ -10,6 +13,8 @@
 */
 
 #include <kernel/arch/i386/system.h>
+#include <kernel/arch/i386/percpu.h>
+#include <kernel/smp.h>
 
 #include <stdint.h>
 #include <string.h>
@@ -25,6 +30,7 @@
 #define TASK_STATE_SEGMENT_ACCESS_BYTE 			0x89
 
 #define LEGACY_MODE_SEGMENT_FLAGS     			0xC
+#define BYTE_GRANULAR_SEGMENT_FLAGS				0x4		/* 32-bit, with the limit in bytes */
 
 
 extern void load_kernel_segments(void);
@@ -61,7 +67,7 @@ struct tss_entry {
 	uint32_t ldt;
 	uint16_t trap;
 	uint16_t iomap_base;
-} tss;
+};
 
 /* Global Descriptor Table 
  * Except for a null descriptor in the fist position, this format is not global for all GDTs.
@@ -74,7 +80,11 @@ struct gdt {
 	uint8_t user_mode_code_segment[8];
 	uint8_t user_mode_data_segment[8];
 	uint8_t task_state_segment[8];
-} gdt;
+	uint8_t percpu_segment[8];
+};
+
+static struct tss_entry cpu_tss[MAX_CPUS];
+static struct gdt cpu_gdts[MAX_CPUS];
 
 /* Segment Descriptor structure:
 *	bits 63:56 - Base Address [31:24]
@@ -117,27 +127,51 @@ static void encode_segment_descriptor(uint8_t entry[8], uint32_t base, uint32_t
  *  bits 36:16 - the Global Descriptor Table's base address
  *  bits 15:0 -  the Global Descriptor Table's size
 */
-static uint16_t gdtd[3];
+static uint16_t gdtd[MAX_CPUS][3];
 
 extern void kernel_end_of_stack(void); 
 
-void gdt_init(void)
+/**
+ * 	Loads the GDT and TSS of a CPU, and points gs to its per-CPU data.
+ * 
+ * 	@param cpu the ID of the current CPU
+*/
+void gdt_init(unsigned int cpu)
 {
-	tss.ss0 = 0x10;
-	tss.esp0 = (uint32_t)kernel_end_of_stack;
+	struct tss_entry* tss = &cpu_tss[cpu];
+	struct gdt* gdt = &cpu_gdts[cpu];
+
+	cpu_locals[cpu].self = &cpu_locals[cpu];
+	cpu_locals[cpu].id = cpu;
+
+	/* Replaced by the running thread's stack on each switch */
+	tss->ss0 = 0x10;
+	tss->esp0 = (uint32_t)kernel_end_of_stack;
 
-	encode_segment_descriptor(gdt.null_descriptor, 0x0, 0x0, 0x0, 0x0);
-	encode_segment_descriptor(gdt.kernel_mode_code_segment, FLAT_MODEL_BASE, FLAT_MODEL_LIMIT, KERNEL_MODE_CODE_SEGMENT_ACCESS_BYTE, LEGACY_MODE_SEGMENT_FLAGS);
-	encode_segment_descriptor(gdt.kernel_mode_data_segment, FLAT_MODEL_BASE, FLAT_MODEL_LIMIT, KERNEL_MODE_DATA_SEGMENT_ACCESS_BYTE, LEGACY_MODE_SEGMENT_FLAGS);
-	encode_segment_descriptor(gdt.user_mode_code_segment, FLAT_MODEL_BASE, FLAT_MODEL_LIMIT, USER_MODE_CODE_SEGMENT_ACCESS_BYTE, LEGACY_MODE_SEGMENT_FLAGS);
-	encode_segment_descriptor(gdt.user_mode_data_segment, FLAT_MODEL_BASE, FLAT_MODEL_LIMIT, USER_MODE_DATA_SEGMENT_ACCESS_BYTE, LEGACY_MODE_SEGMENT_FLAGS);
-	encode_segment_descriptor(gdt.task_state_segment, (uint32_t)&tss, sizeof(struct tss_entry)-1, TASK_STATE_SEGMENT_ACCESS_BYTE, 0x0);
+	encode_segment_descriptor(gdt->null_descriptor, 0x0, 0x0, 0x0, 0x0);
+	encode_segment_descriptor(gdt->kernel_mode_code_segment, FLAT_MODEL_BASE, FLAT_MODEL_LIMIT, KERNEL_MODE_CODE_SEGMENT_ACCESS_BYTE, LEGACY_MODE_SEGMENT_FLAGS);
+	encode_segment_descriptor(gdt->kernel_mode_data_segment, FLAT_MODEL_BASE, FLAT_MODEL_LIMIT, KERNEL_MODE_DATA_SEGMENT_ACCESS_BYTE, LEGACY_MODE_SEGMENT_FLAGS);
+	encode_segment_descriptor(gdt->user_mode_code_segment, FLAT_MODEL_BASE, FLAT_MODEL_LIMIT, USER_MODE_CODE_SEGMENT_ACCESS_BYTE, LEGACY_MODE_SEGMENT_FLAGS);
+	encode_segment_descriptor(gdt->user_mode_data_segment, FLAT_MODEL_BASE, FLAT_MODEL_LIMIT, USER_MODE_DATA_SEGMENT_ACCESS_BYTE, LEGACY_MODE_SEGMENT_FLAGS);
+	encode_segment_descriptor(gdt->task_state_segment, (uint32_t)tss, sizeof(struct tss_entry)-1, TASK_STATE_SEGMENT_ACCESS_BYTE, 0x0);
+	encode_segment_descriptor(gdt->percpu_segment, (uint32_t)&cpu_locals[cpu], sizeof(cpu_local_t)-1, KERNEL_MODE_DATA_SEGMENT_ACCESS_BYTE, BYTE_GRANULAR_SEGMENT_FLAGS);
 
-	gdtd[2] = (uint16_t) (((uint32_t) &gdt >> 16) & 0xFFFF);
-	gdtd[1] = (uint16_t) ((uint32_t) &gdt & 0xFFFF);
-	gdtd[0] = (uint16_t) sizeof(struct gdt);
+	gdtd[cpu][2] = (uint16_t) (((uint32_t) gdt >> 16) & 0xFFFF);
+	gdtd[cpu][1] = (uint16_t) ((uint32_t) gdt & 0xFFFF);
+	gdtd[cpu][0] = (uint16_t) sizeof(struct gdt);
 
-	asm volatile("lgdt [%0]" : : "r" (gdtd));
+	asm volatile("lgdt [%0]" : : "r" (gdtd[cpu]));
 	
 	load_kernel_segments();
+	flush_tss();
+}
+
+/**
+ * Sets the stack the CPU switches to when an interrupt arrives in user mode.
+ * 
+ * @param esp0 the top of the current thread's kernel stack
+*/
+void tss_set_kernel_stack(uint32_t esp0)
+{
+	cpu_tss[smp_cpu_id()].esp0 = esp0;
 }
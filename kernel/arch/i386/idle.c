@@ -0,0 +1,61 @@
+/**
+ * Code for the idle loop.
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/system.h>
+#include <kernel/mm/mm.h>
+#include <kernel/sched/sched.h>
+#include <kernel/time/timer.h>
+#include <kernel/time/ktime.h>
+#include <kernel/smp.h>
+
+#include <kernel/arch/i386/system.h>
+
+
+/* The number of pages zeroed before checking for other work */
+#define IDLE_ZERO_BATCH		8
+
+/* How often the slab caches that went unused are reaped */
+#define IDLE_REAP_INTERVAL_NS	(1 * NSEC_PER_SEC)
+
+
+/**
+ * Runs as the idle thread when there's nothing else to do, doing deferred work
+ * in small batches and halting once there's none left.
+ * 
+ * The tick is stopped while halted, so only pending timers and device interrupts
+ * wake the CPU up.
+*/
+void cpu_idle(void)
+{
+	uint64_t next_reap = ktime_get_ns() + IDLE_REAP_INTERVAL_NS;
+
+	while (1)
+	{
+		if (sched_need_resched()) {
+			tick_nohz_idle_exit();
+			schedule();
+			continue;
+		}
+
+		if (zpool_refill(IDLE_ZERO_BATCH))
+			continue;
+
+		/* Only the boot CPU reaps, as each call also clears the caches' active hints */
+		if (smp_cpu_id() == 0 && ktime_get_ns() >= next_reap) {
+			kmem_reap_idle();
+			next_reap = ktime_get_ns() + IDLE_REAP_INTERVAL_NS;
+		}
+
+		/* sti only takes effect after hlt, so a wakeup can't slip in between */
+		IRQ_OFF;
+		if (!sched_need_resched()) {
+			tick_nohz_idle_enter();
+			asm volatile("sti\n\t" "hlt");
+		}
+		else
+			IRQ_ON;
+	}
+}
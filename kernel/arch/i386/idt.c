@@ -61,9 +61,15 @@ extern void interrupt_handler_45();
 extern void interrupt_handler_46();
 extern void interrupt_handler_47();
 
+extern void interrupt_handler_48();
+extern void interrupt_handler_49();
+extern void interrupt_handler_50();
+extern void interrupt_handler_63();
+
 
 #define HARDWARE_INTERRUPT_ENTRIES   32
 #define IRQ_ENTRIES					 16
+#define APIC_ENTRIES				 16
 #define MAX_INTERRUPT_ENTRIES        256
 
 #define KERNEL_CODE_SEGMENT_SELECTOR 0x8
@@ -86,7 +92,7 @@ struct igd {
 	uint16_t offset_ub;
 };
 
-static struct igd idt[HARDWARE_INTERRUPT_ENTRIES + IRQ_ENTRIES];
+static struct igd idt[HARDWARE_INTERRUPT_ENTRIES + IRQ_ENTRIES + APIC_ENTRIES];
 
 /**
  * Encodes the Interrupt Gate Descriptor with the given values.
@@ -117,6 +123,8 @@ static void encode_igd(unsigned int vector_id, uint32_t handler, uint8_t flags,
 */
 static uint16_t idtd[3];
 
+void idt_load(void);
+
 void idt_init(void)
 {
 	encode_igd(0, (uint32_t) interrupt_handler_0, HARDWARE_INTERRUPT_FLAGS, BIT32_INTERRUPT_GATE);
@@ -169,9 +177,23 @@ void idt_init(void)
 	encode_igd(46, (uint32_t) interrupt_handler_46, HARDWARE_INTERRUPT_FLAGS, BIT32_INTERRUPT_GATE);
 	encode_igd(47, (uint32_t) interrupt_handler_47, HARDWARE_INTERRUPT_FLAGS, BIT32_INTERRUPT_GATE);
 
+	encode_igd(48, (uint32_t) interrupt_handler_48, HARDWARE_INTERRUPT_FLAGS, BIT32_INTERRUPT_GATE);
+	encode_igd(49, (uint32_t) interrupt_handler_49, HARDWARE_INTERRUPT_FLAGS, BIT32_INTERRUPT_GATE);
+	encode_igd(50, (uint32_t) interrupt_handler_50, HARDWARE_INTERRUPT_FLAGS, BIT32_INTERRUPT_GATE);
+	encode_igd(63, (uint32_t) interrupt_handler_63, HARDWARE_INTERRUPT_FLAGS, BIT32_INTERRUPT_GATE);
+
 	idtd[2] = (uint16_t) (((uint32_t) idt >> 16) & 0xFFFF);
 	idtd[1] = (uint16_t) ((uint32_t) idt & 0xFFFF);
 	idtd[0] = (uint16_t) sizeof(idt);
 
-	asm volatile("lidt [%0]\n\t" "sti" : : "r" (idtd));
+	idt_load();
+	asm volatile("sti");
+}
+
+/**
+ * 	Loads the IDT on the current CPU, the CPUs all share it.
+*/
+void idt_load(void)
+{
+	asm volatile("lidt [%0]" : : "r" (idtd));
 }
@@ -12,8 +12,13 @@
 
 #include <kernel/arch/i386/drivers/pic.h>
 #include <kernel/arch/i386/drivers/keyboard.h>
+#include <kernel/arch/i386/drivers/lapic.h>
 #include <kernel/arch/i386/system.h>
+#include <kernel/arch/i386/fpu.h>
+#include <kernel/sched/sched.h>
+#include <kernel/time/timer.h>
 #include <kernel/syscall.h>
+#include <kernel/mm/fault.h>
 
 #include <stdint.h>
 #include <stdio.h>
@@ -22,6 +27,7 @@
 
 
 struct isr_frame {
+	uint32_t gs;
 	uint32_t regs[8];
 	uint32_t vector_id;
 	uint32_t error_code;
@@ -30,8 +36,23 @@ struct isr_frame {
 
 void isr_handler(struct isr_frame isr_frame)
 {
-	printf("Interrupt: %d\n", isr_frame.vector_id);
-	BOCHS_MAGIC_BREAKPOINT;
+	/* Page faults are part of normal operation, so they skip the debug output */
+	if (isr_frame.vector_id == 14) {
+		page_fault_handler(read_cr2(), isr_frame.error_code);
+		return;
+	}
+
+	/* So are #NM, raised by the first FPU/SSE instruction after a thread switch */
+	if (isr_frame.vector_id == 7) {
+		fpu_handle_nm();
+		return;
+	}
+
+	/* Hardware interrupts are part of normal operation too */
+	if (isr_frame.vector_id < PIC_OFFSET) {
+		printf("Interrupt: %d\n", isr_frame.vector_id);
+		BOCHS_MAGIC_BREAKPOINT;
+	}
 
 	switch(isr_frame.vector_id) {
 		case(0): break;
@@ -67,7 +88,8 @@ void isr_handler(struct isr_frame isr_frame)
 		case(30): break;
 		case(31): break;
 
-		case(32): pic_send_eoi(isr_frame.vector_id - PIC_OFFSET); break;
+		case(32): pic_send_eoi(isr_frame.vector_id - PIC_OFFSET);
+			timer_interrupt(); break;
 		case(33): keyboard_read_input();
 			pic_send_eoi(isr_frame.vector_id - PIC_OFFSET); break;
 		case(34): pic_send_eoi(isr_frame.vector_id - PIC_OFFSET); break;
@@ -85,8 +107,17 @@ void isr_handler(struct isr_frame isr_frame)
 		case(46): pic_send_eoi(isr_frame.vector_id - PIC_OFFSET); break;
 		case(47): pic_send_eoi(isr_frame.vector_id - PIC_OFFSET); break;
 
+		case(LAPIC_TIMER_VECTOR): lapic_eoi(); timer_interrupt(); break;
+		case(LAPIC_TLB_VECTOR): tlb_shootdown_interrupt(); lapic_eoi(); break;
+		case(LAPIC_RESCHED_VECTOR): lapic_eoi(); break;
+		case(LAPIC_SPURIOUS_VECTOR): break;
+
 		case(0x80): printf("1\n"); syscall_handler(isr_frame.regs[7]); break;
 
 		default: break;
 	}
+
+	/* Switch threads if the interrupt woke up or preempted one */
+	if (isr_frame.vector_id >= PIC_OFFSET)
+		sched_preempt();
 }
@@ -8,6 +8,9 @@
 #include <kernel/system.h>
 #include <kernel/mm/mm.h>
 #include <kernel/fs/fs.h>
+#include <kernel/sched/sched.h>
+#include <kernel/smp.h>
+#include <kernel/bench.h>
 
 #include <kernel/arch/i386/drivers/vga.h>
 #include <kernel/arch/i386/drivers/serial.h>
@@ -15,6 +18,8 @@
 #include <kernel/arch/i386/drivers/pci.h>
 #include <kernel/arch/i386/drivers/ata.h>
 #include <kernel/arch/i386/io.h>
+#include <kernel/arch/i386/cpu.h>
+#include <kernel/arch/i386/fpu.h>
 #include <kernel/arch/i386/system.h>
 
 #include <stdio.h>
@@ -23,9 +28,12 @@
 #include <sys/types.h>
 
 
-extern void gdt_init(void);
+extern void gdt_init(unsigned int cpu);
 extern void idt_init(void);
 extern void jump_to_user_func(void);
+extern void time_init(void);
+
+static void init_thread(void* arg);
 
 
 int kmain(multiboot_info_t* mbi, uint32_t magic)
@@ -37,20 +45,51 @@ int kmain(multiboot_info_t* mbi, uint32_t magic)
 		PANIC("Invalid magic number");
 	}
 
+	/* First, as everything that reads the CPU's ID goes through the GDT's per-CPU segment */
+	gdt_init(0);
+	printf("Loaded GDT\n");
+
+	cpu_init();
+	printf("Detected %s CPU\n", cpu_info.vendor);
+
 	mm_init(mbi);
 	printf("Detected Memory\n");
 	printf("Initialized Page Allocator\n");
 	printf("Initialized Slab Allocator\n");
 
-	gdt_init();
-	printf("Loaded GDT\n");
-
 	pic_init();
 	printf("Initialized PIC\n");
 
 	idt_init();
 	printf("Loaded IDT\n");
 
+	sched_init();
+	printf("Initialized Scheduler\n");
+
+	time_init();
+	printf("Initialized Timers\n");
+
+	fpu_init();
+
+	smp_init();
+	printf("Started %u CPU(s)\n", num_cpus);
+
+	/* The rest runs in its own thread, the boot context becomes the idle thread */
+	thread_create("init", init_thread, NULL, PRIO_DEFAULT);
+
+	return 0;
+}
+
+
+/**
+ * Finishes loading the kernel and runs the user program.
+ * 
+ * @param arg unused
+*/
+static void init_thread(void* arg)
+{
+	(void) arg;
+
 	ata_init();
 	printf("Detected %hhu ATA Device(s)\n", num_ata_devs);
 
@@ -59,9 +98,11 @@ int kmain(multiboot_info_t* mbi, uint32_t magic)
 		printf("Initialized File System\n");
 	}
 
+#ifdef KERNEL_BENCH
+	bench_run_all();
+#endif
+
 	printf("Finished Loading\n");
 
 	jump_to_user_func();
-
-	return 0;
 }
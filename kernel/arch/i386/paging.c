@@ -1,7 +1,330 @@
 /**
  * Code for Paging.
  * 
+ * TLB invalidations of mappings that other CPUs may use are gathered in TLB batches,
+ * which are sent to the other CPUs as a shootdown IPI when flushed.
+ * 
  * @author Samuel Pires
 */
 
 #include <kernel/arch/i386/paging.h>
+#include <kernel/mm/mm.h>
+#include <kernel/mm/slab.h>
+#include <kernel/ds/list.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/smp.h>
+#include <kernel/system.h>
+
+#include <kernel/arch/i386/drivers/lapic.h>
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+
+/*
+ * The page tables mapping kernel space above low memory, contiguous and preallocated
+ * in boot.S. Low memory itself is mapped with global large pages.
+*/
+extern pte_t kernel_page_tables[];
+
+#define KERNEL_MAPPED_START		(KERNEL_OFFSET + HIGH_MEM_START)
+
+#define KERNEL_PTE(vaddr)		(kernel_page_tables + ((vaddr) - KERNEL_MAPPED_START) / PAGE_SIZE)
+
+#define PT_VIRT(pde)			((pte_t*) P2V((uintptr_t) PDE_ADDR_FIELD(pde)))
+
+
+/* Page tables allocated after boot, which are zeroed when freed */
+static struct kmem_cache_s* page_table_cache;
+
+/*
+ * The TLB shootdown being sent to the other CPUs. Only one is sent at a time,
+ * under shootdown_lock, and each CPU it's sent to has its pending flag set until
+ * it's done the invalidations.
+*/
+static tlb_batch_t shootdown;
+static spinlock_t shootdown_lock = SPINLOCK_INIT("tlb_shootdown");
+static volatile bool shootdown_pending[MAX_CPUS];
+static volatile unsigned int shootdown_acks;
+
+
+static void tlb_shootdown(const tlb_batch_t* batch);
+static void tlb_batch_invalidate(const tlb_batch_t* batch);
+static inline void set_pte(pte_t* ptep, pte_t pte);
+
+
+/* Global Functions */
+
+void paging_init(void)
+{
+	page_table_cache = kmem_cache_create("page_table", PT_SIZE, PT_ALIGNMENT, SLAB_ZERO, NULL, NULL);
+}
+
+
+void tlb_batch_init(tlb_batch_t* batch)
+{
+	batch->num_addrs = 0;
+	batch->flush_all = false;
+	batch->global = false;
+	LIST_INIT(batch->frames);
+}
+
+void tlb_batch_add(tlb_batch_t* batch, uintptr_t vaddr, pte_t old_pte)
+{
+	if (old_pte & PAGE_GLOBAL)
+		batch->global = true;
+
+	if (batch->num_addrs < TLB_BATCH_SIZE)
+		batch->addrs[batch->num_addrs++] = vaddr;
+	else
+		batch->flush_all = true;
+}
+
+void tlb_batch_free_frame(tlb_batch_t* batch, struct page_s* page)
+{
+	list_add_last(&batch->frames, &page->list);
+}
+
+void tlb_batch_flush(tlb_batch_t* batch)
+{
+	tlb_batch_invalidate(batch);
+	tlb_shootdown(batch);
+
+	list_t* entry;
+	while ((entry = list_remove_first(&batch->frames)) != NULL)
+		free_frame((page_t*) entry);
+
+	tlb_batch_init(batch);
+}
+
+void tlb_shootdown_interrupt(void)
+{
+	unsigned int cpu = smp_cpu_id();
+
+	/* The request may already have been done while waiting for shootdown_lock */
+	if (!__atomic_exchange_n(&shootdown_pending[cpu], false, __ATOMIC_ACQUIRE))
+		return;
+
+	tlb_batch_invalidate(&shootdown);
+	__atomic_fetch_sub(&shootdown_acks, 1, __ATOMIC_RELEASE);
+}
+
+
+pte_t* paging_walk(pde_t* pd, uintptr_t vaddr, bool create)
+{
+	pde_t* pde = pd + ADDR_TO_PDE_INDEX(vaddr);
+
+	if (!(*pde & PAGE_PRESENT))
+	{
+		if (!create)
+			return NULL;
+
+		pte_t* pt = kmem_cache_alloc(page_table_cache);
+		if (pt == NULL)
+			return NULL;
+
+		unsigned int flags = PAGE_PRESENT | PAGE_WRITE | (vaddr < KERNEL_OFFSET ? PAGE_USER : 0);
+		set_pte(pde, PDE((pde_t) V2P((uintptr_t) pt), flags));
+	}
+
+	/* Large pages would have to be split first */
+	ASSERT(!(*pde & PAGE_LARGE));
+
+	return PT_VIRT(*pde) + ADDR_TO_PTE_INDEX(vaddr);
+}
+
+int paging_map_range(pde_t* pd, uintptr_t vaddr, phys_addr_t paddr, size_t num_pages, unsigned int flags, tlb_batch_t* batch)
+{
+	pte_t* pte = NULL;
+
+	for (size_t i = 0; i < num_pages; i++, vaddr += PAGE_SIZE, paddr += PAGE_SIZE)
+	{
+		/* The page directory is only walked again when crossing into the next page table */
+		if (pte == NULL || ADDR_TO_PTE_INDEX(vaddr) == 0) {
+			pte = paging_walk(pd, vaddr, true);
+			if (pte == NULL)
+				return -1;
+		}
+		else
+			pte++;
+
+		if (*pte & PAGE_PRESENT)
+			tlb_batch_add(batch, vaddr, *pte);
+
+		set_pte(pte, PTE(PTE_ADDR_FIELD(paddr), flags | PAGE_PRESENT));
+	}
+
+	return 0;
+}
+
+void paging_unmap_range(pde_t* pd, uintptr_t vaddr, size_t num_pages, bool free_frames, tlb_batch_t* batch)
+{
+	pte_t* pte = NULL;
+
+	for (size_t i = 0; i < num_pages; i++, vaddr += PAGE_SIZE)
+	{
+		if (pte == NULL || ADDR_TO_PTE_INDEX(vaddr) == 0)
+			pte = paging_walk(pd, vaddr, false);
+		else
+			pte++;
+
+		/* The page table doesn't exist, so skip it */
+		if (pte == NULL)
+			continue;
+
+		if (!(*pte & PAGE_PRESENT))
+			continue;
+
+		if (free_frames)
+			tlb_batch_free_frame(batch, pfn_to_page(PTE_ADDR_FIELD(*pte) / PAGE_SIZE));
+
+		tlb_batch_add(batch, vaddr, *pte);
+		set_pte(pte, 0);
+	}
+}
+
+void paging_protect_range(pde_t* pd, uintptr_t vaddr, size_t num_pages, unsigned int flags, tlb_batch_t* batch)
+{
+	pte_t* pte = NULL;
+
+	for (size_t i = 0; i < num_pages; i++, vaddr += PAGE_SIZE)
+	{
+		if (pte == NULL || ADDR_TO_PTE_INDEX(vaddr) == 0)
+			pte = paging_walk(pd, vaddr, false);
+		else
+			pte++;
+
+		if (pte == NULL || !(*pte & PAGE_PRESENT))
+			continue;
+
+		pte_t new_pte = PTE(PTE_ADDR_FIELD(*pte), flags | PAGE_PRESENT);
+
+		if (new_pte != *pte) {
+			tlb_batch_add(batch, vaddr, *pte);
+			set_pte(pte, new_pte);
+		}
+	}
+}
+
+
+void paging_map_kernel_page(uintptr_t vaddr, phys_addr_t paddr, unsigned int flags)
+{
+	ASSERT(vaddr >= KERNEL_MAPPED_START);
+
+	pte_t* pte = KERNEL_PTE(vaddr);
+	bool was_present = *pte & PAGE_PRESENT;
+
+	set_pte(pte, PTE(PTE_ADDR_FIELD(paddr), flags | PAGE_PRESENT));
+
+	/* Non-present entries aren't cached in the TLB */
+	if (was_present)
+		tlb_invalidate_page(vaddr);
+}
+
+void paging_unmap_kernel_page(uintptr_t vaddr)
+{
+	ASSERT(vaddr >= KERNEL_MAPPED_START);
+
+	set_pte(KERNEL_PTE(vaddr), 0);
+	tlb_invalidate_page(vaddr);
+}
+
+phys_addr_t paging_kernel_page_phys(uintptr_t vaddr)
+{
+	ASSERT(vaddr >= KERNEL_MAPPED_START);
+
+	pte_t pte = *KERNEL_PTE(vaddr);
+
+	if (!(pte & PAGE_PRESENT))
+		return 0;
+
+	return PTE_ADDR_FIELD(pte);
+}
+
+
+/* Helper Functions */
+
+/**
+ * Sends the invalidations of a TLB batch to the other CPUs and waits until
+ * they've all done them.
+ * 
+ * @param batch the batch
+*/
+static void tlb_shootdown(const tlb_batch_t* batch)
+{
+	if (!smp_booted || num_cpus == 1 || (batch->num_addrs == 0 && !batch->flush_all))
+		return;
+
+	/*
+	 * The CPU holding the lock may be waiting for this one, which may have interrupts
+	 * disabled, so its request is done here while waiting
+	*/
+	while (!spin_trylock(&shootdown_lock)) {
+		tlb_shootdown_interrupt();
+		cpu_relax();
+	}
+
+	memcpy(shootdown.addrs, batch->addrs, batch->num_addrs * sizeof(uintptr_t));
+	shootdown.num_addrs = batch->num_addrs;
+	shootdown.flush_all = batch->flush_all;
+	shootdown.global = batch->global;
+
+	unsigned int self = smp_cpu_id();
+	shootdown_acks = num_cpus - 1;
+
+	for (unsigned int cpu = 0; cpu < num_cpus; cpu++) {
+		if (cpu != self)
+			__atomic_store_n(&shootdown_pending[cpu], true, __ATOMIC_RELEASE);
+	}
+
+	lapic_send_ipi_others(LAPIC_TLB_VECTOR);
+
+	while (__atomic_load_n(&shootdown_acks, __ATOMIC_ACQUIRE) != 0)
+		cpu_relax();
+
+	spin_unlock(&shootdown_lock);
+}
+
+/**
+ * Invalidates the pages of a TLB batch from the current CPU's TLB.
+ * 
+ * @param batch the batch
+*/
+static void tlb_batch_invalidate(const tlb_batch_t* batch)
+{
+	if (batch->flush_all) {
+		if (batch->global)
+			tlb_flush_global();
+		else
+			tlb_flush_all();
+	}
+	else {
+		for (unsigned int i = 0; i < batch->num_addrs; i++)
+			tlb_invalidate_page(batch->addrs[i]);
+	}
+}
+
+/**
+ * Writes a page table entry.
+ * 
+ * 64-bit PAE entries are written in two halves, with the one holding the Present
+ * bit cleared first and set last, so the CPU never walks a half written entry.
+ * 
+ * @param ptep the entry
+ * @param pte the new value
+*/
+static inline void set_pte(pte_t* ptep, pte_t pte)
+{
+#ifdef CONFIG_X86_PAE
+	volatile uint32_t* half = (volatile uint32_t*) ptep;
+
+	half[0] = 0;
+	half[1] = (uint32_t) (pte >> 32);
+	half[0] = (uint32_t) pte;
+#else
+	*ptep = pte;
+#endif
+}
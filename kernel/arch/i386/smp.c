@@ -0,0 +1,247 @@
+/**
+ * Code for starting the application processors.
+ * 
+ * The CPUs are listed by the ACPI MADT. The boot CPU starts them one at a time
+ * with the INIT-SIPI-SIPI sequence on the trampoline, and each one then sets up
+ * its own GDT, TSS, local APIC, FPU and tick, and becomes the idle thread of its
+ * own runqueue. As only one CPU is starting at any time, none of this needs locks.
+ * 
+ * Refer to:
+ * Intel Software Developer Manual, Volume 3-A: Chapter 8.4: Multiple-Processor (MP) Initialization
+ * https://wiki.osdev.org/Symmetric_Multiprocessing
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/smp.h>
+#include <kernel/mm/mm.h>
+#include <kernel/sched/sched.h>
+#include <kernel/time/timer.h>
+#include <kernel/time/ktime.h>
+
+#include <kernel/arch/i386/acpi.h>
+#include <kernel/arch/i386/drivers/lapic.h>
+#include <kernel/arch/i386/percpu.h>
+#include <kernel/arch/i386/context.h>
+#include <kernel/arch/i386/paging.h>
+#include <kernel/arch/i386/system.h>
+#include <kernel/arch/i386/fpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TRAMPOLINE_ADDR		0x8000		/* Must match trampoline.S */
+
+#define INIT_DELAY_NS		(10 * NSEC_PER_MSEC)
+#define STARTUP_DELAY_NS	(200 * NSEC_PER_USEC)
+#define ONLINE_TIMEOUT_NS	(100 * NSEC_PER_MSEC)
+
+#define AP_STACK_SIZE		(THREAD_STACK_PAGES * PAGE_SIZE)
+
+
+/* Matches trampoline_params in trampoline.S */
+typedef struct trampoline_params_s {
+	uint32_t cr3;
+	uint32_t cr4;
+	uint32_t stack;				/* The top of the CPU's boot stack */
+	uint32_t cpu;				/* The ID given to the CPU */
+} trampoline_params_t;
+
+
+extern char trampoline_start[];
+extern char trampoline_params[];
+extern char trampoline_end[];
+
+extern void gdt_init(unsigned int cpu);
+extern void idt_load(void);
+extern void cpu_idle(void);
+
+
+cpu_local_t cpu_locals[MAX_CPUS];
+unsigned int num_cpus = 1;
+
+static volatile bool ap_online;				/* Set by the CPU being started once it's running */
+volatile bool smp_booted;
+
+
+void smp_init(void);
+void smp_send_reschedule(unsigned int cpu);
+void ap_main(unsigned int cpu);
+
+static unsigned int find_cpus(uint32_t apic_ids[MAX_CPUS]);
+static bool start_cpu(unsigned int cpu, uint32_t apic_id, volatile trampoline_params_t* params);
+static void delay_ns(uint64_t ns);
+
+
+/* Global Functions */
+
+void smp_init(void)
+{
+	if (!lapic_available() || !acpi_init())
+		return;
+
+	cpu_locals[0].apic_id = lapic_id();
+
+	uint32_t apic_ids[MAX_CPUS];
+	unsigned int count = find_cpus(apic_ids);
+	if (count <= 1)
+		return;
+
+	memcpy((void*) P2V(TRAMPOLINE_ADDR), trampoline_start, trampoline_end - trampoline_start);
+
+	volatile trampoline_params_t* params = (trampoline_params_t*)
+		P2V(TRAMPOLINE_ADDR + (trampoline_params - trampoline_start));
+
+	uint32_t cr3, cr4;
+	asm volatile("mov %0, cr3" : "=r" (cr3));
+	asm volatile("mov %0, cr4" : "=r" (cr4));
+	params->cr3 = cr3;
+	params->cr4 = cr4;
+
+	/* Paging is turned on while running from the trampoline, so it must be identity mapped */
+	kernel_page_directory[0] = PDE(0, PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE);
+
+	for (unsigned int i = 0; i < count && num_cpus < MAX_CPUS; i++)
+	{
+		if (apic_ids[i] == cpu_locals[0].apic_id)
+			continue;
+
+		if (start_cpu(num_cpus, apic_ids[i], params))
+			num_cpus++;
+		else
+			printf("CPU with APIC ID %u didn't start\n", apic_ids[i]);
+	}
+
+	kernel_page_directory[0] = 0;
+	tlb_flush_all();
+
+	smp_booted = true;
+}
+
+void smp_send_reschedule(unsigned int cpu)
+{
+	/* The handler does nothing, need_resched is checked on the way out of it */
+	if (!lapic_send_ipi_to(cpu_locals[cpu].apic_id, LAPIC_RESCHED_VECTOR))
+		printf("Reschedule IPI to CPU %u timed out\n", cpu);
+}
+
+
+/**
+ * The entry point of the application processors, called by the trampoline.
+ * 
+ * @param cpu the ID given to the CPU
+*/
+void ap_main(unsigned int cpu)
+{
+	gdt_init(cpu);
+	idt_load();
+
+	lapic_init();
+	lapic_timer_setup();
+	fpu_init_cpu();
+
+	sched_init_cpu();
+	timer_init_cpu();
+
+	ap_online = true;
+
+	/* Drop the trampoline's identity mapping once the boot CPU has removed it */
+	while (!smp_booted)
+		cpu_relax();
+	tlb_flush_all();
+
+	IRQ_ON;
+	cpu_idle();
+}
+
+
+/* Helper Functions */
+
+/**
+ * Lists the enabled CPUs in the MADT.
+ * 
+ * @param apic_ids where the local APIC IDs of the CPUs are stored
+ * 
+ * @return the number of CPUs, including the boot CPU, or 0 if there's no MADT
+*/
+static unsigned int find_cpus(uint32_t apic_ids[MAX_CPUS])
+{
+	acpi_madt_t* madt = (acpi_madt_t*) acpi_find_table("APIC");
+	if (madt == NULL)
+		return 0;
+
+	uint8_t* entry = madt->entries;
+	uint8_t* end = (uint8_t*) madt + madt->header.length;
+	unsigned int count = 0;
+
+	/* Entries start with their type and length */
+	while (entry + 2 <= end && entry[1] >= 2 && count < MAX_CPUS)
+	{
+		madt_lapic_t* lapic = (madt_lapic_t*) entry;
+
+		if (lapic->type == MADT_TYPE_LAPIC && (lapic->flags & MADT_LAPIC_ENABLED))
+			apic_ids[count++] = lapic->apic_id;
+
+		entry += entry[1];
+	}
+
+	return count;
+}
+
+/**
+ * Starts a CPU on the trampoline and waits for it to be running.
+ * 
+ * @param cpu the ID given to the CPU
+ * @param apic_id the local APIC ID of the CPU
+ * @param params the trampoline's parameters
+ * 
+ * @return true if the CPU is running, false if it didn't respond
+*/
+static bool start_cpu(unsigned int cpu, uint32_t apic_id, volatile trampoline_params_t* params)
+{
+	uintptr_t stack = (uintptr_t) alloc_pages(THREAD_STACK_PAGES, PA_KERNEL);
+	if (stack == 0)
+		return false;
+
+	params->stack = (uint32_t) P2V(stack) + AP_STACK_SIZE;
+	params->cpu = cpu;
+	cpu_locals[cpu].apic_id = apic_id;
+	ap_online = false;
+
+	if (!lapic_send_init(apic_id))
+		return false;
+	delay_ns(INIT_DELAY_NS);
+
+	/* The second STARTUP is in case the first one was missed, a running CPU ignores it */
+	for (unsigned int i = 0; i < 2 && !ap_online; i++)
+	{
+		if (!lapic_send_startup(apic_id, TRAMPOLINE_ADDR))
+			return false;
+		delay_ns(STARTUP_DELAY_NS);
+	}
+
+	/* The stack isn't freed on failure, the CPU may still come up late and use it */
+	uint64_t deadline = ktime_get_ns() + ONLINE_TIMEOUT_NS;
+
+	while (!ap_online)
+		if (ktime_get_ns() > deadline)
+			return false;
+
+	return true;
+}
+
+/**
+ * Busy waits for a number of nanoseconds.
+ * 
+ * @param ns the number of nanoseconds
+*/
+static void delay_ns(uint64_t ns)
+{
+	uint64_t deadline = ktime_get_ns() + ns;
+
+	while (ktime_get_ns() < deadline)
+		cpu_relax();
+}
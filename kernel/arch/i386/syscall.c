@@ -5,6 +5,8 @@
  */
 
 #include <kernel/syscall.h>
+#include <kernel/system.h>
+#include <kernel/sched/sched.h>
 #include <kernel/arch/i386/system.h>
 
 #include <stdio.h>
@@ -13,7 +15,7 @@
 void myexit()
 {
 	printf("Exited program\n");
-	STOP;
+	thread_exit();
 }
 
 void syscall_handler(int syscall_num)
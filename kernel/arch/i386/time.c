@@ -0,0 +1,89 @@
+/**
+ * Code for setting up the kernel's time sources.
+ * 
+ * The frequencies of the Time Stamp Counter and of the local APIC timer aren't
+ * known, so they're measured against channel 2 of the PIT, whose frequency is.
+ * The TSC is then used as the clocksource and the local APIC timer for timer
+ * interrupts, falling back to the PIT. The wall-clock time is read from the RTC.
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/time/timer.h>
+#include <kernel/time/ktime.h>
+
+#include <kernel/arch/i386/drivers/pit.h>
+#include <kernel/arch/i386/drivers/lapic.h>
+#include <kernel/arch/i386/drivers/rtc.h>
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define CALIBRATE_MS		10
+#define CALIBRATE_COUNT		(PIT_FREQUENCY / (1000 / CALIBRATE_MS))
+
+/* The shortest measurement is kept, the others were likely stretched by SMIs or a slow PIT read */
+#define CALIBRATE_RUNS		3
+
+
+void time_init(void);
+
+static uint64_t tsc_read(void);
+
+
+static clocksource_t tsc_clocksource = {
+	.name = "TSC",
+	.read = tsc_read,
+};
+
+
+void time_init(void)
+{
+	bool has_lapic = lapic_init();
+
+	uint64_t tsc_cycles = UINT64_MAX;
+	uint32_t lapic_ticks = UINT32_MAX;
+
+	for (unsigned int i = 0; i < CALIBRATE_RUNS; i++)
+	{
+		uint32_t flags = irq_save();
+
+		pit_channel2_start(CALIBRATE_COUNT);
+		if (has_lapic)
+			lapic_timer_calibrate_start();
+		uint64_t tsc_start = rdtsc();
+
+		while (!pit_channel2_done()) {}
+
+		uint64_t cycles = rdtsc() - tsc_start;
+		uint32_t ticks = has_lapic ? lapic_timer_calibrate_end() : 0;
+
+		irq_restore(flags);
+
+		if (cycles < tsc_cycles)
+			tsc_cycles = cycles;
+		if (ticks < lapic_ticks)
+			lapic_ticks = ticks;
+	}
+
+	clocksource_register(&tsc_clocksource, (uint32_t) (tsc_cycles / CALIBRATE_MS));
+
+	clock_event_t* dev;
+
+	if (has_lapic && lapic_ticks > 0)
+		dev = lapic_clock_event_init(lapic_ticks * (1000 / CALIBRATE_MS));
+	else
+		dev = pit_clock_event_init();
+
+	timer_init(dev);
+
+	ktime_set_real(rtc_read_time());
+}
+
+
+static uint64_t tsc_read(void)
+{
+	return rdtsc();
+}
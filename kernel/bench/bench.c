@@ -0,0 +1,41 @@
+/**
+ * Code for running the boot-time benchmarks.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+void bench_run_all(void)
+{
+	printf("Running Benchmarks\n");
+
+	bench_page_alloc();
+	bench_kmalloc();
+	bench_slab_bulk();
+	bench_kmap();
+	bench_tlb();
+	bench_tlb_batch();
+	bench_page_fault();
+	bench_zero_pool();
+	bench_mem();
+	bench_string();
+	bench_context_switch();
+	bench_fpu();
+	bench_wakeup_latency();
+	bench_locks();
+}
+
+
+void bench_report(const char* name, uint64_t cycles, unsigned long num_ops)
+{
+	printf("%s: %llu cycles, %llu cycles/op\n", name, cycles, num_ops ? cycles / num_ops : 0);
+}
+
+#endif
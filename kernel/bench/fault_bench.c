@@ -0,0 +1,71 @@
+/**
+ * Benchmark comparing eagerly mapped vmalloc buffers against demand-zero ones,
+ * both to set up and to touch every page of.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/mm/vmalloc.h>
+#include <kernel/mm/fault.h>
+#include <kernel/system.h>
+
+#include <kernel/arch/i386/system.h>
+#include <kernel/arch/i386/paging.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define BUF_NUM_PAGES		1024
+
+
+static uint64_t touch_pages(volatile uint8_t* buf);
+
+
+void bench_page_fault(void)
+{
+	uint64_t start = rdtsc();
+	uint8_t* eager = vmalloc(BUF_NUM_PAGES * PAGE_SIZE);
+	uint64_t eager_setup_cycles = rdtsc() - start;
+
+	start = rdtsc();
+	uint8_t* lazy = vmalloc_lazy(BUF_NUM_PAGES * PAGE_SIZE);
+	uint64_t lazy_setup_cycles = rdtsc() - start;
+
+	ASSERT(eager != NULL && lazy != NULL);
+
+	uint64_t eager_touch_cycles = touch_pages(eager);
+	uint64_t lazy_touch_cycles = touch_pages(lazy);
+
+	bench_report("vmalloc setup", eager_setup_cycles, BUF_NUM_PAGES);
+	bench_report("vmalloc_lazy setup", lazy_setup_cycles, BUF_NUM_PAGES);
+	bench_report("vmalloc first touch", eager_touch_cycles, BUF_NUM_PAGES);
+	bench_report("vmalloc_lazy first touch", lazy_touch_cycles, BUF_NUM_PAGES);
+	page_fault_print_stats();
+
+	vfree(lazy);
+	vfree(eager);
+}
+
+
+/**
+ * Writes a byte to every page of a buffer.
+ * 
+ * @param buf the buffer
+ * 
+ * @return the number of cycles the writes took
+*/
+static uint64_t touch_pages(volatile uint8_t* buf)
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int i = 0; i < BUF_NUM_PAGES; i++)
+		buf[i * PAGE_SIZE] = 1;
+
+	return rdtsc() - start;
+}
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * Benchmark timing kernel_fpu_begin()/kernel_fpu_end() and comparing zeroing
+ * pages with memset() against non-temporal SSE2 stores.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/mm/mm.h>
+
+#include <kernel/arch/i386/fpu.h>
+#include <kernel/arch/i386/cpu.h>
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+
+#define NUM_ITERATIONS		1000
+#define NUM_PAGES			64
+
+
+void bench_fpu(void)
+{
+	if (!kernel_fpu_usable() || !(cpu_info.features_edx & CPUID_EDX_SSE2)) {
+		printf("SSE2 isn't available, skipping the FPU benchmark\n");
+		return;
+	}
+
+	uint64_t start = rdtsc();
+	for (unsigned int i = 0; i < NUM_ITERATIONS; i++) {
+		kernel_fpu_begin();
+		kernel_fpu_end();
+	}
+	uint64_t fpu_cycles = rdtsc() - start;
+
+	uint8_t* pages = (uint8_t*) P2V((uintptr_t) alloc_pages(NUM_PAGES, PA_KERNEL));
+
+	start = rdtsc();
+	for (unsigned int i = 0; i < NUM_PAGES; i++)
+		memset(pages + i * PAGE_SIZE, 0, PAGE_SIZE);
+	uint64_t memset_cycles = rdtsc() - start;
+
+	start = rdtsc();
+	for (unsigned int i = 0; i < NUM_PAGES; i++) {
+		kernel_fpu_begin();
+		sse2_clear_page(pages + i * PAGE_SIZE, PAGE_SIZE);
+		kernel_fpu_end();
+	}
+	uint64_t sse2_cycles = rdtsc() - start;
+
+	free_pages((void*) V2P((uintptr_t) pages), NUM_PAGES);
+
+	bench_report("kernel_fpu_begin/end", fpu_cycles, NUM_ITERATIONS);
+	bench_report("page zeroing, memset", memset_cycles, NUM_PAGES);
+	bench_report("page zeroing, SSE2 non-temporal", sse2_cycles, NUM_PAGES);
+}
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * Benchmark for the kmalloc size classes.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/mm/mm.h>
+#include <kernel/system.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define MAX_SIZE			1024	/* Sizes above this use power of 2 classes anyway */
+#define NUM_OPS				4096
+
+
+static size_t pow2_class_size(size_t size);
+
+
+void bench_kmalloc(void)
+{
+	size_t class_start = 1;
+	unsigned long requested = 0, used = 0, used_pow2 = 0;
+
+	/* Every size in a class is assumed to be equally likely */
+	for (size_t size = 1; size <= MAX_SIZE; size++)
+	{
+		void* ptr = kmalloc(size);
+		size_t class_size = kmem_size(ptr);
+		kfree(ptr);
+
+		requested += size;
+		used += class_size;
+		used_pow2 += pow2_class_size(size);
+
+		if (size < class_size)
+			continue;
+
+		printf("kmalloc-%u (%u-%u): %u%% wasted, %u%% with powers of 2\n", class_size, class_start, size,
+			(used - requested) * 100 / used, (used_pow2 - requested) * 100 / used_pow2);
+
+		class_start = size + 1;
+		requested = used = used_pow2 = 0;
+	}
+
+	uint64_t start = rdtsc();
+
+	for (unsigned int i = 0; i < NUM_OPS; i++)
+		kfree(kmalloc(1 + (i * 37) % MAX_SIZE));
+
+	bench_report("kmalloc/kfree", rdtsc() - start, NUM_OPS);
+}
+
+
+/**
+ * Returns the size of the class a size would fall in with power of 2 classes
+ * starting at 16 bytes.
+ * 
+ * @param size the size
+ * 
+ * @return the class size
+*/
+static size_t pow2_class_size(size_t size)
+{
+	size_t class_size = 16;
+
+	while (class_size < size)
+		class_size *= 2;
+
+	return class_size;
+}
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * Benchmark timing the temporary mappings of high memory pages.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/mm/mm.h>
+#include <kernel/mm/highmem.h>
+#include <kernel/system.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define NUM_PAGES			64
+#define NUM_ROUNDS			64
+
+
+static page_t* pages[NUM_PAGES];
+
+
+void bench_kmap(void)
+{
+	for (unsigned int i = 0; i < NUM_PAGES; i++)
+		pages[i] = alloc_frame(PA_HIGHMEM);
+
+	uint64_t start = rdtsc();
+
+	for (unsigned int round = 0; round < NUM_ROUNDS; round++) {
+		for (unsigned int i = 0; i < NUM_PAGES; i++) {
+			uint32_t* vaddr = kmap_atomic(pages[i]);
+			vaddr[round] = round;
+			kunmap_atomic(vaddr);
+		}
+	}
+
+	uint64_t atomic_cycles = rdtsc() - start;
+	start = rdtsc();
+
+	/* After the first round the pages are still mapped, so kmap() only takes a reference */
+	for (unsigned int round = 0; round < NUM_ROUNDS; round++) {
+		for (unsigned int i = 0; i < NUM_PAGES; i++) {
+			uint32_t* vaddr = kmap(pages[i]);
+			ASSERT(vaddr[round] == round);
+			kunmap(pages[i]);
+		}
+	}
+
+	uint64_t kmap_cycles = rdtsc() - start;
+
+	bench_report("kmap_atomic/kunmap_atomic", atomic_cycles, NUM_PAGES * NUM_ROUNDS);
+	bench_report("kmap/kunmap", kmap_cycles, NUM_PAGES * NUM_ROUNDS);
+
+	for (unsigned int i = 0; i < NUM_PAGES; i++)
+		free_frame(pages[i]);
+}
+
+#endif
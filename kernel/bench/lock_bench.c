@@ -0,0 +1,115 @@
+/**
+ * Benchmark timing the uncontended lock operations and a mutex handed back and
+ * forth between two threads.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/sched/sched.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/sync/mutex.h>
+#include <kernel/sync/lock_stat.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+#define NUM_OPS				100000
+#define NUM_HANDOFFS		10000
+
+
+static spinlock_t bench_spinlock = SPINLOCK_INIT("bench spinlock");
+static rwlock_t bench_rwlock = RWLOCK_INIT("bench rwlock");
+static mutex_t bench_mutex = MUTEX_INIT(bench_mutex, "bench mutex");
+
+static volatile bool handoff_done;
+
+
+static void handoff_loop(void* arg);
+
+
+void bench_locks(void)
+{
+	uint64_t start = rdtsc();
+	for (unsigned int i = 0; i < NUM_OPS; i++) {
+		spin_lock(&bench_spinlock);
+		spin_unlock(&bench_spinlock);
+	}
+	bench_report("spin_lock/spin_unlock", rdtsc() - start, NUM_OPS);
+
+	start = rdtsc();
+	for (unsigned int i = 0; i < NUM_OPS; i++) {
+		uint32_t flags = spin_lock_irqsave(&bench_spinlock);
+		spin_unlock_irqrestore(&bench_spinlock, flags);
+	}
+	bench_report("spin_lock_irqsave/spin_unlock_irqrestore", rdtsc() - start, NUM_OPS);
+
+	start = rdtsc();
+	for (unsigned int i = 0; i < NUM_OPS; i++) {
+		read_lock(&bench_rwlock);
+		read_unlock(&bench_rwlock);
+	}
+	bench_report("read_lock/read_unlock", rdtsc() - start, NUM_OPS);
+
+	start = rdtsc();
+	for (unsigned int i = 0; i < NUM_OPS; i++) {
+		write_lock(&bench_rwlock);
+		write_unlock(&bench_rwlock);
+	}
+	bench_report("write_lock/write_unlock", rdtsc() - start, NUM_OPS);
+
+	start = rdtsc();
+	for (unsigned int i = 0; i < NUM_OPS; i++) {
+		mutex_lock(&bench_mutex);
+		mutex_unlock(&bench_mutex);
+	}
+	bench_report("mutex_lock/mutex_unlock", rdtsc() - start, NUM_OPS);
+
+	/*
+	 * Both threads run on this CPU and yield while holding the mutex, so every lock
+	 * blocks until the other thread hands it over, each handoff being a switch
+	*/
+	handoff_done = false;
+	thread_create_on(smp_cpu_id(), "bench", handoff_loop, NULL, thread_current()->priority);
+
+	start = rdtsc();
+	handoff_loop(NULL);
+	while (!handoff_done)
+		thread_yield();
+	bench_report("mutex handoff", rdtsc() - start, 2 * NUM_HANDOFFS);
+
+#ifdef CONFIG_LOCK_STAT
+	lock_stat_print();
+#endif
+}
+
+
+/**
+ * Takes and releases the benchmark mutex NUM_HANDOFFS times, yielding while
+ * holding it. The thread that finishes last sets handoff_done.
+ * 
+ * @param arg unused
+*/
+static void handoff_loop(void* arg)
+{
+	static unsigned int num_done;
+
+	(void) arg;
+
+	for (unsigned int i = 0; i < NUM_HANDOFFS; i++) {
+		mutex_lock(&bench_mutex);
+		thread_yield();
+		mutex_unlock(&bench_mutex);
+	}
+
+	if (++num_done % 2 == 0)
+		handoff_done = true;
+}
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * Benchmark sweeping memcpy(), memmove() and memset() over buffer sizes from 16B
+ * to 1MB. Large copies are also timed without the non-temporal path.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/mm/vmalloc.h>
+#include <kernel/system.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+
+#define MIN_SIZE			16
+#define MAX_SIZE			(1 << 20)
+
+#define BYTES_PER_SIZE		(8 << 20)	/* The amount of memory touched for each size */
+
+#define MOVE_OFFSET			8			/* memmove() copies overlapping buffers backward */
+
+
+extern size_t __mem_nt_threshold;
+
+
+static uint8_t* src;
+static uint8_t* dst;
+
+
+static uint64_t time_memcpy(size_t size, unsigned int num_iters);
+static uint64_t time_memmove(size_t size, unsigned int num_iters);
+static uint64_t time_memset(size_t size, unsigned int num_iters);
+
+
+void bench_mem(void)
+{
+	src = vmalloc(MAX_SIZE + MOVE_OFFSET);
+	dst = vmalloc(MAX_SIZE + MOVE_OFFSET);
+	ASSERT(src != NULL && dst != NULL);
+
+	/* Touch the buffers, so the first size doesn't pay for their page faults */
+	memset(src, 0xAA, MAX_SIZE + MOVE_OFFSET);
+	memset(dst, 0x55, MAX_SIZE + MOVE_OFFSET);
+
+	size_t nt_threshold = __mem_nt_threshold;
+
+	for (size_t size = MIN_SIZE; size <= MAX_SIZE; size *= 4)
+	{
+		unsigned int num_iters = BYTES_PER_SIZE / size;
+
+		uint64_t memcpy_cycles = time_memcpy(size, num_iters);
+		uint64_t memmove_cycles = time_memmove(size, num_iters);
+		uint64_t memset_cycles = time_memset(size, num_iters);
+
+		printf("%u bytes: memcpy %llu, memmove %llu, memset %llu cycles/op\n", size,
+			memcpy_cycles / num_iters, memmove_cycles / num_iters, memset_cycles / num_iters);
+
+		if (size < nt_threshold)
+			continue;
+
+		__mem_nt_threshold = SIZE_MAX;
+		memcpy_cycles = time_memcpy(size, num_iters);
+		memset_cycles = time_memset(size, num_iters);
+		__mem_nt_threshold = nt_threshold;
+
+		printf("%u bytes, cached stores: memcpy %llu, memset %llu cycles/op\n", size,
+			memcpy_cycles / num_iters, memset_cycles / num_iters);
+	}
+
+	vfree(src);
+	vfree(dst);
+}
+
+
+/**
+ * Copies between the two buffers.
+ * 
+ * @param size the number of bytes to copy
+ * @param num_iters the number of copies
+ * 
+ * @return the number of cycles it took
+*/
+static uint64_t time_memcpy(size_t size, unsigned int num_iters)
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int i = 0; i < num_iters; i++)
+		memcpy(dst, src, size);
+
+	return rdtsc() - start;
+}
+
+/**
+ * Moves a buffer forward onto itself.
+ * 
+ * @param size the number of bytes to move
+ * @param num_iters the number of moves
+ * 
+ * @return the number of cycles it took
+*/
+static uint64_t time_memmove(size_t size, unsigned int num_iters)
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int i = 0; i < num_iters; i++)
+		memmove(dst + MOVE_OFFSET, dst, size);
+
+	return rdtsc() - start;
+}
+
+/**
+ * Fills a buffer.
+ * 
+ * @param size the number of bytes to fill
+ * @param num_iters the number of fills
+ * 
+ * @return the number of cycles it took
+*/
+static uint64_t time_memset(size_t size, unsigned int num_iters)
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int i = 0; i < num_iters; i++)
+		memset(dst, (int) i, size);
+
+	return rdtsc() - start;
+}
+
+#endif
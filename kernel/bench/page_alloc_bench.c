@@ -0,0 +1,122 @@
+/**
+ * Benchmark comparing the page allocators: the bitmap, the buddy allocator and
+ * alloc_pages(), which puts the per-CPU page lists in front of the buddy allocator.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/mm/mm.h>
+#include <kernel/system.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define POOL_NUM_PAGES		1024	/* Pages lent to the bitmap */
+#define NUM_ALLOCS			256
+
+/* Single page allocations, frees of every other page, 4-page allocations in the holes and frees of everything */
+#define NUM_OPS				(NUM_ALLOCS + NUM_ALLOCS / 2 + NUM_ALLOCS / 2 + NUM_ALLOCS)
+
+
+extern void* bmap_alloc_upper(size_t num_pages, uintptr_t addr_upper);
+extern void bmap_exclude(uintptr_t start_addr, uintptr_t end_addr);
+extern void bmap_free(void* page_addr, size_t num_pages);
+
+extern page_t* buddy_alloc(unsigned int zone_id, size_t num_pages);
+extern void buddy_free(page_t* page, size_t num_pages);
+
+
+static void* page_addrs[NUM_ALLOCS];
+
+
+static uint64_t run_pattern(void* (*alloc)(size_t), void (*free)(void*, size_t));
+static void* bmap_alloc_normal(size_t num_pages);
+static void* buddy_alloc_normal(size_t num_pages);
+static void buddy_free_normal(void* page_addr, size_t num_pages);
+static void* alloc_pages_normal(size_t num_pages);
+
+
+void bench_page_alloc(void)
+{
+	/* The bitmap has no free pages after handing them over to the buddy allocator, so lend it some */
+	void* pool = alloc_pages(POOL_NUM_PAGES, PA_KERNEL);
+	bmap_free(pool, POOL_NUM_PAGES);
+
+	uint64_t bmap_cycles = run_pattern(bmap_alloc_normal, bmap_free);
+
+	bmap_exclude((uintptr_t) pool, (uintptr_t) pool + POOL_NUM_PAGES * PAGE_SIZE);
+	free_pages(pool, POOL_NUM_PAGES);
+
+	uint64_t buddy_cycles = run_pattern(buddy_alloc_normal, buddy_free_normal);
+	uint64_t pcp_cycles = run_pattern(alloc_pages_normal, free_pages);
+
+	bench_report("bitmap page alloc/free", bmap_cycles, NUM_OPS);
+	bench_report("buddy page alloc/free", buddy_cycles, NUM_OPS);
+	bench_report("alloc_pages/free_pages", pcp_cycles, NUM_OPS);
+
+	pcp_print();
+}
+
+
+/**
+ * Runs a fragmenting allocation pattern with the given allocator.
+ * 
+ * @param alloc the allocation function
+ * @param free the free function
+ * 
+ * @return the number of cycles the pattern took
+*/
+static uint64_t run_pattern(void* (*alloc)(size_t), void (*free)(void*, size_t))
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int i = 0; i < NUM_ALLOCS; i++) {
+		page_addrs[i] = alloc(1);
+		ASSERT(page_addrs[i] != NULL);
+	}
+
+	/* Leave single page holes behind */
+	for (unsigned int i = 0; i < NUM_ALLOCS; i += 2)
+		free(page_addrs[i], 1);
+
+	/* These don't fit in the holes */
+	for (unsigned int i = 0; i < NUM_ALLOCS; i += 2) {
+		page_addrs[i] = alloc(4);
+		ASSERT(page_addrs[i] != NULL);
+	}
+
+	for (unsigned int i = 0; i < NUM_ALLOCS; i++)
+		free(page_addrs[i], i % 2 ? 1 : 4);
+
+	return rdtsc() - start;
+}
+
+static void* bmap_alloc_normal(size_t num_pages)
+{
+	return bmap_alloc_upper(num_pages, HIGH_MEM_START);
+}
+
+static void* buddy_alloc_normal(size_t num_pages)
+{
+	page_t* page = buddy_alloc(ZONE_NORMAL, num_pages);
+
+	return page != NULL ? (void*) (uintptr_t) page_to_phys(page) : NULL;
+}
+
+static void buddy_free_normal(void* page_addr, size_t num_pages)
+{
+	buddy_free(phys_to_page(page_addr), num_pages);
+}
+
+static void* alloc_pages_normal(size_t num_pages)
+{
+	return alloc_pages(num_pages, PA_KERNEL);
+}
+
+#endif
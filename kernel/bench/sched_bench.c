@@ -0,0 +1,76 @@
+/**
+ * Benchmark timing thread switches and the creation of short-lived threads.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/sched/sched.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define NUM_YIELDS			10000
+#define NUM_THREADS			256
+
+
+static void yield_loop(void* arg);
+static void empty_func(void* arg);
+
+
+void bench_context_switch(void)
+{
+	unsigned int priority = thread_current()->priority;
+
+	/* Both threads yield to each other on this CPU, each yield being a switch */
+	thread_create_on(smp_cpu_id(), "bench", yield_loop, NULL, priority);
+
+	uint64_t start = rdtsc();
+	for (unsigned int i = 0; i < NUM_YIELDS; i++)
+		thread_yield();
+	uint64_t switch_cycles = rdtsc() - start;
+
+	/* Each thread runs as soon as we yield and has exited by the time we're back */
+	start = rdtsc();
+	for (unsigned int i = 0; i < NUM_THREADS; i++) {
+		thread_create_on(smp_cpu_id(), "bench", empty_func, NULL, priority);
+		thread_yield();
+	}
+	uint64_t thread_cycles = rdtsc() - start;
+
+	bench_report("thread switch (yield)", switch_cycles, 2 * NUM_YIELDS);
+	bench_report("thread create, run and exit", thread_cycles, NUM_THREADS);
+
+	sched_print();
+}
+
+
+/**
+ * Yields NUM_YIELDS times, then exits.
+ * 
+ * @param arg unused
+*/
+static void yield_loop(void* arg)
+{
+	(void) arg;
+
+	for (unsigned int i = 0; i < NUM_YIELDS; i++)
+		thread_yield();
+}
+
+/**
+ * Returns right away.
+ * 
+ * @param arg unused
+*/
+static void empty_func(void* arg)
+{
+	(void) arg;
+}
+
+#endif
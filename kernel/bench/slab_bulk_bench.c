@@ -0,0 +1,62 @@
+/**
+ * Benchmark comparing single object slab allocations against bulk ones.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/mm/slab.h>
+#include <kernel/system.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define OBJ_SIZE			64
+#define NUM_OBJS			512
+#define NUM_ROUNDS			8
+
+
+static void* objs[NUM_OBJS];
+
+
+void bench_slab_bulk(void)
+{
+	/* Without magazines both paths go through the slab lists */
+	struct kmem_cache_s* cache = kmem_cache_create("bench_bulk", OBJ_SIZE, 0, SLAB_NO_MAGAZINES, NULL, NULL);
+	kmem_cache_set_free_limit(cache, NUM_OBJS);
+
+	/* Warm up, so neither run pays for growing the cache */
+	ASSERT(kmem_cache_alloc_bulk(cache, NUM_OBJS, objs) == NUM_OBJS);
+	kmem_cache_free_bulk(cache, NUM_OBJS, objs);
+
+	uint64_t start = rdtsc();
+
+	for (unsigned int round = 0; round < NUM_ROUNDS; round++) {
+		for (unsigned int i = 0; i < NUM_OBJS; i++)
+			objs[i] = kmem_cache_alloc(cache);
+		for (unsigned int i = 0; i < NUM_OBJS; i++)
+			kmem_cache_free(cache, objs[i]);
+	}
+
+	uint64_t single_cycles = rdtsc() - start;
+	start = rdtsc();
+
+	for (unsigned int round = 0; round < NUM_ROUNDS; round++) {
+		ASSERT(kmem_cache_alloc_bulk(cache, NUM_OBJS, objs) == NUM_OBJS);
+		kmem_cache_free_bulk(cache, NUM_OBJS, objs);
+	}
+
+	uint64_t bulk_cycles = rdtsc() - start;
+
+	bench_report("kmem_cache_alloc/free", single_cycles, 2 * NUM_OBJS * NUM_ROUNDS);
+	bench_report("kmem_cache_alloc/free_bulk", bulk_cycles, 2 * NUM_OBJS * NUM_ROUNDS);
+
+	kmem_cache_destroy(cache);
+}
+
+#endif
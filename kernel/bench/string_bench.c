@@ -0,0 +1,233 @@
+/**
+ * Benchmark comparing the word-at-a-time string functions against byte-at-a-time
+ * loops on the strings path lookups work with: directory entry names, which are
+ * compared with strncmp() against every entry of a directory, and whole paths.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/fs/fs.h>
+#include <kernel/system.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+
+#define NUM_DENTRIES		64
+#define NUM_ROUNDS			1024
+
+#define NAME_PREFIX			"dentry_name_"	/* Shared by every name, like files of the same kind */
+
+
+/* Keeps the compiler from dropping calls whose results are unused */
+static volatile uintptr_t sink;
+
+static char names[NUM_DENTRIES][SUFS_MAX_FILENAME_LEN + 1];
+
+static const char* const paths[] = {
+	"/home/user/notes.txt",
+	"/usr/include/kernel/arch/i386/drivers/serial.h",
+	"/home/user/projects/myos/kernel/arch/i386/drivers/ata/pio/registers/status/busy/bit/definition.h"
+};
+
+
+static uint64_t search_names(int (*cmp)(const char*, const char*, size_t));
+static uint64_t time_strlen(const char* path, size_t (*len)(const char*));
+static uint64_t time_strcmp(const char* path, const char* copy, int (*cmp)(const char*, const char*));
+static uint64_t time_components(const char* path, char* (*chr)(const char*, int));
+static uint64_t time_strrchr(const char* path, char* (*rchr)(const char*, int));
+
+static size_t byte_strlen(const char* str);
+static int byte_strcmp(const char* str1, const char* str2);
+static int byte_strncmp(const char* str1, const char* str2, size_t size);
+static char* byte_strchr(const char* str, int c);
+static char* byte_strrchr(const char* str, int c);
+
+
+void bench_string(void)
+{
+	for (unsigned int i = 0; i < NUM_DENTRIES; i++) {
+		strcpy(names[i], NAME_PREFIX);
+		names[i][sizeof(NAME_PREFIX) - 1] = '0' + i / 10;
+		names[i][sizeof(NAME_PREFIX)] = '0' + i % 10;
+		names[i][sizeof(NAME_PREFIX) + 1] = '\0';
+	}
+
+	bench_report("dentry search, byte strncmp", search_names(byte_strncmp), NUM_ROUNDS * NUM_DENTRIES);
+	bench_report("dentry search, word strncmp", search_names(strncmp), NUM_ROUNDS * NUM_DENTRIES);
+
+	char copy[MAX_FILENAME_LEN + 1];
+
+	for (unsigned int i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+	{
+		strcpy(copy, paths[i]);
+		printf("%u byte path:\n", strlen(paths[i]));
+
+		bench_report("byte strlen", time_strlen(paths[i], byte_strlen), NUM_ROUNDS);
+		bench_report("word strlen", time_strlen(paths[i], strlen), NUM_ROUNDS);
+		bench_report("byte strcmp", time_strcmp(paths[i], copy, byte_strcmp), NUM_ROUNDS);
+		bench_report("word strcmp", time_strcmp(paths[i], copy, strcmp), NUM_ROUNDS);
+		bench_report("byte strchr components", time_components(paths[i], byte_strchr), NUM_ROUNDS);
+		bench_report("word strchr components", time_components(paths[i], strchr), NUM_ROUNDS);
+		bench_report("byte strrchr", time_strrchr(paths[i], byte_strrchr), NUM_ROUNDS);
+		bench_report("word strrchr", time_strrchr(paths[i], strrchr), NUM_ROUNDS);
+	}
+}
+
+
+/**
+ * Looks up every name in the directory entries, comparing them like search_dir().
+ * 
+ * @param cmp the strncmp() implementation
+ * 
+ * @return the number of cycles it took
+*/
+static uint64_t search_names(int (*cmp)(const char*, const char*, size_t))
+{
+	unsigned int num_found = 0;
+	uint64_t start = rdtsc();
+
+	for (unsigned int round = 0; round < NUM_ROUNDS; round++) {
+		const char* name = names[round % NUM_DENTRIES];
+
+		for (unsigned int i = 0; i < NUM_DENTRIES; i++)
+			if (!cmp(names[i], name, SUFS_MAX_FILENAME_LEN))
+				num_found++;
+	}
+
+	uint64_t cycles = rdtsc() - start;
+	ASSERT(num_found == NUM_ROUNDS);
+
+	return cycles;
+}
+
+/**
+ * Measures the length of a path.
+ * 
+ * @param path the path
+ * @param len the strlen() implementation
+ * 
+ * @return the number of cycles it took
+*/
+static uint64_t time_strlen(const char* path, size_t (*len)(const char*))
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int round = 0; round < NUM_ROUNDS; round++)
+		sink += len(path);
+
+	return rdtsc() - start;
+}
+
+/**
+ * Compares a path with an equal copy of it, the worst case of a comparison.
+ * 
+ * @param path the path
+ * @param copy the copy of the path
+ * @param cmp the strcmp() implementation
+ * 
+ * @return the number of cycles it took
+*/
+static uint64_t time_strcmp(const char* path, const char* copy, int (*cmp)(const char*, const char*))
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int round = 0; round < NUM_ROUNDS; round++)
+		sink += cmp(path, copy);
+
+	return rdtsc() - start;
+}
+
+/**
+ * Splits a path into its components, like the path lookup in SUFS.
+ * 
+ * @param path the path
+ * @param chr the strchr() implementation
+ * 
+ * @return the number of cycles it took
+*/
+static uint64_t time_components(const char* path, char* (*chr)(const char*, int))
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int round = 0; round < NUM_ROUNDS; round++)
+		for (const char* next = chr(path + 1, PATH_SEPARATOR); next != NULL; next = chr(next + 1, PATH_SEPARATOR))
+			;
+
+	return rdtsc() - start;
+}
+
+/**
+ * Finds the last component of a path.
+ * 
+ * @param path the path
+ * @param rchr the strrchr() implementation
+ * 
+ * @return the number of cycles it took
+*/
+static uint64_t time_strrchr(const char* path, char* (*rchr)(const char*, int))
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int round = 0; round < NUM_ROUNDS; round++)
+		sink += (uintptr_t) rchr(path, PATH_SEPARATOR);
+
+	return rdtsc() - start;
+}
+
+
+/* The previous byte-at-a-time implementations */
+
+static size_t byte_strlen(const char* str)
+{
+	size_t len = 0;
+	while (str[len])
+		len++;
+	return len;
+}
+
+static int byte_strcmp(const char* str1, const char* str2)
+{
+	for (size_t i = 0; ; i++) {
+		if (str1[i] != str2[i]) return str1[i] - str2[i];
+		if (!str1[i]) break;
+	}
+	return 0;
+}
+
+static int byte_strncmp(const char* str1, const char* str2, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		if (str1[i] != str2[i]) return str1[i] - str2[i];
+		if (!str1[i]) break;
+	}
+	return 0;
+}
+
+static char* byte_strchr(const char* str, int c)
+{
+	while (*str) {
+		if (*str == c) return (char*) str;
+		str++;
+	}
+	return NULL;
+}
+
+static char* byte_strrchr(const char* str, int c)
+{
+	const char* last = NULL;
+	while (*str) {
+		if (*str == c) last = str;
+		str++;
+	}
+	return (char*) last;
+}
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * Benchmark measuring how late sleeping threads are woken up by their timers,
+ * and the cost of reading the time.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/sched/sched.h>
+#include <kernel/time/timer.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+
+#define NUM_SLEEPS			100
+#define NUM_READS			10000
+
+/* Sleeps from 50us to about 1ms, shorter than a tick, which the old tick-based sleeps rounded up to */
+#define SLEEP_NS(i)			(50 * NSEC_PER_USEC + ((i) * 37 % 1000) * NSEC_PER_USEC)
+
+
+void bench_wakeup_latency(void)
+{
+	uint64_t total_latency = 0;
+	uint64_t max_latency = 0;
+
+	for (unsigned int i = 0; i < NUM_SLEEPS; i++)
+	{
+		uint64_t deadline = ktime_get_ns() + SLEEP_NS(i);
+
+		thread_sleep_ns(SLEEP_NS(i));
+
+		uint64_t latency = ktime_get_ns() - deadline;
+		total_latency += latency;
+		if (latency > max_latency)
+			max_latency = latency;
+	}
+
+	uint64_t start = rdtsc();
+	for (unsigned int i = 0; i < NUM_READS; i++)
+		ktime_get_ns();
+	uint64_t read_cycles = rdtsc() - start;
+
+	printf("wakeup latency: %llu ns average, %llu ns max over %u sleeps\n",
+		total_latency / NUM_SLEEPS, max_latency, NUM_SLEEPS);
+	bench_report("ktime_get_ns", read_cycles, NUM_READS);
+
+	timer_print();
+}
+
+#endif
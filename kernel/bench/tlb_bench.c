@@ -0,0 +1,184 @@
+/**
+ * Benchmarks of the TLB: random accesses over a large span of low memory through
+ * the direct map, made of global large pages, against the same span mapped with
+ * 4KB pages like the old direct map, with and without CR3 reloads in between,
+ * and unmapping pages with an invlpg each against a batched TLB flush.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/mm/mm.h>
+#include <kernel/mm/vmalloc.h>
+#include <kernel/utils.h>
+#include <kernel/system.h>
+
+#include <kernel/arch/i386/system.h>
+#include <kernel/arch/i386/paging.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+
+/* The span read, past the kernel image, and cut short if there's less low memory */
+#define SPAN_START			(16 << 20)
+#define SPAN_SIZE			(256 << 20)
+#define NUM_ACCESSES		(1 << 16)
+
+/* Unused user space, where the span is mapped again with 4KB pages */
+#define SMALL_MAP_BASE		0x40000000
+
+/* The number of reads between two CR3 reloads, in the runs that reload it */
+#define RELOAD_INTERVAL		64
+
+#define REMAP_NUM_PAGES		1024
+
+
+static page_t* frames[REMAP_NUM_PAGES];
+
+
+static uint64_t random_reads(uintptr_t base, size_t num_pages, bool reload_cr3);
+static void map_frames(uint8_t* buf);
+
+
+void bench_tlb(void)
+{
+	uintptr_t lowmem_end = (uintptr_t) MIN(max_pfn, (unsigned long) HIGH_MEM_PFN) * PAGE_SIZE;
+	if (lowmem_end <= SPAN_START)
+		return;
+
+	size_t num_pages = MIN(lowmem_end - SPAN_START, (uintptr_t) SPAN_SIZE) / PAGE_SIZE;
+	uintptr_t direct_base = P2V((uintptr_t) SPAN_START);
+
+	/* Map the span again with non-global 4KB pages, as boot.S used to map low memory */
+	size_t num_pts = DIV_CEIL(num_pages, PT_NUM_ENTRIES);
+	uintptr_t pts_phys = (uintptr_t) alloc_pages(num_pts, PA_KERNEL);
+	pte_t* pts = (pte_t*) P2V(pts_phys);
+	pde_t* pdes = kernel_page_directory + ADDR_TO_PDE_INDEX(SMALL_MAP_BASE);
+
+	for (size_t i = 0; i < num_pages; i++)
+		pts[i] = PTE((pte_t) SPAN_START + i * PAGE_SIZE, PAGE_PRESENT | PAGE_WRITE);
+	for (size_t i = num_pages; i < num_pts * PT_NUM_ENTRIES; i++)
+		pts[i] = 0;
+
+	for (size_t i = 0; i < num_pts; i++) {
+		ASSERT(!(pdes[i] & PAGE_PRESENT));
+		pdes[i] = PDE((pde_t) pts_phys + i * PT_SIZE, PAGE_PRESENT | PAGE_WRITE);
+	}
+
+	uint64_t direct_cycles = random_reads(direct_base, num_pages, false);
+	uint64_t small_cycles = random_reads(SMALL_MAP_BASE, num_pages, false);
+	uint64_t direct_reload_cycles = random_reads(direct_base, num_pages, true);
+	uint64_t small_reload_cycles = random_reads(SMALL_MAP_BASE, num_pages, true);
+
+	printf("TLB span: %u MB\n", (unsigned int) (num_pages * PAGE_SIZE >> 20));
+	bench_report("random reads, direct map (global large pages)", direct_cycles, NUM_ACCESSES);
+	bench_report("random reads, 4KB pages", small_cycles, NUM_ACCESSES);
+	bench_report("random reads, direct map, CR3 reloads", direct_reload_cycles, NUM_ACCESSES);
+	bench_report("random reads, 4KB pages, CR3 reloads", small_reload_cycles, NUM_ACCESSES);
+
+	for (size_t i = 0; i < num_pts; i++)
+		pdes[i] = 0;
+	tlb_flush_all();
+
+	free_pages((void*) pts_phys, num_pts);
+}
+
+
+void bench_tlb_batch(void)
+{
+	uint8_t* buf = vmalloc_lazy(REMAP_NUM_PAGES * PAGE_SIZE);
+	ASSERT(buf != NULL);
+
+	for (unsigned int i = 0; i < REMAP_NUM_PAGES; i++)
+		frames[i] = alloc_frame(PA_HIGHMEM);
+
+	map_frames(buf);
+
+	uint64_t start = rdtsc();
+
+	for (unsigned int i = 0; i < REMAP_NUM_PAGES; i++)
+		paging_unmap_kernel_page((uintptr_t) buf + i * PAGE_SIZE);
+
+	uint64_t invlpg_cycles = rdtsc() - start;
+
+	map_frames(buf);
+
+	tlb_batch_t batch;
+	tlb_batch_init(&batch);
+	start = rdtsc();
+
+	paging_unmap_range(kernel_page_directory, (uintptr_t) buf, REMAP_NUM_PAGES, false, &batch);
+	tlb_batch_flush(&batch);
+
+	uint64_t batch_cycles = rdtsc() - start;
+
+	bench_report("unmap, invlpg per page", invlpg_cycles, REMAP_NUM_PAGES);
+	bench_report("unmap, batched flush", batch_cycles, REMAP_NUM_PAGES);
+
+	for (unsigned int i = 0; i < REMAP_NUM_PAGES; i++)
+		free_frame(frames[i]);
+
+	vfree(buf);
+}
+
+
+/**
+ * Reads a word from pseudo-random pages of a span.
+ * 
+ * @param base the virtual address of the span
+ * @param num_pages the number of pages of the span
+ * @param reload_cr3 true to reload CR3 every RELOAD_INTERVAL reads, which only
+ * keeps the global entries in the TLB
+ * 
+ * @return the number of cycles the reads took
+*/
+static uint64_t random_reads(uintptr_t base, size_t num_pages, bool reload_cr3)
+{
+	uint32_t seed = 1;
+	uint32_t sum = 0;
+
+	/* Touch every page first, so all runs start with the same lines cached */
+	for (size_t i = 0; i < num_pages; i++)
+		sum += *(volatile uint32_t*) (base + i * PAGE_SIZE);
+
+	uint64_t start = rdtsc();
+
+	for (unsigned int i = 0; i < NUM_ACCESSES; i++) {
+		if (reload_cr3 && i % RELOAD_INTERVAL == 0)
+			tlb_flush_all();
+
+		seed = seed * 1103515245 + 12345;
+		sum += *(volatile uint32_t*) (base + ((seed >> 8) % num_pages) * PAGE_SIZE);
+	}
+
+	uint64_t cycles = rdtsc() - start;
+
+	(void) sum;
+	return cycles;
+}
+
+/**
+ * Maps the frames into a buffer and touches every page, so they're all in the TLB.
+ * 
+ * @param buf the buffer
+*/
+static void map_frames(uint8_t* buf)
+{
+	tlb_batch_t batch;
+	tlb_batch_init(&batch);
+
+	for (unsigned int i = 0; i < REMAP_NUM_PAGES; i++)
+		paging_map_range(kernel_page_directory, (uintptr_t) buf + i * PAGE_SIZE, page_to_phys(frames[i]), 1, PAGE_WRITE | PAGE_GLOBAL, &batch);
+
+	tlb_batch_flush(&batch);
+
+	for (unsigned int i = 0; i < REMAP_NUM_PAGES; i++)
+		((volatile uint8_t*) buf)[i * PAGE_SIZE];
+}
+
+#endif
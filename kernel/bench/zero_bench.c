@@ -0,0 +1,74 @@
+/**
+ * Benchmark comparing PA_ZERO allocations that zero the page on the spot against
+ * ones served from the pool of pre-zeroed pages, and the cost of refilling it.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef KERNEL_BENCH
+
+#include <kernel/bench.h>
+#include <kernel/mm/mm.h>
+
+#include <kernel/arch/i386/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define NUM_ALLOCS			64
+
+
+static void* page_addrs[NUM_ALLOCS];
+
+
+static uint64_t alloc_zeroed(void);
+static void free_all(void);
+
+
+void bench_zero_pool(void)
+{
+	/* Nothing has been zeroed yet, the idle loop only runs after boot */
+	uint64_t miss_cycles = alloc_zeroed();
+	free_all();
+
+	uint64_t start = rdtsc();
+	zpool_refill(NUM_ALLOCS);
+	uint64_t refill_cycles = rdtsc() - start;
+
+	uint64_t hit_cycles = alloc_zeroed();
+	free_all();
+
+	bench_report("PA_ZERO alloc, zeroed on the spot", miss_cycles, NUM_ALLOCS);
+	bench_report("PA_ZERO alloc, from the zeroed pool", hit_cycles, NUM_ALLOCS);
+	bench_report("zeroed pool refill", refill_cycles, NUM_ALLOCS);
+
+	zpool_print();
+}
+
+
+/**
+ * Allocates NUM_ALLOCS zeroed pages.
+ * 
+ * @return the number of cycles it took
+*/
+static uint64_t alloc_zeroed(void)
+{
+	uint64_t start = rdtsc();
+
+	for (unsigned int i = 0; i < NUM_ALLOCS; i++)
+		page_addrs[i] = alloc_page(PA_ZERO);
+
+	return rdtsc() - start;
+}
+
+/**
+ * Frees the pages allocated by alloc_zeroed().
+*/
+static void free_all(void)
+{
+	for (unsigned int i = 0; i < NUM_ALLOCS; i++)
+		free_page(page_addrs[i]);
+}
+
+#endif
@@ -7,6 +7,14 @@
 #include <kernel/ds/list.h>
 
 
+void list_add_first(list_t* head, list_t* new)
+{
+	new->next = head->next;
+	new->prev = head;
+	head->next->prev = new;
+	head->next = new;
+}
+
 void list_add_last(list_t* head, list_t* new)
 {
 	new->next = head;
@@ -48,6 +56,27 @@ list_t* list_remove(list_t* head, list_t* entry)
 }
 
 
+void list_del(list_t* entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+}
+
+
+void list_splice_last(list_t* head, list_t* list)
+{
+	if (list->next == list)
+		return;
+
+	list->next->prev = head->prev;
+	head->prev->next = list->next;
+	head->prev = list->prev;
+	list->prev->next = head;
+
+	list->next = list->prev = list;
+}
+
+
 void list_for_each(list_t* head, void (*func)(list_t*))
 {
 	list_t* curr_entry = head->next;
@@ -12,19 +12,23 @@
 #include <kernel/fs/fs.h>
 #include <kernel/utils.h>
 #include <kernel/mm/mm.h>
+#include <kernel/mm/vmalloc.h>
 #include <kernel/ds/bitmap.h>
 #include <kernel/system.h>
+#include <kernel/time/ktime.h>
+#include <kernel/sync/mutex.h>
 
 
 #define SUPERBLOCK_SECTOR	(SUFS_SUPERBLOCK_OFFSET / dev->logical_sector_size)
 
-#define time(NULL) 0 // TODO
-
 ata_dev_t* dev;
 struct sufs_superblock sb;
 struct sufs_dinode root_inode;
 void *block_buf, *map_block_buf, *indirect_block_buf;
 
+/* Serializes the operations on the file system, which share the buffers above */
+static mutex_t sufs_lock = MUTEX_INIT(sufs_lock, "sufs");
+
 
 static void write_superblock();
 static void write_inode(const struct sufs_dinode* inode);
@@ -36,6 +40,8 @@ static void remove_dir_dblock(struct sufs_dinode* dir_inode, uint32_t idx);
 static uint32_t get_data_block(const struct sufs_dinode* inode, uint32_t idx);
 static uint32_t alloc_data_block(struct sufs_dinode* inode, uint32_t idx);
 
+static ssize_t write_file(struct sufs_dinode* inode, void* data, uint64_t offset, size_t nbytes);
+static ssize_t read_file(struct sufs_dinode* inode, void* buf, uint64_t offset, size_t nbytes);
 static int create_file(char* path, int mode);
 static int delete_file(char* path, bool is_dir);
 
@@ -143,23 +149,27 @@ void sufs_mount(ata_dev_t* _dev)
 		write_superblock();
 	}
 
-	block_buf = kmalloc(sb.sb_block_size);
-	map_block_buf = kmalloc(sb.sb_block_size);
-	indirect_block_buf = kmalloc(sb.sb_block_size);
+	/* Large block sizes would need physically contiguous buffers from kmalloc */
+	block_buf = kvmalloc(sb.sb_block_size);
+	map_block_buf = kvmalloc(sb.sb_block_size);
+	indirect_block_buf = kvmalloc(sb.sb_block_size);
 	iget(sb.sb_roodir_inum, &root_inode);
 }
 
 void sufs_unmount(void)
 {
-	kfree(block_buf);
-	kfree(map_block_buf);
-	kfree(indirect_block_buf);
+	kvfree(block_buf);
+	kvfree(map_block_buf);
+	kvfree(indirect_block_buf);
 }
 
 
 struct sufs_dinode* sufs_open(char* path)
 {
+	mutex_lock(&sufs_lock);
 	struct sufs_dinode* inode = namei(path, NULL);
+	mutex_unlock(&sufs_lock);
+
 	if (inode == NULL) {
 		fs_errno = ENOENT;
 		return NULL;
@@ -170,158 +180,56 @@ struct sufs_dinode* sufs_open(char* path)
 
 int sufs_close(struct sufs_dinode* inode)
 {
+	mutex_lock(&sufs_lock);
 	iput(inode);
+	mutex_unlock(&sufs_lock);
+
 	return 0;
 }
 
 ssize_t sufs_write(struct sufs_dinode* inode, void* data, uint64_t offset, size_t nbytes)
 {
-	if (inode->di_mode & IFDIR) {
-		fs_errno = EISDIR;
-		return -1;
-	}
-
-	if (offset + nbytes > sb.sb_maxfilesize) {
-		fs_errno = EFBIG;
-		return -1;
-	}
-
-	uint64_t end_offset = offset + nbytes;
-	uint32_t end_block_idx = end_offset / sb.sb_block_size;
-
-	if (end_block_idx > SUFS_NDADDR)	// TODO
-		PANIC("Indirect blocks not supported yet");
-
-	uint32_t i = offset / sb.sb_block_size;
-	size_t to_write;
-	uint32_t block_idx;
-	size_t data_offset = 0;
-
-	// Write to the first block if offset is not block-aligned
-	if (offset % sb.sb_block_size > 0) {
-		uint32_t block_offset = offset % sb.sb_block_size;
-		to_write = MIN(nbytes, sb.sb_block_size - block_offset);
-		block_idx = i < inode->di_nblocks ?
-					get_data_block(inode, i) : alloc_data_block(inode, i);
-		if (block_idx == 0) {
-			fs_errno = ENOSPC;
-			return -1;
-		}
-
-		dev_read_block(block_buf, block_idx);
-		memcpy(block_buf + block_offset, data, to_write);
-		dev_write_block(block_buf, block_idx);
-
-		i++;
-		nbytes -= to_write;
-		data_offset += to_write;
-	}
-
-	// Write to the remaining blocks
-	for (; i < end_block_idx; i++) {
-		block_idx = i < inode->di_nblocks ?
-					get_data_block(inode, i) : alloc_data_block(inode, i);
-		if (block_idx == 0) {
-			fs_errno = ENOSPC;
-			return data_offset > 0 ? (ssize_t)data_offset : -1;
-		}
-
-		memcpy(block_buf, data + data_offset, sb.sb_block_size);
-		dev_write_block(block_buf, block_idx);
-
-		nbytes -= sb.sb_block_size;
-		data_offset += sb.sb_block_size;
-	}
-
-	// Write to the last block if last byte is not block-aligned
-	if (nbytes > 0) {
-		block_idx = i < inode->di_nblocks ?
-					get_data_block(inode, end_block_idx) :
-					alloc_data_block(inode, end_block_idx);
-		dev_read_block(block_buf, end_block_idx);
-		memcpy(block_buf, data + data_offset, nbytes);
-		dev_write_block(block_buf, block_idx);
+	mutex_lock(&sufs_lock);
+	ssize_t ret = write_file(inode, data, offset, nbytes);
+	mutex_unlock(&sufs_lock);
 
-		data_offset += nbytes;
-		nbytes = 0;
-	}
-
-	inode->di_size = MAX(inode->di_size, end_offset);
-	inode->di_mtime = time(NULL);
-	write_inode(inode);
-
-	return data_offset;
+	return ret;
 }
 
 ssize_t sufs_read(struct sufs_dinode* inode, void* buf, uint64_t offset, size_t nbytes)
 {
-	if (offset >= inode->di_size) {
-		fs_errno = EINVAL;
-		return -1;
-	}
-
-	nbytes = MIN(nbytes, inode->di_size - offset);
+	mutex_lock(&sufs_lock);
+	ssize_t ret = read_file(inode, buf, offset, nbytes);
+	mutex_unlock(&sufs_lock);
 
-	uint64_t end_offset = offset + nbytes;
-	uint32_t end_block_idx = end_offset / sb.sb_block_size;
-
-	uint32_t i = offset / sb.sb_block_size;
-	size_t to_read;
-	uint32_t block_idx;
-	size_t buf_offset = 0;
-
-	// Read the first block if offset is not block-aligned
-	if (offset % sb.sb_block_size > 0) {
-		uint32_t block_offset = offset % sb.sb_block_size;
-		to_read = MIN(nbytes, sb.sb_block_size - block_offset);
-		block_idx = get_data_block(inode, i);
-
-		dev_read_block(block_buf, block_idx);
-		memcpy(buf, block_buf + block_offset, to_read);
-
-		i++;
-		nbytes -= to_read;
-		buf_offset += to_read;
-	}
-
-	// Read the remaining blocks
-	for (; i < end_block_idx; i++) {
-		block_idx = get_data_block(inode, i);
-		to_read = MIN(nbytes, sb.sb_block_size);
-
-		dev_read_block(block_buf, block_idx);
-		memcpy(buf + buf_offset, block_buf, to_read);
-
-		nbytes -= to_read;
-		buf_offset += to_read;
-	}
-
-	// Read the last block if last byte is not block-aligned
-	if (nbytes > 0) {
-		block_idx = get_data_block(inode, end_block_idx);
-		dev_read_block(block_buf, block_idx);
-		memcpy(buf + buf_offset, block_buf, nbytes);
-
-		buf_offset += nbytes;
-		nbytes = 0;
-	}
-
-	return buf_offset;
+	return ret;
 }
 
 int sufs_create(char* path)
 {
-	return create_file(path, (IFREG | S_IRWXU | S_IRWXG | S_IRWXO));
+	mutex_lock(&sufs_lock);
+	int ret = create_file(path, (IFREG | S_IRWXU | S_IRWXG | S_IRWXO));
+	mutex_unlock(&sufs_lock);
+
+	return ret;
 }
 
 int sufs_unlink(char* path)
 {
-	return delete_file(path, false);
+	mutex_lock(&sufs_lock);
+	int ret = delete_file(path, false);
+	mutex_unlock(&sufs_lock);
+
+	return ret;
 }
 
 int sufs_mkdir(char* path)
 {
-	return create_file(path, (IFDIR | S_IRWXU | S_IRWXG | S_IRWXO));
+	mutex_lock(&sufs_lock);
+	int ret = create_file(path, (IFDIR | S_IRWXU | S_IRWXG | S_IRWXO));
+	mutex_unlock(&sufs_lock);
+
+	return ret;
 }
 
 int sufs_rmdir(char* path)
@@ -331,7 +239,11 @@ int sufs_rmdir(char* path)
 		return -1;
 	}
 
-	return delete_file(path, true);
+	mutex_lock(&sufs_lock);
+	int ret = delete_file(path, true);
+	mutex_unlock(&sufs_lock);
+
+	return ret;
 }
 
 
@@ -397,7 +309,7 @@ void sufs_dump_dir_tree(void)
  */
 static void write_superblock(void)
 {
-	sb.sb_time = time(NULL);
+	sb.sb_time = ktime_get_real_seconds();
 	dev_write_sector(&sb, SUPERBLOCK_SECTOR);
 }
 
@@ -619,6 +531,166 @@ static uint32_t alloc_data_block(struct sufs_dinode* inode, uint32_t idx)
 	return block_idx;
 }
 
+/**
+ * Writes data to a file, allocating its data blocks as needed.
+ * 
+ * Sets fs_errno on failure.
+ * 
+ * @param inode the inode of the file
+ * @param data the data to write
+ * @param offset the offset in the file to write at
+ * @param nbytes the number of bytes to write
+ * 
+ * @return the number of bytes written, or -1 on failure
+ */
+static ssize_t write_file(struct sufs_dinode* inode, void* data, uint64_t offset, size_t nbytes)
+{
+	if (inode->di_mode & IFDIR) {
+		fs_errno = EISDIR;
+		return -1;
+	}
+
+	if (offset + nbytes > sb.sb_maxfilesize) {
+		fs_errno = EFBIG;
+		return -1;
+	}
+
+	uint64_t end_offset = offset + nbytes;
+	uint32_t end_block_idx = end_offset / sb.sb_block_size;
+
+	if (end_block_idx > SUFS_NDADDR)	// TODO
+		PANIC("Indirect blocks not supported yet");
+
+	uint32_t i = offset / sb.sb_block_size;
+	size_t to_write;
+	uint32_t block_idx;
+	size_t data_offset = 0;
+
+	// Write to the first block if offset is not block-aligned
+	if (offset % sb.sb_block_size > 0) {
+		uint32_t block_offset = offset % sb.sb_block_size;
+		to_write = MIN(nbytes, sb.sb_block_size - block_offset);
+		block_idx = i < inode->di_nblocks ?
+					get_data_block(inode, i) : alloc_data_block(inode, i);
+		if (block_idx == 0) {
+			fs_errno = ENOSPC;
+			return -1;
+		}
+
+		dev_read_block(block_buf, block_idx);
+		memcpy(block_buf + block_offset, data, to_write);
+		dev_write_block(block_buf, block_idx);
+
+		i++;
+		nbytes -= to_write;
+		data_offset += to_write;
+	}
+
+	// Write to the remaining blocks
+	for (; i < end_block_idx; i++) {
+		block_idx = i < inode->di_nblocks ?
+					get_data_block(inode, i) : alloc_data_block(inode, i);
+		if (block_idx == 0) {
+			fs_errno = ENOSPC;
+			return data_offset > 0 ? (ssize_t)data_offset : -1;
+		}
+
+		memcpy(block_buf, data + data_offset, sb.sb_block_size);
+		dev_write_block(block_buf, block_idx);
+
+		nbytes -= sb.sb_block_size;
+		data_offset += sb.sb_block_size;
+	}
+
+	// Write to the last block if last byte is not block-aligned
+	if (nbytes > 0) {
+		block_idx = i < inode->di_nblocks ?
+					get_data_block(inode, end_block_idx) :
+					alloc_data_block(inode, end_block_idx);
+		dev_read_block(block_buf, end_block_idx);
+		memcpy(block_buf, data + data_offset, nbytes);
+		dev_write_block(block_buf, block_idx);
+
+		data_offset += nbytes;
+		nbytes = 0;
+	}
+
+	inode->di_size = MAX(inode->di_size, end_offset);
+	inode->di_mtime = ktime_get_real_seconds();
+	inode->di_itime = inode->di_mtime;
+	write_inode(inode);
+
+	return data_offset;
+}
+
+/**
+ * Reads data from a file.
+ * 
+ * Sets fs_errno on failure.
+ * 
+ * @param inode the inode of the file
+ * @param buf the buffer to read into
+ * @param offset the offset in the file to read from
+ * @param nbytes the number of bytes to read
+ * 
+ * @return the number of bytes read, or -1 on failure
+ */
+static ssize_t read_file(struct sufs_dinode* inode, void* buf, uint64_t offset, size_t nbytes)
+{
+	if (offset >= inode->di_size) {
+		fs_errno = EINVAL;
+		return -1;
+	}
+
+	nbytes = MIN(nbytes, inode->di_size - offset);
+
+	uint64_t end_offset = offset + nbytes;
+	uint32_t end_block_idx = end_offset / sb.sb_block_size;
+
+	uint32_t i = offset / sb.sb_block_size;
+	size_t to_read;
+	uint32_t block_idx;
+	size_t buf_offset = 0;
+
+	// Read the first block if offset is not block-aligned
+	if (offset % sb.sb_block_size > 0) {
+		uint32_t block_offset = offset % sb.sb_block_size;
+		to_read = MIN(nbytes, sb.sb_block_size - block_offset);
+		block_idx = get_data_block(inode, i);
+
+		dev_read_block(block_buf, block_idx);
+		memcpy(buf, block_buf + block_offset, to_read);
+
+		i++;
+		nbytes -= to_read;
+		buf_offset += to_read;
+	}
+
+	// Read the remaining blocks
+	for (; i < end_block_idx; i++) {
+		block_idx = get_data_block(inode, i);
+		to_read = MIN(nbytes, sb.sb_block_size);
+
+		dev_read_block(block_buf, block_idx);
+		memcpy(buf + buf_offset, block_buf, to_read);
+
+		nbytes -= to_read;
+		buf_offset += to_read;
+	}
+
+	// Read the last block if last byte is not block-aligned
+	if (nbytes > 0) {
+		block_idx = get_data_block(inode, end_block_idx);
+		dev_read_block(block_buf, block_idx);
+		memcpy(buf + buf_offset, block_buf, nbytes);
+
+		buf_offset += nbytes;
+		nbytes = 0;
+	}
+
+	return buf_offset;
+}
+
 /**
  * Creates a file in the file system.
  * 
@@ -676,7 +748,7 @@ static int create_file(char* path, int mode)
 	inode.di_uid = 0;
 	inode.di_gid = 0;
 	inode.di_nlink = 1;
-	inode.di_ctime = time(NULL);
+	inode.di_ctime = ktime_get_real_seconds();
 	inode.di_atime = inode.di_ctime;
 	inode.di_mtime = inode.di_ctime;
 	inode.di_itime = inode.di_ctime;
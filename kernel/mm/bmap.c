@@ -26,12 +26,23 @@ static bmap_array_elem_t* bmap;
 
 static size_t bmap_arr_length;
 
+/* The summary has a bit for each bitmap array element, which is set if all of its entries are used */
+static bmap_array_elem_t* summary;
+
+static size_t summary_arr_length;
+
 static uintptr_t mem_start, mem_end;
 
 
 #define PAGES_PER_ARR_ELEM	(8 * sizeof(bmap_array_elem_t))
 #define BMAP_ARRAY_ELEM_MAX	((bmap_array_elem_t)ULONG_MAX)
 
+#define BMAP_ARR_LENGTH(num_pages)		DIV_CEIL((size_t) (num_pages), PAGES_PER_ARR_ELEM)
+#define SUMMARY_ARR_LENGTH(num_pages)	DIV_CEIL(BMAP_ARR_LENGTH(num_pages), PAGES_PER_ARR_ELEM)
+
+/* The size of the bitmap and its summary */
+#define BMAP_SIZE(num_pages)	((BMAP_ARR_LENGTH(num_pages) + SUMMARY_ARR_LENGTH(num_pages)) * sizeof(bmap_array_elem_t))
+
 #define MEM_START_PAGE	(mem_start / PAGE_SIZE)
 
 /* The bitmap does not include the static kernel or itself, therefore a page with index x corresponds to entry x - excluded pages. */
@@ -44,6 +55,9 @@ static uintptr_t mem_start, mem_end;
 #define BMAP_ENTRY_TO_ARR_IDX(be)		((be) / PAGES_PER_ARR_ELEM)
 #define BMAP_ENTRY_TO_BIT_OFFSET(be)	((be) % PAGES_PER_ARR_ELEM)
 
+#define ARR_IDX_TO_SUMMARY_IDX(ai)			((ai) / PAGES_PER_ARR_ELEM)
+#define ARR_IDX_TO_SUMMARY_BIT_OFFSET(ai)	((ai) % PAGES_PER_ARR_ELEM)
+
 
 uintptr_t bmap_init(uintptr_t static_kernel_end, uintptr_t mem_end);
 void bmap_exclude(uintptr_t start_addr, uintptr_t end_addr);
@@ -54,11 +68,16 @@ void* bmap_alloc_upper(size_t num_pages, uintptr_t addr_upper);
 void* bmap_alloc_range(size_t num_pages, uintptr_t addr_lower, uintptr_t addr_upper);
 
 void bmap_free(void* page_addr, size_t num_pages);
+void bmap_hand_over(void (*func)(phys_addr_t page_addr, size_t num_pages));
 void bmap_print(void);
 
 static void set_pages_used(uintptr_t page_addr, size_t num_pages);
 static void set_pages_free(uintptr_t page_addr, size_t num_pages);
 
+static size_t find_next_free(size_t bmap_entry, size_t limit);
+static size_t find_next_used(size_t bmap_entry, size_t limit);
+static size_t find_next_non_full(size_t arr_idx);
+
 
 /* Global Functions */
 
@@ -83,7 +102,7 @@ uintptr_t bmap_init(uintptr_t _mem_start, uintptr_t _mem_end)
 
 	size_t free_mem_size = mem_end - aligned_free_mem_start;
 	size_t num_free_pages = free_mem_size / PAGE_SIZE;
-	size_t bmap_size = ALIGN_UP(num_free_pages, PAGES_PER_ARR_ELEM) / 8;
+	size_t bmap_size = BMAP_SIZE(num_free_pages);
 
 	mem_start += bmap_size;
 
@@ -97,13 +116,14 @@ uintptr_t bmap_init(uintptr_t _mem_start, uintptr_t _mem_end)
 		/* Exclude additional memory the bitmap will occupy */
 		free_mem_size = mem_end - aligned_free_mem_start;
 		num_free_pages = free_mem_size / PAGE_SIZE;
-		bmap_size = ALIGN_UP(num_free_pages, PAGES_PER_ARR_ELEM) / 8;
 
 		// TODO: reclaim page that might become available due to the bitmap's size reduction
 	}
 
 	mem_start = aligned_free_mem_start;
-	bmap_arr_length = bmap_size / sizeof(bmap_array_elem_t);
+	bmap_arr_length = BMAP_ARR_LENGTH(num_free_pages);
+	summary_arr_length = SUMMARY_ARR_LENGTH(num_free_pages);
+	summary = bmap + bmap_arr_length;
 
 	if (mem_start >= mem_end) {
 		PANIC("Not enough memory to allocate bitmap");
@@ -114,7 +134,19 @@ uintptr_t bmap_init(uintptr_t _mem_start, uintptr_t _mem_end)
 		bmap[i] = 0;
 
 	/* Set leftover pages as used */
-	bmap[bmap_arr_length - 1] = ~(BMAP_ARRAY_ELEM_MAX >> (num_free_pages % PAGES_PER_ARR_ELEM));
+	if (num_free_pages % PAGES_PER_ARR_ELEM)
+		bmap[bmap_arr_length - 1] = BMAP_ARRAY_ELEM_MAX << (num_free_pages % PAGES_PER_ARR_ELEM);
+	else
+		bmap[bmap_arr_length - 1] = 0;
+
+	/* No array element is full, except for the summary bits past the end of the bitmap */
+	for (unsigned int i = 0; i < summary_arr_length - 1; i++)
+		summary[i] = 0;
+
+	if (bmap_arr_length % PAGES_PER_ARR_ELEM)
+		summary[summary_arr_length - 1] = BMAP_ARRAY_ELEM_MAX << (bmap_arr_length % PAGES_PER_ARR_ELEM);
+	else
+		summary[summary_arr_length - 1] = 0;
 
 	return mem_start;
 }
@@ -204,49 +236,26 @@ void* bmap_alloc_range(size_t num_pages, uintptr_t addr_lower, uintptr_t addr_up
 	if ((addr_upper - addr_lower) / PAGE_SIZE < num_pages)
 		return NULL;
 
-	unsigned long start_entry = PAGE_ADDR_TO_BMAP_ENTRY(addr_lower);
-	unsigned long end_entry = PAGE_ADDR_TO_BMAP_ENTRY(addr_upper);
-
-	unsigned long curr_entry = start_entry;
-	size_t contiguous_pages_found = 0;
+	size_t bmap_entry = PAGE_ADDR_TO_BMAP_ENTRY(addr_lower);
+	size_t end_entry = PAGE_ADDR_TO_BMAP_ENTRY(addr_upper);
 
 	/* Only search within the specified range */
-	for (size_t i = BMAP_ENTRY_TO_ARR_IDX(start_entry); curr_entry + contiguous_pages_found < end_entry; i++)
+	while (end_entry - bmap_entry >= num_pages)
 	{
-		bmap_array_elem_t arr_elem = bmap[i];
+		bmap_entry = find_next_free(bmap_entry, end_entry);
+		if (end_entry - bmap_entry < num_pages)
+			break;
 
-		/* Skip array elements with no free bitmap entries */
-		if (!((bmap_array_elem_t)~arr_elem)) {
-			contiguous_pages_found = 0;
-			curr_entry = (i + 1) * PAGES_PER_ARR_ELEM;
-			continue;
-		}
+		/* Check if the run of free pages is long enough */
+		size_t run_end = find_next_used(bmap_entry, bmap_entry + num_pages);
 
-		bmap_array_elem_t search_mask = 1;
-
-		for (size_t j = 0; j < PAGES_PER_ARR_ELEM; j++)
-		{
-			/* If it's the first iteration, adjust the starting bit */
-			if (i == BMAP_ENTRY_TO_ARR_IDX(start_entry) && j == 0) {
-				j = BMAP_ENTRY_TO_BIT_OFFSET(start_entry);
-				search_mask <<= j;
-			}
-
-			if (~arr_elem & search_mask) {
-				contiguous_pages_found++;
-			} else {
-				contiguous_pages_found = 0;
-				curr_entry = i * PAGES_PER_ARR_ELEM + j + 1;
-			}
-
-			if (contiguous_pages_found == num_pages) {
-				uintptr_t page_addr = BMAP_ENTRY_TO_PAGE_ADDR(curr_entry);
-				set_pages_used(page_addr, num_pages);
-				return (void*) page_addr;
-			}
-
-			search_mask <<= 1;
+		if (run_end - bmap_entry == num_pages) {
+			uintptr_t page_addr = BMAP_ENTRY_TO_PAGE_ADDR(bmap_entry);
+			set_pages_used(page_addr, num_pages);
+			return (void*) page_addr;
 		}
+
+		bmap_entry = run_end;
 	}
 
 	return NULL;
@@ -268,6 +277,45 @@ void bmap_free(void* page_addr, size_t num_pages)
 }
 
 
+/**
+ * Hands all free pages over to another allocator and sets them as used.
+ * 
+ * The free pages are reported in runs of contiguous pages.
+ * 
+ * @param func the function to call with each run of free pages
+*/
+void bmap_hand_over(void (*func)(phys_addr_t page_addr, size_t num_pages))
+{
+	size_t end_entry = PAGE_ADDR_TO_BMAP_ENTRY(mem_end);
+	size_t run_start = 0, run_length = 0;
+
+	for (size_t entry = 0; entry < end_entry; entry++)
+	{
+		bmap_array_elem_t mask = (bmap_array_elem_t) 1 << BMAP_ENTRY_TO_BIT_OFFSET(entry);
+
+		if (!(bmap[BMAP_ENTRY_TO_ARR_IDX(entry)] & mask)) {
+			if (run_length++ == 0)
+				run_start = entry;
+			continue;
+		}
+
+		if (run_length > 0) {
+			func(BMAP_ENTRY_TO_PAGE_ADDR(run_start), run_length);
+			run_length = 0;
+		}
+	}
+
+	if (run_length > 0)
+		func(BMAP_ENTRY_TO_PAGE_ADDR(run_start), run_length);
+
+	for (size_t i = 0; i < bmap_arr_length; i++)
+		bmap[i] = BMAP_ARRAY_ELEM_MAX;
+
+	for (size_t i = 0; i < summary_arr_length; i++)
+		summary[i] = BMAP_ARRAY_ELEM_MAX;
+}
+
+
 /**
  * Prints the bitmap's contents.
 */
@@ -282,6 +330,11 @@ void bmap_print(void)
 	for (size_t i = 0; i < bmap_arr_length; i++)
 		printf("0x%X ", bmap[i]);
 	printf("\n");
+
+	printf("summary: ");
+	for (size_t i = 0; i < summary_arr_length; i++)
+		printf("0x%X ", summary[i]);
+	printf("\n");
 }
 
 
@@ -307,6 +360,9 @@ static void set_pages_used(uintptr_t page_addr, size_t num_pages)
 			~(BMAP_ARRAY_ELEM_MAX << bits_to_set) << bit_offset;
 		bmap[arr_idx] |= mask;
 
+		if (bmap[arr_idx] == BMAP_ARRAY_ELEM_MAX)
+			summary[ARR_IDX_TO_SUMMARY_IDX(arr_idx)] |= (bmap_array_elem_t) 1 << ARR_IDX_TO_SUMMARY_BIT_OFFSET(arr_idx);
+
 		num_pages -= bits_to_set;
 		arr_idx++;
 		bit_offset = 0;
@@ -332,9 +388,93 @@ static void set_pages_free(uintptr_t page_addr, size_t num_pages)
 		bmap_array_elem_t mask = bits_to_zero == PAGES_PER_ARR_ELEM ? BMAP_ARRAY_ELEM_MAX :
 			~(BMAP_ARRAY_ELEM_MAX << bits_to_zero) << bit_offset;
 		bmap[arr_idx] &= ~mask;
+		summary[ARR_IDX_TO_SUMMARY_IDX(arr_idx)] &= ~((bmap_array_elem_t) 1 << ARR_IDX_TO_SUMMARY_BIT_OFFSET(arr_idx));
 
 		num_pages -= bits_to_zero;
 		arr_idx++;
 		bit_offset = 0;
 	}
 }
+
+
+/**
+ * Finds the first free bitmap entry at or after a given one.
+ * 
+ * @param bmap_entry the bitmap entry to start searching from
+ * @param limit the bitmap entry to stop searching at, exclusive
+ * 
+ * @return the first free bitmap entry or limit if none was found
+*/
+static size_t find_next_free(size_t bmap_entry, size_t limit)
+{
+	size_t arr_idx = BMAP_ENTRY_TO_ARR_IDX(bmap_entry);
+
+	/* Check the remaining entries of the first array element */
+	bmap_array_elem_t free_mask = ~bmap[arr_idx] & (BMAP_ARRAY_ELEM_MAX << BMAP_ENTRY_TO_BIT_OFFSET(bmap_entry));
+
+	/* Use the summary to skip array elements with no free entries */
+	if (!free_mask) {
+		arr_idx = find_next_non_full(arr_idx + 1);
+		if (arr_idx >= bmap_arr_length)
+			return limit;
+
+		free_mask = ~bmap[arr_idx];
+	}
+
+	bmap_entry = arr_idx * PAGES_PER_ARR_ELEM + __builtin_ctzl(free_mask);
+
+	return MIN(bmap_entry, limit);
+}
+
+/**
+ * Finds the first used bitmap entry at or after a given one.
+ * 
+ * @param bmap_entry the bitmap entry to start searching from
+ * @param limit the bitmap entry to stop searching at, exclusive
+ * 
+ * @return the first used bitmap entry or limit if none was found
+*/
+static size_t find_next_used(size_t bmap_entry, size_t limit)
+{
+	size_t arr_idx = BMAP_ENTRY_TO_ARR_IDX(bmap_entry);
+
+	bmap_array_elem_t used_mask = bmap[arr_idx] & (BMAP_ARRAY_ELEM_MAX << BMAP_ENTRY_TO_BIT_OFFSET(bmap_entry));
+
+	while (!used_mask) {
+		arr_idx++;
+		if (arr_idx * PAGES_PER_ARR_ELEM >= limit)
+			return limit;
+
+		used_mask = bmap[arr_idx];
+	}
+
+	bmap_entry = arr_idx * PAGES_PER_ARR_ELEM + __builtin_ctzl(used_mask);
+
+	return MIN(bmap_entry, limit);
+}
+
+/**
+ * Finds the first bitmap array element with free entries at or after a given one.
+ * 
+ * @param arr_idx the index of the array element to start searching from
+ * 
+ * @return the index of the array element or bmap_arr_length if none was found
+*/
+static size_t find_next_non_full(size_t arr_idx)
+{
+	if (arr_idx >= bmap_arr_length)
+		return bmap_arr_length;
+
+	size_t summary_idx = ARR_IDX_TO_SUMMARY_IDX(arr_idx);
+
+	bmap_array_elem_t non_full_mask = ~summary[summary_idx] & (BMAP_ARRAY_ELEM_MAX << ARR_IDX_TO_SUMMARY_BIT_OFFSET(arr_idx));
+
+	while (!non_full_mask) {
+		if (++summary_idx >= summary_arr_length)
+			return bmap_arr_length;
+
+		non_full_mask = ~summary[summary_idx];
+	}
+
+	return MIN(summary_idx * PAGES_PER_ARR_ELEM + __builtin_ctzl(non_full_mask), bmap_arr_length);
+}
@@ -0,0 +1,372 @@
+/**
+ * Code for the buddy page allocator.
+ * 
+ * Free memory is kept in per-zone lists of naturally aligned blocks of 2^order
+ * pages. Blocks are split on allocation and coalesced with their buddies when
+ * freed, so both operations take O(log n) regardless of the amount of memory.
+ * 
+ * Refer to:
+ * https://www.kernel.org/doc/gorman/html/understand/understand009.html
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/mm/mm.h>
+#include <kernel/ds/list.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/utils.h>
+#include <kernel/system.h>
+
+/* Must be defined: PAGE_SIZE */
+#ifdef __i386__
+#include <kernel/arch/i386/paging.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+
+#define BUDDY_MAX_ORDER		11		/* Blocks of up to 2^10 pages (4MB) */
+
+#define INVALID_PFN			((unsigned long) -1)
+
+#define PAGE_ADDR_TO_PFN(pa)	((unsigned long) ((pa) / PAGE_SIZE))
+
+
+typedef struct zone_s {
+	const char* name;
+	spinlock_t lock;			/* Protects the free lists and their counters */
+
+	unsigned long start_pfn;
+	unsigned long end_pfn;
+
+	size_t num_free_pages;
+
+	list_t free_area[BUDDY_MAX_ORDER];
+	size_t num_free_blocks[BUDDY_MAX_ORDER];
+} zone_t;
+
+static zone_t zones[NUM_ZONES];
+
+
+void buddy_init(void);
+void buddy_add_free_range(phys_addr_t page_addr, size_t num_pages);
+
+page_t* buddy_alloc(unsigned int zone_id, size_t num_pages);
+void buddy_free(page_t* page, size_t num_pages);
+
+size_t buddy_num_free_pages(unsigned int zone_id);
+void buddy_print(void);
+
+static unsigned long alloc_block(zone_t* zone, unsigned int order);
+static void free_block(zone_t* zone, unsigned long pfn, unsigned int order);
+static void free_range(zone_t* zone, unsigned long pfn, size_t num_pages);
+
+static void add_free_block(zone_t* zone, unsigned long pfn, unsigned int order);
+static void del_free_block(zone_t* zone, unsigned long pfn, unsigned int order);
+
+static zone_t* pfn_to_zone(unsigned long pfn);
+static unsigned int num_pages_to_order(size_t num_pages);
+
+
+/* Global Functions */
+
+/**
+ * Initializes the zones of the buddy allocator.
+ * 
+ * The zones start out empty, free memory is given to them with buddy_add_free_range().
+ * The sections' page_t arrays must already be initialized.
+*/
+void buddy_init(void)
+{
+	zones[ZONE_NORMAL].name = "Normal";
+	zones[ZONE_NORMAL].start_pfn = 0;
+	zones[ZONE_NORMAL].end_pfn = MIN(max_pfn, (unsigned long) HIGH_MEM_PFN);
+
+	zones[ZONE_HIGHMEM].name = "HighMem";
+	zones[ZONE_HIGHMEM].start_pfn = HIGH_MEM_PFN;
+	zones[ZONE_HIGHMEM].end_pfn = MAX(max_pfn, (unsigned long) HIGH_MEM_PFN);
+
+	for (unsigned int i = 0; i < NUM_ZONES; i++) {
+		spin_lock_init(&zones[i].lock, zones[i].name);
+		zones[i].num_free_pages = 0;
+
+		for (unsigned int order = 0; order < BUDDY_MAX_ORDER; order++) {
+			LIST_INIT(zones[i].free_area[order]);
+			zones[i].num_free_blocks[order] = 0;
+		}
+	}
+}
+
+/**
+ * Gives a range of free pages to the buddy allocator.
+ * 
+ * The range may span more than one zone.
+ * 
+ * @param page_addr the address of the first page
+ * @param num_pages the number of contiguous pages
+*/
+void buddy_add_free_range(phys_addr_t page_addr, size_t num_pages)
+{
+	unsigned long start_pfn = PAGE_ADDR_TO_PFN(page_addr);
+	unsigned long end_pfn = start_pfn + num_pages;
+
+	for (unsigned int i = 0; i < NUM_ZONES; i++)
+	{
+		unsigned long zone_start_pfn = MAX(start_pfn, zones[i].start_pfn);
+		unsigned long zone_end_pfn = MIN(end_pfn, zones[i].end_pfn);
+
+		if (zone_start_pfn < zone_end_pfn) {
+			spin_lock(&zones[i].lock);
+			free_range(zones + i, zone_start_pfn, zone_end_pfn - zone_start_pfn);
+			spin_unlock(&zones[i].lock);
+		}
+	}
+}
+
+
+/**
+ * Allocates contiguous pages from a zone.
+ * 
+ * A block of the smallest sufficient order is taken and the pages
+ * past num_pages are given back.
+ * 
+ * @param zone_id the zone to allocate from
+ * @param num_pages the number of pages to allocate
+ * 
+ * @return the first page or NULL if the zone doesn't have a large enough free block
+*/
+page_t* buddy_alloc(unsigned int zone_id, size_t num_pages)
+{
+	if (num_pages == 0)
+		return NULL;
+
+	unsigned int order = num_pages_to_order(num_pages);
+	if (order >= BUDDY_MAX_ORDER)
+		return NULL;
+
+	zone_t* zone = zones + zone_id;
+
+	spin_lock(&zone->lock);
+
+	unsigned long pfn = alloc_block(zone, order);
+
+	/* Give back the tail of the block that wasn't requested */
+	if (pfn != INVALID_PFN && (1UL << order) > num_pages)
+		free_range(zone, pfn + num_pages, (1UL << order) - num_pages);
+
+	spin_unlock(&zone->lock);
+
+	if (pfn == INVALID_PFN)
+		return NULL;
+
+	return pfn_to_page(pfn);
+}
+
+/**
+ * Frees contiguous pages.
+ * 
+ * The pages don't need to have been allocated in a single call, as long as
+ * they all belong to the same zone.
+ * 
+ * @param page the first page
+ * @param num_pages the number of contiguous pages to free
+*/
+void buddy_free(page_t* page, size_t num_pages)
+{
+	unsigned long pfn = page_to_pfn(page);
+	zone_t* zone = pfn_to_zone(pfn);
+
+	spin_lock(&zone->lock);
+	free_range(zone, pfn, num_pages);
+	spin_unlock(&zone->lock);
+}
+
+
+/**
+ * Returns the number of free pages in a zone.
+ * 
+ * @param zone_id the zone
+ * 
+ * @return the number of free pages in the zone
+*/
+size_t buddy_num_free_pages(unsigned int zone_id)
+{
+	return zones[zone_id].num_free_pages;
+}
+
+/**
+ * Prints the number of free blocks of each order in each zone.
+*/
+void buddy_print(void)
+{
+	for (unsigned int i = 0; i < NUM_ZONES; i++)
+	{
+		printf("%s: %u free pages\n", zones[i].name, zones[i].num_free_pages);
+
+		for (unsigned int order = 0; order < BUDDY_MAX_ORDER; order++)
+			printf("%u ", zones[i].num_free_blocks[order]);
+		printf("\n");
+	}
+}
+
+
+/* Helper Functions */
+
+/**
+ * Allocates a block of 2^order pages from a zone, splitting a larger one if needed.
+ * 
+ * @param zone the zone to allocate from
+ * @param order the order of the block
+ * 
+ * @return the page frame number of the first page of the block or INVALID_PFN
+ * if no block large enough is free
+*/
+static unsigned long alloc_block(zone_t* zone, unsigned int order)
+{
+	for (unsigned int curr_order = order; curr_order < BUDDY_MAX_ORDER; curr_order++)
+	{
+		list_t* entry = LIST_FIRST(zone->free_area[curr_order]);
+		if (entry == NULL)
+			continue;
+
+		unsigned long pfn = page_to_pfn((page_t*) entry);
+		del_free_block(zone, pfn, curr_order);
+
+		/* Split the block, returning the upper halves to the free lists */
+		while (curr_order > order) {
+			curr_order--;
+			add_free_block(zone, pfn + (1UL << curr_order), curr_order);
+		}
+
+		return pfn;
+	}
+
+	return INVALID_PFN;
+}
+
+/**
+ * Frees a block of 2^order pages, coalescing it with its free buddies.
+ * 
+ * @param zone the zone the block belongs to
+ * @param pfn the page frame number of the first page of the block
+ * @param order the order of the block
+*/
+static void free_block(zone_t* zone, unsigned long pfn, unsigned int order)
+{
+	ASSERT(!(pfn_to_page(pfn)->flags & PG_BUDDY));
+
+	while (order < BUDDY_MAX_ORDER - 1)
+	{
+		unsigned long buddy_pfn = pfn ^ (1UL << order);
+
+		if (buddy_pfn < zone->start_pfn || buddy_pfn >= zone->end_pfn)
+			break;
+
+		page_t* buddy = pfn_to_page(buddy_pfn);
+
+		/* The buddy can only be merged if it heads a free block of the same order */
+		if (!(buddy->flags & PG_BUDDY) || buddy->order != order)
+			break;
+
+		del_free_block(zone, buddy_pfn, order);
+
+		pfn &= ~(1UL << order);
+		order++;
+	}
+
+	add_free_block(zone, pfn, order);
+}
+
+/**
+ * Frees a range of pages by splitting it into the largest naturally aligned blocks.
+ * 
+ * @param zone the zone the pages belong to
+ * @param pfn the page frame number of the first page
+ * @param num_pages the number of contiguous pages to free
+*/
+static void free_range(zone_t* zone, unsigned long pfn, size_t num_pages)
+{
+	while (num_pages > 0)
+	{
+		unsigned int order = 0;
+
+		while (order < BUDDY_MAX_ORDER - 1 && !(pfn & (1UL << order)) && (2UL << order) <= num_pages)
+			order++;
+
+		free_block(zone, pfn, order);
+
+		pfn += 1UL << order;
+		num_pages -= 1UL << order;
+	}
+}
+
+
+/**
+ * Adds a block to the free list of its order.
+ * 
+ * @param zone the zone the block belongs to
+ * @param pfn the page frame number of the first page of the block
+ * @param order the order of the block
+*/
+static void add_free_block(zone_t* zone, unsigned long pfn, unsigned int order)
+{
+	page_t* page = pfn_to_page(pfn);
+
+	page->flags |= PG_BUDDY;
+	page->order = order;
+	list_add_last(&zone->free_area[order], &page->list);
+
+	zone->num_free_blocks[order]++;
+	zone->num_free_pages += 1UL << order;
+}
+
+/**
+ * Removes a block from the free list of its order.
+ * 
+ * @param zone the zone the block belongs to
+ * @param pfn the page frame number of the first page of the block
+ * @param order the order of the block
+*/
+static void del_free_block(zone_t* zone, unsigned long pfn, unsigned int order)
+{
+	page_t* page = pfn_to_page(pfn);
+
+	list_del(&page->list);
+	page->flags &= ~PG_BUDDY;
+
+	zone->num_free_blocks[order]--;
+	zone->num_free_pages -= 1UL << order;
+}
+
+
+/**
+ * Returns the zone a page frame belongs to.
+ * 
+ * @param pfn the page frame number
+ * 
+ * @return the zone the page frame belongs to
+*/
+static zone_t* pfn_to_zone(unsigned long pfn)
+{
+	return pfn >= HIGH_MEM_PFN ? zones + ZONE_HIGHMEM : zones + ZONE_NORMAL;
+}
+
+/**
+ * Returns the smallest order of a block that holds the given number of pages.
+ * 
+ * @param num_pages the number of pages
+ * 
+ * @return the order, or BUDDY_MAX_ORDER if no block is large enough
+*/
+static unsigned int num_pages_to_order(size_t num_pages)
+{
+	unsigned int order = 0;
+
+	while (order < BUDDY_MAX_ORDER && (1UL << order) < num_pages)
+		order++;
+
+	return order;
+}
@@ -0,0 +1,99 @@
+/**
+ * Code for handling page faults.
+ * 
+ * The only address space is the kernel's, whose lazily mapped areas are the
+ * ones reserved by vmalloc_lazy(). Their pages are only allocated and zeroed
+ * when first touched, so reserving them costs no memory and takes O(1).
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/mm/fault.h>
+#include <kernel/mm/vmalloc.h>
+#include <kernel/system.h>
+
+/* Must be defined: PF_ERR_PRESENT, rdtsc */
+#ifdef __i386__
+#include <kernel/arch/i386/paging.h>
+#include <kernel/arch/i386/system.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+typedef struct pf_stats_s {
+	unsigned long count;
+	uint64_t total_cycles;
+	uint64_t min_cycles;
+	uint64_t max_cycles;
+} pf_stats_t;
+
+static pf_stats_t pf_stats[NUM_PF_TYPES];
+
+static const char* pf_type_names[NUM_PF_TYPES] = {
+	"demand-zero", "spurious", "protection", "bad address"
+};
+
+
+static void pf_record(unsigned int type, uint64_t cycles);
+
+
+/* Global Functions */
+
+void page_fault_handler(uintptr_t addr, unsigned int error_code)
+{
+	uint64_t start = rdtsc();
+	unsigned int type;
+
+	if (error_code & PF_ERR_PRESENT)
+		type = PF_PROTECTION;
+	else if (is_vmalloc_addr(addr))
+		type = vmalloc_fault(addr);
+	else
+		type = PF_BAD_ADDRESS;
+
+	pf_record(type, rdtsc() - start);
+
+	if (type == PF_PROTECTION || type == PF_BAD_ADDRESS) {
+		printf("Page fault at 0x%X (%s), error code 0x%X\n", addr, pf_type_names[type], error_code);
+		PANIC("Unhandled page fault");
+	}
+}
+
+
+void page_fault_print_stats(void)
+{
+	for (unsigned int type = 0; type < NUM_PF_TYPES; type++)
+	{
+		pf_stats_t* stats = pf_stats + type;
+
+		if (stats->count == 0)
+			continue;
+
+		printf("%s faults: %u, cycles avg %llu min %llu max %llu\n", pf_type_names[type], stats->count,
+			stats->total_cycles / stats->count, stats->min_cycles, stats->max_cycles);
+	}
+}
+
+
+/* Helper Functions */
+
+/**
+ * Records a handled page fault in the statistics of its type.
+ * 
+ * @param type the type of the fault
+ * @param cycles the number of cycles it took to handle the fault
+*/
+static void pf_record(unsigned int type, uint64_t cycles)
+{
+	pf_stats_t* stats = pf_stats + type;
+
+	if (stats->count == 0 || cycles < stats->min_cycles)
+		stats->min_cycles = cycles;
+	if (cycles > stats->max_cycles)
+		stats->max_cycles = cycles;
+
+	stats->count++;
+	stats->total_cycles += cycles;
+}
@@ -0,0 +1,214 @@
+/**
+ * Code for mapping high memory pages.
+ * 
+ * Pages above HIGH_MEM_START aren't in the kernel's direct map, so they're mapped
+ * on demand, either in the pkmap window, where mappings are reference counted and
+ * only torn down in batches, or in the per-CPU slots used by kmap_atomic(), which
+ * only cost an invlpg.
+ * 
+ * Refer to:
+ * https://www.kernel.org/doc/gorman/html/understand/understand012.html
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/mm/highmem.h>
+#include <kernel/mm/mm.h>
+#include <kernel/sched/preempt.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/smp.h>
+#include <kernel/system.h>
+
+/* Must be defined: PAGE_SIZE */
+#ifdef __i386__
+#include <kernel/arch/i386/paging.h>
+#include <kernel/arch/i386/system.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * 0 means the slot is free, 1 that it's mapped but unused, so it can be reused
+ * without a TLB flush, and n > 1 that it has n - 1 users.
+*/
+static unsigned int pkmap_count[LAST_PKMAP];
+
+/* An unused slot that's been unmapped, but may still be in other CPUs' TLBs */
+#define PKMAP_FLUSHING		((unsigned int) -1)
+
+/* The next slot the search for a free one looks at */
+static unsigned int last_pkmap_nr;
+
+/* Set while the unused slots are being flushed, which is done without kmap_lock */
+static volatile bool pkmap_flushing;
+
+/* Protects the pkmap slots and the PG_KMAPPED flags */
+static spinlock_t kmap_lock = SPINLOCK_INIT("kmap");
+
+/* The number of atomic mappings in use by each CPU */
+static unsigned int kmap_atomic_idx[MAX_CPUS];
+
+
+static bool map_new_virtual(page_t* page);
+static bool flush_all_zero_pkmaps(void);
+
+
+/* Global Functions */
+
+void* kmap(page_t* page)
+{
+	if (!PageHighMem(page))
+		return (void*) P2V((uintptr_t) page_to_phys(page));
+
+	spin_lock(&kmap_lock);
+
+	/* The lock is dropped while flushing, so the page may have been mapped meanwhile */
+	while (!(page->flags & PG_KMAPPED) && !map_new_virtual(page)) {
+		if (!flush_all_zero_pkmaps())
+			PANIC("Out of kmap slots");
+	}
+
+	unsigned int nr = page->pkmap_nr;
+	pkmap_count[nr]++;
+
+	spin_unlock(&kmap_lock);
+
+	return (void*) PKMAP_ADDR(nr);
+}
+
+void kunmap(page_t* page)
+{
+	if (!PageHighMem(page))
+		return;
+
+	spin_lock(&kmap_lock);
+
+	ASSERT(page->flags & PG_KMAPPED && pkmap_count[page->pkmap_nr] > 1);
+
+	/* The mapping is kept until the slots run out, in case the page is mapped again */
+	pkmap_count[page->pkmap_nr]--;
+
+	spin_unlock(&kmap_lock);
+}
+
+
+void* kmap_atomic(page_t* page)
+{
+	if (!PageHighMem(page))
+		return (void*) P2V((uintptr_t) page_to_phys(page));
+
+	/* The slots belong to the CPU, so the thread can't move until they're unmapped */
+	preempt_disable();
+
+	unsigned int cpu = smp_cpu_id();
+	ASSERT(kmap_atomic_idx[cpu] < KM_TYPE_NR);
+
+	uintptr_t vaddr = FIXMAP_ADDR(cpu, kmap_atomic_idx[cpu]++);
+	paging_map_kernel_page(vaddr, page_to_phys(page), PAGE_WRITE);
+
+	return (void*) vaddr;
+}
+
+void kunmap_atomic(void* vaddr)
+{
+	if ((uintptr_t) vaddr < FIXMAP_BASE || (uintptr_t) vaddr >= FIXMAP_END)
+		return;
+
+	unsigned int cpu = smp_cpu_id();
+	ASSERT(kmap_atomic_idx[cpu] > 0 && (uintptr_t) vaddr == FIXMAP_ADDR(cpu, kmap_atomic_idx[cpu] - 1));
+
+	kmap_atomic_idx[cpu]--;
+	paging_unmap_kernel_page((uintptr_t) vaddr);
+
+	preempt_enable();
+}
+
+
+/* Helper Functions */
+
+/**
+ * Maps a high memory page in the next free pkmap slot, with kmap_lock held.
+ * 
+ * The slots are handed out in order, and the unused ones are only unmapped once
+ * the search reaches the last one, so the TLB is flushed once per pass.
+ * 
+ * @param page the page
+ * 
+ * @return true if the page was mapped, false if there's no free slot left in this pass
+*/
+static bool map_new_virtual(page_t* page)
+{
+	for (; last_pkmap_nr < LAST_PKMAP; last_pkmap_nr++)
+	{
+		if (pkmap_count[last_pkmap_nr] != 0)
+			continue;
+
+		paging_map_kernel_page(PKMAP_ADDR(last_pkmap_nr), page_to_phys(page), PAGE_WRITE);
+
+		pkmap_count[last_pkmap_nr] = 1;
+		page->pkmap_nr = last_pkmap_nr++;
+		page->flags |= PG_KMAPPED;
+
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Unmaps every mapped but unused pkmap slot, batching the TLB invalidations, and
+ * starts a new pass over the slots. Called with kmap_lock held.
+ * 
+ * The lock is dropped while the other CPUs are sent the invalidations, as one of
+ * them may be spinning on it with interrupts disabled and never acknowledge them.
+ * The slots stay taken until then, so they aren't reused while still in a TLB.
+ * 
+ * @return false if no slot could be freed, true otherwise
+*/
+static bool flush_all_zero_pkmaps(void)
+{
+	/* Another CPU is flushing, the slots it frees are as good as ours */
+	if (pkmap_flushing) {
+		spin_unlock(&kmap_lock);
+		while (pkmap_flushing)
+			cpu_relax();
+		spin_lock(&kmap_lock);
+		return true;
+	}
+
+	tlb_batch_t batch;
+	tlb_batch_init(&batch);
+	unsigned int num_freed = 0;
+
+	for (unsigned int nr = 0; nr < LAST_PKMAP; nr++)
+	{
+		if (pkmap_count[nr] != 1)
+			continue;
+
+		uintptr_t vaddr = PKMAP_ADDR(nr);
+		pfn_to_page(paging_kernel_page_phys(vaddr) / PAGE_SIZE)->flags &= ~PG_KMAPPED;
+
+		pkmap_count[nr] = PKMAP_FLUSHING;
+		paging_unmap_range(kernel_page_directory, vaddr, 1, false, &batch);
+		num_freed++;
+	}
+
+	pkmap_flushing = true;
+	spin_unlock(&kmap_lock);
+
+	tlb_batch_flush(&batch);
+
+	spin_lock(&kmap_lock);
+
+	for (unsigned int nr = 0; nr < LAST_PKMAP; nr++) {
+		if (pkmap_count[nr] == PKMAP_FLUSHING)
+			pkmap_count[nr] = 0;
+	}
+
+	last_pkmap_nr = 0;
+	pkmap_flushing = false;
+
+	return num_freed > 0;
+}
@@ -5,6 +5,7 @@
 */
 
 #include <kernel/mm/mm.h>
+#include <kernel/mm/vmalloc.h>
 #include <kernel/utils.h>
 #include <kernel/system.h>
 
@@ -13,13 +14,13 @@
 #include <stdbool.h>
 
 
-#define MEM_MAP_MAX_LENGTH	((1 << 30) / (4 * (1 << 10)))	/* 1GB / 4KB page frames */
-
-
 extern char _kernel_end_physical;
 
-/* A variable must be defined for boot sequence */
-const unsigned long low_mem_num_pages = HIGH_MEM_PFN;
+/* The bitmap only tracks memory below 4GB, which pointers can address */
+#define BMAP_MAX_ADDR		0xFFFFF000
+
+#define MMM_START(mmm)		((uint64_t) (mmm)->addr_high << 32 | (mmm)->addr_low)
+#define MMM_END(mmm)		(MMM_START(mmm) + ((uint64_t) (mmm)->len_high << 32 | (mmm)->len_low))
 
 
 extern uintptr_t bmap_init(uintptr_t mem_start, uintptr_t mem_end);
@@ -29,16 +30,41 @@ extern void* bmap_alloc_lower(size_t num_pages, uintptr_t addr_lower);
 extern void* bmap_alloc_upper(size_t num_pages, uintptr_t addr_upper);
 extern void* bmap_alloc_range(size_t num_pages, uintptr_t addr_lower, uintptr_t addr_upper);
 extern void bmap_free(void* page_addr, size_t num_pages);
+extern void bmap_hand_over(void (*func)(phys_addr_t page_addr, size_t num_pages));
 extern void bmap_print(void);
 
+extern void buddy_init(void);
+extern void buddy_add_free_range(phys_addr_t page_addr, size_t num_pages);
+extern page_t* buddy_alloc(unsigned int zone_id, size_t num_pages);
+extern void buddy_free(page_t* page, size_t num_pages);
+extern void buddy_print(void);
+
+extern void pcp_init(void);
+extern page_t* pcp_alloc(unsigned int zone_id, bool cold);
+extern void pcp_free(page_t* page, bool cold);
+extern void pcp_drain_all(void);
+
+extern void zpool_init(void);
+extern page_t* zpool_alloc(unsigned int zone_id);
+extern void zpool_drain_all(void);
+extern void zero_frame(page_t* page);
+
+
+page_t* mem_section[NUM_SECTIONS];
+unsigned long max_pfn;
 
 static struct kmem_cache_s* page_cache;
 
 
-static uintptr_t mem_map_init(uintptr_t mem_start, uintptr_t mem_end);
-static uintptr_t detect_mem_end(multiboot_info_t* mbi);
-static void detect_mem_holes(multiboot_info_t* mbi, uintptr_t mem_start);
+static page_t* zone_alloc(unsigned int zone_id, size_t num_pages, unsigned char flags);
+static uintptr_t sparse_init(multiboot_info_t* mbi, uintptr_t mem_start, phys_addr_t mem_end);
+static bool section_has_mem(multiboot_info_t* mbi, unsigned long section_nr);
+static phys_addr_t detect_mem_end(multiboot_info_t* mbi);
+static void detect_mem_holes(multiboot_info_t* mbi, uintptr_t mem_start, uintptr_t mem_end);
 static bool mmm_exceeds_max_mem(multiboot_memory_map_t* mmm);
+#ifdef CONFIG_X86_PAE
+static void add_mem_above_4gb(multiboot_info_t* mbi);
+#endif
 
 
 /* Global Functions */
@@ -50,66 +76,209 @@ void mm_init(multiboot_info_t* mbi)
         PANIC("Invalid memory map given by GRUB bootloader");
 	}
 
-	uintptr_t mem_end = detect_mem_end(mbi);
+	phys_addr_t mem_end = detect_mem_end(mbi);
 
-	/* Initialize mem_map */
-	uintptr_t mem_start = mem_map_init((uintptr_t) &_kernel_end_physical, mem_end);
+	/* Create the page_t arrays of the sections with memory */
+	uintptr_t mem_start = sparse_init(mbi, (uintptr_t) &_kernel_end_physical, mem_end);
 
 	/* Initialize bitmap */	
-	mem_start = bmap_init(mem_start, mem_end);
+	uintptr_t bmap_end = MIN(mem_end, (phys_addr_t) BMAP_MAX_ADDR);
+	mem_start = bmap_init(mem_start, bmap_end);
 
 	/* Detect and exclude memory holes */
-	detect_mem_holes(mbi, mem_start);
+	detect_mem_holes(mbi, mem_start, bmap_end);
+
+	/* Hand the free pages over to the buddy allocator */
+	buddy_init();
+	bmap_hand_over(buddy_add_free_range);
+#ifdef CONFIG_X86_PAE
+	add_mem_above_4gb(mbi);
+#endif
+	pcp_init();
+	zpool_init();
 
 	/* Initialize the slab allocator */
 	kmem_cache_init();
 
+	/* Initialize the page table pool */
+	paging_init();
+
+	/* Initialize the vmalloc allocator */
+	vmalloc_init();
+
 	/* Create a page cache */
-	page_cache = kmem_cache_create("page_cache", sizeof(page_t), mem_zero_cache_constructor, NULL);
+	page_cache = kmem_cache_create("page_cache", sizeof(page_t), 0, SLAB_ZERO, NULL, NULL);
 }
 
 
-void* alloc_pages(size_t num_pages, unsigned char flags)
+page_t* alloc_frames(size_t num_pages, unsigned char flags)
 {
-	void* page_addr;
+	page_t* page = NULL;
 
 	/* Try to allocate a page from high memory first if specified */
 	if (flags & PA_HIGHMEM)
-	{
-		page_addr = bmap_alloc_lower(num_pages, HIGH_MEM_START);
-		if (page_addr != NULL)
-			return page_addr;
-	}
+		page = zone_alloc(ZONE_HIGHMEM, num_pages, flags);
 
 	/* Otherwise, allocate from the kernel address space */
-	page_addr = bmap_alloc_upper(num_pages, HIGH_MEM_START);
-	if (page_addr == NULL)
+	if (page == NULL)
+		page = zone_alloc(ZONE_NORMAL, num_pages, flags);
+
+	/*
+	 * Take back the pages cached by the slab allocator, the zeroed pools and the CPUs
+	 * and try again. The first two free their pages to the CPUs' lists, so those are
+	 * drained last, for the buddy allocator to merge every page back into larger blocks.
+	*/
+	if (page == NULL) {
+		kmem_reap();
+		zpool_drain_all();
+		pcp_drain_all();
+		page = zone_alloc(ZONE_NORMAL, num_pages, flags);
+	}
+
+	if (page == NULL)
 		PANIC("out of memory");
 
-	return page_addr;
+	return page;
 }
 
+void* alloc_pages(size_t num_pages, unsigned char flags)
+{
+#ifdef CONFIG_X86_PAE
+	flags &= ~PA_HIGHMEM;
+#endif
+
+	return (void*) (uintptr_t) page_to_phys(alloc_frames(num_pages, flags));
+}
+
+
+void free_frames(page_t* page, size_t num_pages)
+{
+	if (page == NULL)
+		return;
+
+	if (num_pages == 1)
+		pcp_free(page, false);
+	else
+		buddy_free(page, num_pages);
+}
 
 void free_pages(void* page_addr, size_t num_pages)
 {
-	bmap_free(page_addr, num_pages);
+	if (page_addr == NULL)
+		return;
+
+	free_frames(phys_to_page(page_addr), num_pages);
+}
+
+
+void free_page_cold(void* page_addr)
+{
+	if (page_addr == NULL)
+		return;
+
+	pcp_free(phys_to_page(page_addr), true);
 }
 
 
 
 /* Helper Functions */
 
+/**
+ * Allocates contiguous pages from a zone, going through the per-CPU lists for single pages.
+ * 
+ * With PA_ZERO, single pages are taken from the zone's pool of zeroed pages first,
+ * and the pages are only zeroed here if the pool is empty.
+ * 
+ * @param zone_id the zone to allocate from
+ * @param num_pages the number of contiguous pages
+ * @param flags the allocation flags
+ * 
+ * @return the first page or NULL if the zone is out of memory
+*/
+static page_t* zone_alloc(unsigned int zone_id, size_t num_pages, unsigned char flags)
+{
+	page_t* page;
+
+	if (num_pages == 1 && (flags & PA_ZERO)) {
+		page = zpool_alloc(zone_id);
+		if (page != NULL)
+			return page;
+	}
+
+	if (num_pages == 1)
+		page = pcp_alloc(zone_id, flags & PA_COLD);
+	else
+		page = buddy_alloc(zone_id, num_pages);
+
+	if (page != NULL && (flags & PA_ZERO))
+		for (size_t i = 0; i < num_pages; i++)
+			zero_frame(page + i);
+
+	return page;
+}
+
 
-static uintptr_t mem_map_init(uintptr_t mem_start, uintptr_t mem_end)
+/**
+ * Creates the page_t arrays of the memory sections that have available memory,
+ * right after the kernel image.
+ * 
+ * @param mbi the multiboot info struct
+ * @param mem_start the address where the arrays are placed
+ * @param mem_end the end of memory
+ * 
+ * @return the address after the arrays
+*/
+static uintptr_t sparse_init(multiboot_info_t* mbi, uintptr_t mem_start, phys_addr_t mem_end)
 {
+	/* Memory past the last section can't be described */
+	max_pfn = MIN(mem_end / PAGE_SIZE, (phys_addr_t) NUM_SECTIONS * PAGES_PER_SECTION);
 	mem_start = ALIGN_UP(mem_start, sizeof(page_t));
-	mem_map = (page_t*) P2V(mem_start);
-	mem_map_length = MIN(mem_end / PAGE_SIZE, MEM_MAP_MAX_LENGTH);
 
-	for (size_t i = 0; i < mem_map_length; i++)
-		mem_map[i] = (page_t) {0};
+	for (unsigned long nr = 0; nr < DIV_CEIL(max_pfn, PAGES_PER_SECTION); nr++)
+	{
+		if (!section_has_mem(mbi, nr))
+			continue;
+
+		unsigned long start_pfn = nr * PAGES_PER_SECTION;
+		unsigned long num_pages = MIN(max_pfn - start_pfn, PAGES_PER_SECTION);
+
+		if (mem_start + num_pages * sizeof(page_t) > HIGH_MEM_START) {
+			PANIC("Not enough low memory for the page_t arrays");
+		}
+
+		page_t* map = (page_t*) P2V(mem_start);
+		mem_start += num_pages * sizeof(page_t);
+
+		for (unsigned long i = 0; i < num_pages; i++)
+			map[i] = (page_t) { .flags = nr << PG_SECTION_SHIFT };
 
-	return mem_start + mem_map_length * sizeof(page_t);
+		mem_section[nr] = map - start_pfn;
+	}
+
+	return mem_start;
+}
+
+/**
+ * Returns true if any available memory is in a memory section.
+ * 
+ * @param mbi the multiboot info struct
+ * @param section_nr the section number
+ * 
+ * @return true if the section has available memory, false otherwise
+*/
+static bool section_has_mem(multiboot_info_t* mbi, unsigned long section_nr)
+{
+	uint64_t section_start = (uint64_t) section_nr * SECTION_SIZE;
+	uint64_t section_end = section_start + SECTION_SIZE;
+
+	for (unsigned int i = 0; i < mbi->mmap_length; i += sizeof(multiboot_memory_map_t)) {
+        multiboot_memory_map_t* mmm = (multiboot_memory_map_t*) P2V(mbi->mmap_addr + i);
+
+		if (mmm->type == MULTIBOOT_MEMORY_AVAILABLE && MMM_START(mmm) < section_end && MMM_END(mmm) > section_start)
+			return true;
+	}
+
+	return false;
 }
 
 /**
@@ -117,9 +286,9 @@ static uintptr_t mem_map_init(uintptr_t mem_start, uintptr_t mem_end)
  * 
  * @param mbi the multiboot info struct
  * 
- * @return the end of memory address
+ * @return the end of memory address, which is capped at 4GB unless PAE is enabled
 */
-static uintptr_t detect_mem_end(multiboot_info_t* mbi)
+static phys_addr_t detect_mem_end(multiboot_info_t* mbi)
 {
 	multiboot_memory_map_t* last_available_mmm = NULL;
 
@@ -134,10 +303,14 @@ static uintptr_t detect_mem_end(multiboot_info_t* mbi)
 		PANIC("No usable memory found in multiboot memory map");
 	}
 
+#ifdef CONFIG_X86_PAE
+	return ALIGN_DOWN(MMM_END(last_available_mmm), PAGE_SIZE);
+#else
 	if (mmm_exceeds_max_mem(last_available_mmm))
 		return 0xFFFFFFFF;
 
 	return last_available_mmm->addr_low + last_available_mmm->len_low;
+#endif
 }
 
 
@@ -146,8 +319,9 @@ static uintptr_t detect_mem_end(multiboot_info_t* mbi)
  * 
  * @param mbi the multiboot info struct
  * @param mem_start the starting address of available memory
+ * @param mem_end the end address of the bitmap
 */
-static void detect_mem_holes(multiboot_info_t* mbi, uintptr_t mem_start)
+static void detect_mem_holes(multiboot_info_t* mbi, uintptr_t mem_start, uintptr_t mem_end)
 {
 	uintptr_t curr_addr = mem_start;
 
@@ -157,16 +331,26 @@ static void detect_mem_holes(multiboot_info_t* mbi, uintptr_t mem_start)
 		if (mmm->type == MULTIBOOT_MEMORY_AVAILABLE)
 		{
 			/* Ignore memory above 4GB */
-			if (mmm_exceeds_max_mem(mmm))
+			if (mmm->addr_high > 0)
 				break;
 
 			if (mmm->addr_low > curr_addr)
 				bmap_exclude(curr_addr, mmm->addr_low);
 
+			/* The rest of the bitmap is available */
+			if (mmm_exceeds_max_mem(mmm)) {
+				curr_addr = mem_end;
+				break;
+			}
+
 			if (mmm->addr_low + mmm->len_low > curr_addr)
 				curr_addr = mmm->addr_low + mmm->len_low;
 		}
 	}
+
+	/* Exclude the hole between the last available memory below 4GB and the end of the bitmap */
+	if (curr_addr < mem_end)
+		bmap_exclude(curr_addr, mem_end);
 }
 
 
@@ -181,3 +365,28 @@ static bool mmm_exceeds_max_mem(multiboot_memory_map_t* mmm)
 {
 	return mmm->addr_high > 0 || mmm->len_high > 0 || UNSIGNED_SUM_OVERFLOWS(mmm->addr_low, mmm->len_low);
 }
+
+
+#ifdef CONFIG_X86_PAE
+/**
+ * Gives the available memory above 4GB, which isn't tracked by the bitmap,
+ * to the buddy allocator.
+ * 
+ * @param mbi the multiboot info struct
+*/
+static void add_mem_above_4gb(multiboot_info_t* mbi)
+{
+	for (unsigned int i = 0; i < mbi->mmap_length; i += sizeof(multiboot_memory_map_t)) {
+        multiboot_memory_map_t* mmm = (multiboot_memory_map_t*) P2V(mbi->mmap_addr + i);
+
+		if (mmm->type != MULTIBOOT_MEMORY_AVAILABLE || !mmm_exceeds_max_mem(mmm))
+			continue;
+
+		phys_addr_t start = MAX(ALIGN_UP(MMM_START(mmm), PAGE_SIZE), 0x100000000ULL);
+		phys_addr_t end = ALIGN_DOWN(MMM_END(mmm), PAGE_SIZE);
+
+		if (start < end)
+			buddy_add_free_range(start, (end - start) / PAGE_SIZE);
+	}
+}
+#endif
@@ -0,0 +1,350 @@
+/**
+ * Code for the per-CPU page lists.
+ * 
+ * Each CPU keeps a small number of free single pages per zone in front of the
+ * buddy allocator, so most order-0 allocations and frees don't touch the zone's
+ * free lists. Recently freed pages are kept in a LIFO hot list, as they are likely
+ * to still be in the CPU's cache, while pages that will only be touched by devices
+ * (e.g. DMA buffers) are kept in a FIFO cold list.
+ * 
+ * The lists are refilled from and drained to the buddy allocator in batches,
+ * according to the low and high watermarks.
+ * 
+ * Each list has a lock, which is almost only ever taken by its own CPU, other
+ * CPUs only take it to drain the list or change its watermarks.
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/mm/mm.h>
+#include <kernel/ds/list.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/sched/preempt.h>
+#include <kernel/smp.h>
+#include <kernel/system.h>
+
+/* Must be defined: PAGE_SIZE */
+#ifdef __i386__
+#include <kernel/arch/i386/paging.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+
+#define PCP_BATCH			16
+#define PCP_HIGH			(6 * PCP_BATCH)
+#define PCP_LOW				0
+
+
+typedef struct per_cpu_pages_s {
+	spinlock_t lock;
+	list_t hot;				/* LIFO list of cache-warm pages */
+	list_t cold;			/* FIFO list of pages for which cache warmth doesn't matter */
+	unsigned int count;		/* The number of pages in both lists */
+
+	unsigned int low;		/* Refill when count drops to low */
+	unsigned int high;		/* Drain when count reaches high */
+	unsigned int batch;		/* The number of pages moved on each refill or drain */
+
+	struct {
+		unsigned long alloc_hits;
+		unsigned long alloc_misses;
+		unsigned long frees;
+		unsigned long refills;
+		unsigned long drains;
+	} stats;
+} per_cpu_pages_t;
+
+static per_cpu_pages_t pcps[MAX_CPUS][NUM_ZONES];
+
+
+extern page_t* buddy_alloc(unsigned int zone_id, size_t num_pages);
+extern void buddy_free(page_t* page, size_t num_pages);
+
+
+void pcp_init(void);
+page_t* pcp_alloc(unsigned int zone_id, bool cold);
+void pcp_free(page_t* page, bool cold);
+void pcp_drain_all(void);
+void pcp_set_watermarks(unsigned int low, unsigned int high, unsigned int batch);
+void pcp_print(void);
+
+static void pcp_refill(per_cpu_pages_t* pcp, unsigned int zone_id, bool cold);
+static void pcp_drain(per_cpu_pages_t* pcp, unsigned int num_pages);
+static void pcp_add(per_cpu_pages_t* pcp, page_t* page, bool cold);
+static page_t* pcp_remove(per_cpu_pages_t* pcp, bool cold);
+
+
+/* Global Functions */
+
+/**
+ * Initializes the per-CPU page lists of every CPU.
+*/
+void pcp_init(void)
+{
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		for (unsigned int zone_id = 0; zone_id < NUM_ZONES; zone_id++)
+		{
+			per_cpu_pages_t* pcp = &pcps[cpu][zone_id];
+
+			spin_lock_init(&pcp->lock, "pcp");
+			LIST_INIT(pcp->hot);
+			LIST_INIT(pcp->cold);
+			pcp->count = 0;
+
+			pcp->low = PCP_LOW;
+			pcp->high = PCP_HIGH;
+			pcp->batch = PCP_BATCH;
+		}
+	}
+}
+
+
+/**
+ * Allocates a single page from the current CPU's lists, refilling them if needed.
+ * 
+ * @param zone_id the zone to allocate from
+ * @param cold true to prefer a page from the cold list
+ * 
+ * @return the page or NULL if the zone has no free pages
+*/
+page_t* pcp_alloc(unsigned int zone_id, bool cold)
+{
+	/* Stay on this CPU until its list is locked */
+	preempt_disable();
+
+	per_cpu_pages_t* pcp = &pcps[smp_cpu_id()][zone_id];
+	spin_lock(&pcp->lock);
+
+	if (pcp->count <= pcp->low) {
+		pcp_refill(pcp, zone_id, cold);
+		pcp->stats.alloc_misses++;
+	}
+	else
+		pcp->stats.alloc_hits++;
+
+	page_t* page = pcp_remove(pcp, cold);
+
+	spin_unlock(&pcp->lock);
+	preempt_enable();
+
+	return page;
+}
+
+/**
+ * Frees a single page to the current CPU's lists, draining them if they're full.
+ * 
+ * @param page the page
+ * @param cold true if the page's contents aren't in the CPU's cache
+*/
+void pcp_free(page_t* page, bool cold)
+{
+	unsigned int zone_id = page_to_pfn(page) >= HIGH_MEM_PFN ? ZONE_HIGHMEM : ZONE_NORMAL;
+
+	preempt_disable();
+
+	per_cpu_pages_t* pcp = &pcps[smp_cpu_id()][zone_id];
+	spin_lock(&pcp->lock);
+
+	pcp_add(pcp, page, cold);
+	pcp->stats.frees++;
+
+	if (pcp->count >= pcp->high)
+		pcp_drain(pcp, pcp->batch);
+
+	spin_unlock(&pcp->lock);
+	preempt_enable();
+}
+
+/**
+ * Gives every page in the per-CPU lists back to the buddy allocator.
+ * 
+ * Used when the buddy allocator runs out of memory.
+*/
+void pcp_drain_all(void)
+{
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		for (unsigned int zone_id = 0; zone_id < NUM_ZONES; zone_id++)
+		{
+			per_cpu_pages_t* pcp = &pcps[cpu][zone_id];
+
+			spin_lock(&pcp->lock);
+			pcp_drain(pcp, pcp->count);
+			spin_unlock(&pcp->lock);
+		}
+	}
+}
+
+
+/**
+ * Sets the watermarks and batch size of every per-CPU list.
+ * 
+ * @param low the count at which the lists are refilled
+ * @param high the count at which the lists are drained
+ * @param batch the number of pages moved on each refill or drain
+*/
+void pcp_set_watermarks(unsigned int low, unsigned int high, unsigned int batch)
+{
+	ASSERT(batch > 0 && low < high && batch <= high);
+
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		for (unsigned int zone_id = 0; zone_id < NUM_ZONES; zone_id++)
+		{
+			per_cpu_pages_t* pcp = &pcps[cpu][zone_id];
+
+			spin_lock(&pcp->lock);
+
+			pcp->low = low;
+			pcp->high = high;
+			pcp->batch = batch;
+
+			if (pcp->count >= high)
+				pcp_drain(pcp, pcp->count - low);
+
+			spin_unlock(&pcp->lock);
+		}
+	}
+}
+
+/**
+ * Prints the counters of the per-CPU lists that have been used.
+*/
+void pcp_print(void)
+{
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		for (unsigned int zone_id = 0; zone_id < NUM_ZONES; zone_id++)
+		{
+			per_cpu_pages_t* pcp = &pcps[cpu][zone_id];
+
+			if (pcp->stats.alloc_hits + pcp->stats.alloc_misses + pcp->stats.frees == 0)
+				continue;
+
+			printf("cpu%u zone %u: %u pages, %u hits, %u misses, %u frees, %u refills, %u drains\n",
+				cpu, zone_id, pcp->count, pcp->stats.alloc_hits, pcp->stats.alloc_misses,
+				pcp->stats.frees, pcp->stats.refills, pcp->stats.drains);
+		}
+	}
+}
+
+
+/* Helper Functions */
+
+/**
+ * Refills a per-CPU list with a batch of pages from the buddy allocator.
+ * 
+ * The batch is taken as a single block when possible, falling back to single
+ * pages if the zone is too fragmented.
+ * 
+ * @param pcp the per-CPU lists
+ * @param zone_id the zone the lists belong to
+ * @param cold true to refill the cold list, false for the hot one
+*/
+static void pcp_refill(per_cpu_pages_t* pcp, unsigned int zone_id, bool cold)
+{
+	pcp->stats.refills++;
+
+	page_t* block = buddy_alloc(zone_id, pcp->batch);
+
+	if (block != NULL) {
+		for (unsigned int i = 0; i < pcp->batch; i++)
+			pcp_add(pcp, block + i, cold);
+		return;
+	}
+
+	for (unsigned int i = 0; i < pcp->batch; i++)
+	{
+		page_t* page = buddy_alloc(zone_id, 1);
+		if (page == NULL)
+			break;
+
+		pcp_add(pcp, page, cold);
+	}
+}
+
+/**
+ * Gives pages from a per-CPU list back to the buddy allocator.
+ * 
+ * Cold pages are given back first, followed by the least recently freed hot pages.
+ * 
+ * @param pcp the per-CPU lists
+ * @param num_pages the number of pages to give back
+*/
+static void pcp_drain(per_cpu_pages_t* pcp, unsigned int num_pages)
+{
+	if (num_pages == 0)
+		return;
+
+	pcp->stats.drains++;
+
+	for (unsigned int i = 0; i < num_pages; i++)
+	{
+		list_t* entry = list_remove_first(&pcp->cold);
+
+		if (entry == NULL && !LIST_IS_EMPTY(pcp->hot)) {
+			entry = pcp->hot.prev;
+			list_del(entry);
+		}
+
+		if (entry == NULL)
+			break;
+
+		pcp->count--;
+		buddy_free((page_t*) entry, 1);
+	}
+}
+
+
+/**
+ * Adds a page to a per-CPU list.
+ * 
+ * @param pcp the per-CPU lists
+ * @param page the page to add
+ * @param cold true to add the page to the tail of the cold list, false for the
+ * head of the hot one
+*/
+static void pcp_add(per_cpu_pages_t* pcp, page_t* page, bool cold)
+{
+	if (cold)
+		list_add_last(&pcp->cold, &page->list);
+	else
+		list_add_first(&pcp->hot, &page->list);
+
+	pcp->count++;
+}
+
+/**
+ * Removes a page from a per-CPU list, falling back to the other list if it's empty.
+ * 
+ * @param pcp the per-CPU lists
+ * @param cold true to prefer the cold list
+ * 
+ * @return the removed page or NULL if both lists are empty
+*/
+static page_t* pcp_remove(per_cpu_pages_t* pcp, bool cold)
+{
+	list_t* entry;
+
+	if (cold) {
+		entry = list_remove_first(&pcp->cold);
+		if (entry == NULL)
+			entry = list_remove_first(&pcp->hot);
+	}
+	else {
+		entry = list_remove_first(&pcp->hot);
+		if (entry == NULL)
+			entry = list_remove_first(&pcp->cold);
+	}
+
+	if (entry == NULL)
+		return NULL;
+
+	pcp->count--;
+	return (page_t*) entry;
+}
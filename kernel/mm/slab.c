@@ -1,6 +1,18 @@
 /**
  * Code for the slab allocator.
  * 
+ * Each CPU keeps a loaded and a previous magazine of object pointers per cache,
+ * in front of the slab lists, and exchanges full and empty magazines with the
+ * cache's depot. Most allocations and frees are then a pointer pop or push.
+ * 
+ * The magazines only need preemption disabled, as they belong to the CPU, while
+ * the depot and the slab lists are protected by the cache's lock. The lock is
+ * dropped whenever pages are allocated or freed, as the page allocator reaps the
+ * caches when it runs out of memory.
+ * 
+ * Refer to:
+ * https://www.usenix.org/legacy/event/usenix01/full_papers/bonwick/bonwick.pdf
+ * 
  * @author Samuel Pires
 */
 
@@ -9,6 +21,9 @@
 #include <kernel/utils.h>
 #include <kernel/mm/slab.h>
 #include <kernel/mm/mm.h>
+#include <kernel/sched/preempt.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/smp.h>
 
 /* Must be defined: PAGE_SIZE */
 #ifdef __i386__
@@ -17,6 +32,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
 
 
 #define CACHE_NAMELEN 			20
@@ -31,21 +47,75 @@
 
 #define SIZE_OF_SLAB_T(cache) 	(sizeof(slab_t) + ((kmem_cache_t*) (cache))->objs_per_slab * sizeof(kmem_bufctl_t))
 
+/* The number of free slabs a cache keeps by default instead of giving them back */
+#define DEFAULT_FREE_SLABS_LIMIT	2
+
+#define MAGAZINE_INITIAL_SIZE	4
+#define MAGAZINE_MAX_SIZE		32
+
+/* The depot is contended if more than 1 in MAGAZINE_CONTENTION_RATIO magazine operations go to it */
+#define MAGAZINE_CONTENTION_RATIO	8
+#define MAGAZINE_RESIZE_INTERVAL	1024
+
+
+typedef struct magazine_s {
+	list_t list;
+	unsigned int rounds;
+	void* objs[MAGAZINE_MAX_SIZE];
+} magazine_t;
+
+typedef struct kmem_cpu_cache_s {
+	magazine_t* loaded;
+	magazine_t* previous;		/* Either full or empty */
+	bool active;				/* The magazines were used since the last idle reap */
+} kmem_cpu_cache_t;
+
 
 typedef struct kmem_cache_s {
 	list_t list;
+	spinlock_t lock;				/* Protects the slab lists, the depot and their counters */
+
 	list_t slabs_full;
 	list_t slabs_partial;
 	list_t slabs_free;
 
-	unsigned int obj_size;
+	unsigned int num_free_slabs;
+	unsigned int free_slabs_limit;	/* Free slabs kept before they're given back */
+	bool active;					/* The slabs or the depot were used since the last idle reap */
+
+	unsigned int obj_size;			/* The size of the objects, rounded up to the alignment */
 	unsigned int objs_per_slab;
 	unsigned int pages_per_slab;
 
+	unsigned int align;
+	unsigned int flags;
+
+	/* Slabs start their objects at different offsets so they don't all compete for the same cache sets */
+	unsigned int color_off;			/* The offset between colors */
+	unsigned int num_colors;
+	unsigned int color_next;		/* The color of the next slab */
+
 	char name[CACHE_NAMELEN];
 
 	void (*constructor)(void*, size_t);
 	void (*destructor)(void*, size_t);
+
+	kmem_cpu_cache_t cpu_caches[MAX_CPUS];
+
+	/* Magazines that aren't loaded in any CPU */
+	list_t depot_full;
+	list_t depot_empty;
+
+	unsigned int magazine_size;		/* 0 if the cache doesn't use magazines */
+
+	/* Updated by every CPU without the lock, they only drive the resize heuristic */
+	unsigned int magazine_ops;		/* Magazine operations since the last resize check */
+	unsigned int depot_ops;			/* Depot operations since the last resize check */
+
+	struct {
+		unsigned long grows;		/* Slabs allocated */
+		unsigned long reaps;		/* Slabs given back */
+	} stats;
 } kmem_cache_t;
 
 typedef unsigned int kmem_bufctl_t;
@@ -59,22 +129,54 @@ typedef struct slab_s {
 
 
 static kmem_cache_t cache_cache;
+static kmem_cache_t magazine_cache;
 
 static list_t cache_list;
+static rwlock_t cache_list_lock;
 
-static size_t general_cache_sizes[] = {16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536, 131072};
+/*
+ * Small sizes are spaced at most 50% apart, so less is wasted than with powers of 2.
+ * Large sizes are powers of 2, as the slabs are several pages long anyway.
+*/
+static size_t general_cache_sizes[] = {
+	8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+	2048, 4096, 8192, 16384, 32768, 65536, 131072
+};
 
 #define NUM_GENERAL_CACHES  (sizeof(general_cache_sizes) / sizeof(general_cache_sizes[0]))
 
+#define SMALL_SIZE_ORDER	10
+#define SMALL_SIZE_MAX		(1 << SMALL_SIZE_ORDER)		/* The largest size looked up in size_index */
+#define NUM_SMALL_CACHES	14							/* The number of general caches up to SMALL_SIZE_MAX */
+
+#define SIZE_INDEX(size)	(((size) + 7) >> 3)
+
 static kmem_cache_t* general_caches[NUM_GENERAL_CACHES];
 
+/* The index of the general cache for each small size, in 8 byte steps */
+static uint8_t size_index[SIZE_INDEX(SMALL_SIZE_MAX) + 1];
+
 
 static void kmem_cache_grow(struct kmem_cache_s* cache);
 static void kmem_cache_reap(struct kmem_cache_s* cache);
 
-static void init_cache(kmem_cache_t* cache, const char* name, size_t obj_size, void (*constructor)(void*, size_t), void (*destructor)(void*, size_t));
+static void* slab_alloc_obj(kmem_cache_t* cache);
+static void slab_free_obj(kmem_cache_t* cache, void* ptr);
+static void slab_trim(kmem_cache_t* cache, list_t* slabs);
+static void slab_free_run(kmem_cache_t* cache, slab_t* slab, void** objs, size_t num_objs);
+
+static void* magazine_alloc_obj(kmem_cache_t* cache);
+static bool magazine_free_obj(kmem_cache_t* cache, void* ptr);
+static magazine_t* depot_get(kmem_cache_t* cache, list_t* depot);
+static void depot_put(kmem_cache_t* cache, list_t* depot, magazine_t* magazine);
+static void magazine_unload(kmem_cache_t* cache, magazine_t* magazine);
+static void magazine_free_list(list_t* magazines);
+static void magazine_resize_check(kmem_cache_t* cache);
+
+static void init_cache(kmem_cache_t* cache, const char* name, size_t obj_size, size_t align, unsigned int flags, void (*constructor)(void*, size_t), void (*destructor)(void*, size_t));
 static slab_t* slab_get(kmem_cache_t* cache);
 static void slab_destroy(kmem_cache_t* cache, slab_t* slab);
+static void slab_destroy_list(kmem_cache_t* cache, list_t* slabs);
 static kmem_cache_t* general_cache(size_t size);
 
 
@@ -95,31 +197,61 @@ void* kmem_alloc(size_t size)
 
 void kmem_free(void* ptr)
 {
+	if (ptr == NULL)
+		return;
+
 	kmem_cache_free(virt_to_page(ptr)->cache, ptr);
 }
 
+size_t kmem_size(void* ptr)
+{
+	return ((kmem_cache_t*) virt_to_page(ptr)->cache)->obj_size;
+}
+
 
 /* Cache Functions */
 
 void kmem_cache_init(void)
 {
 	LIST_INIT(cache_list);
+	rwlock_init(&cache_list_lock, "cache_list");
 
-	init_cache(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), NULL, NULL);
+	/* These caches don't use magazines, as they're needed to create them */
+	init_cache(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), 0, SLAB_NO_MAGAZINES, NULL, NULL);
 	list_add_last(&cache_list, &cache_cache.list);
+
+	init_cache(&magazine_cache, "kmem_magazine", sizeof(magazine_t), 0, SLAB_NO_MAGAZINES, NULL, NULL);
+	list_add_last(&cache_list, &magazine_cache.list);
 	
 	/* Initialize general caches */
 	for (unsigned int i = 0; i < NUM_GENERAL_CACHES; i++)
-		general_caches[i] = kmem_cache_create("kmem_cache", general_cache_sizes[i], NULL, NULL);
+		general_caches[i] = kmem_cache_create("kmem_cache", general_cache_sizes[i], 0, 0, NULL, NULL);
+
+	ASSERT(general_cache_sizes[NUM_SMALL_CACHES - 1] == SMALL_SIZE_MAX);
+
+	/* Precompute the general cache of each small size */
+	unsigned int cache_index = 0;
+	for (unsigned int i = 0; i <= SIZE_INDEX(SMALL_SIZE_MAX); i++)
+	{
+		while (general_cache_sizes[cache_index] < i * 8)
+			cache_index++;
+
+		size_index[i] = cache_index;
+	}
 }
 
 
-struct kmem_cache_s* kmem_cache_create(const char* name, size_t obj_size, void (*constructor)(void*, size_t), void (*destructor)(void*, size_t))
+struct kmem_cache_s* kmem_cache_create(const char* name, size_t obj_size, size_t align, unsigned int flags, void (*constructor)(void*, size_t), void (*destructor)(void*, size_t))
 {
+	ASSERT(align == 0 || (IS_POWER_OF_2(align) && align <= PAGE_SIZE));
+
 	kmem_cache_t* cache = kmem_cache_alloc(&cache_cache);
 
-	init_cache(cache, name, obj_size, constructor, destructor);
+	init_cache(cache, name, obj_size, align, flags, constructor, destructor);
+
+	write_lock(&cache_list_lock);
 	list_add_last(&cache_list, &cache->list);
+	write_unlock(&cache_list_lock);
 	
 	return cache;
 }
@@ -127,21 +259,32 @@ struct kmem_cache_s* kmem_cache_create(const char* name, size_t obj_size, void (
 /**
  * Grows a cache by allocating a new slab for it.
  * 
+ * Called with the cache's lock held, which is dropped while the slab is allocated
+ * and initialized.
+ * 
  * @param cache the cache to grow
 */
 static void kmem_cache_grow(struct kmem_cache_s* cache)
 {
+	/* Offset the objects by the slab's color */
+	unsigned int color = cache->color_next;
+
+	if (++cache->color_next == cache->num_colors)
+		cache->color_next = 0;
+
+	spin_unlock(&cache->lock);
+
 	slab_t* slab;
 	size_t slab_size = cache->pages_per_slab * PAGE_SIZE;
-	unsigned char* temp = alloc_pages(cache->pages_per_slab, PA_KERNEL);
-	unsigned char* s_mem = P2V(temp);
+	unsigned char* temp = alloc_pages(cache->pages_per_slab, cache->flags & SLAB_ZERO ? PA_ZERO : PA_KERNEL);
+	unsigned char* slab_mem = P2V(temp);
 
 	if (OFF_SLAB(cache))
 		slab = kmem_alloc(SIZE_OF_SLAB_T(cache));
 	else
-		slab = (slab_t*) (s_mem + slab_size - SIZE_OF_SLAB_T(cache));
+		slab = (slab_t*) (slab_mem + slab_size - SIZE_OF_SLAB_T(cache));
 
-	slab->s_mem = s_mem;
+	slab->s_mem = slab_mem + color * cache->color_off;
 	slab->num_free = cache->objs_per_slab;
 
 	/* Initialize the objects and the free array */
@@ -153,34 +296,288 @@ static void kmem_cache_grow(struct kmem_cache_s* cache)
 			cache->constructor(((unsigned char*) (slab->s_mem)) + i * cache->obj_size, cache->obj_size);
 	}
 
-	list_add_last(&(cache->slabs_free), &slab->list);
-
 	/* Save cache and slab in corresponding pages */
-	page_t* page = virt_to_page(s_mem);
+	page_t* page = virt_to_page(slab_mem);
 	for (unsigned int i = 0; i < cache->pages_per_slab; i++) {
 		page->cache = cache;
 		page->slab = slab;
 		page++;
 	}
+
+	spin_lock(&cache->lock);
+
+	list_add_last(&(cache->slabs_free), &slab->list);
+	cache->num_free_slabs++;
+	cache->stats.grows++;
 }
 
 /**
- * Frees all free slabs from a cache.
+ * Gives the objects in a cache's depot back to their slabs and frees all of its
+ * free slabs.
  * 
  * @param cache the cache to free all free slabs from
 */
 static void kmem_cache_reap(struct kmem_cache_s* cache)
 {
-	void slab_destroy_fe(list_t* entry) {
-		ASSERT(list_remove(&cache->slabs_free, entry));
-		slab_destroy(cache, (slab_t*) entry);
-	}
+	list_t magazines, slabs;
+	magazine_t* magazine;
+
+	LIST_INIT(magazines);
+	LIST_INIT(slabs);
+
+	spin_lock(&cache->lock);
+
+	list_splice_last(&magazines, &cache->depot_full);
+	list_splice_last(&magazines, &cache->depot_empty);
+
+	LIST_FOR_EACH_ENTRY(magazine, &magazines, list)
+		magazine_unload(cache, magazine);
 
-	list_for_each(&cache->slabs_free, slab_destroy_fe);
+	cache->stats.reaps += cache->num_free_slabs;
+	cache->num_free_slabs = 0;
+	list_splice_last(&slabs, &cache->slabs_free);
+
+	spin_unlock(&cache->lock);
+
+	magazine_free_list(&magazines);
+	slab_destroy_list(cache, &slabs);
 }
 
 
 void* kmem_cache_alloc(struct kmem_cache_s* cache)
+{
+	void* obj = NULL;
+
+	/* The magazines belong to the CPU, so the thread can't move while using them */
+	if (cache->magazine_size > 0) {
+		preempt_disable();
+		obj = magazine_alloc_obj(cache);
+		preempt_enable();
+	}
+
+	if (obj == NULL) {
+		spin_lock(&cache->lock);
+		obj = slab_alloc_obj(cache);
+		spin_unlock(&cache->lock);
+	}
+
+	return obj;
+}
+
+
+void kmem_cache_free(kmem_cache_t* cache, void* ptr)
+{
+	bool freed = false;
+
+	if (cache->magazine_size > 0) {
+		preempt_disable();
+		freed = magazine_free_obj(cache, ptr);
+		preempt_enable();
+	}
+
+	if (!freed) {
+		list_t slabs;
+		LIST_INIT(slabs);
+
+		spin_lock(&cache->lock);
+		slab_free_obj(cache, ptr);
+		slab_trim(cache, &slabs);
+		spin_unlock(&cache->lock);
+
+		slab_destroy_list(cache, &slabs);
+	}
+}
+
+
+size_t kmem_cache_alloc_bulk(struct kmem_cache_s* cache, size_t num_objs, void** objs)
+{
+	size_t num_allocated = 0;
+
+	spin_lock(&cache->lock);
+
+	while (num_allocated < num_objs)
+	{
+		slab_t* slab = slab_get(cache);
+
+		if (slab == NULL) {
+			spin_unlock(&cache->lock);
+			kmem_cache_free_bulk(cache, num_allocated, objs);
+			return 0;
+		}
+
+		bool was_free = slab->num_free == cache->objs_per_slab;
+		size_t n = MIN(num_objs - num_allocated, (size_t) slab->num_free);
+
+		for (size_t i = 0; i < n; i++)
+			objs[num_allocated++] = ((unsigned char*) slab->s_mem) + slab->free[--slab->num_free] * cache->obj_size;
+
+		/* Move the slab once for the whole batch */
+		if (was_free)
+			cache->num_free_slabs--;
+
+		if (slab->num_free == 0) {
+			list_del(&slab->list);
+			list_add_last(&cache->slabs_full, &slab->list);
+		}
+		else if (was_free) {
+			list_del(&slab->list);
+			list_add_last(&cache->slabs_partial, &slab->list);
+		}
+	}
+
+	cache->active = true;
+	spin_unlock(&cache->lock);
+
+	return num_allocated;
+}
+
+void kmem_cache_free_bulk(struct kmem_cache_s* cache, size_t num_objs, void** objs)
+{
+	size_t run_start = 0;
+	list_t slabs;
+
+	LIST_INIT(slabs);
+
+	spin_lock(&cache->lock);
+
+	/* Free runs of objects that belong to the same slab together */
+	for (size_t i = 1; i <= num_objs; i++)
+	{
+		slab_t* slab = virt_to_page(objs[run_start])->slab;
+
+		if (i < num_objs && virt_to_page(objs[i])->slab == slab)
+			continue;
+
+		slab_free_run(cache, slab, objs + run_start, i - run_start);
+		run_start = i;
+	}
+
+	slab_trim(cache, &slabs);
+	spin_unlock(&cache->lock);
+
+	slab_destroy_list(cache, &slabs);
+}
+
+
+void kmem_cache_destroy(struct kmem_cache_s* cache)
+{
+	list_t magazines, slabs;
+	magazine_t* magazine;
+
+	LIST_INIT(magazines);
+	LIST_INIT(slabs);
+
+	spin_lock(&cache->lock);
+
+	/* Give the objects in the magazines back to their slabs */
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		kmem_cpu_cache_t* cpu_cache = &cache->cpu_caches[cpu];
+
+		if (cpu_cache->loaded != NULL)
+			list_add_last(&magazines, &cpu_cache->loaded->list);
+		if (cpu_cache->previous != NULL)
+			list_add_last(&magazines, &cpu_cache->previous->list);
+
+		cpu_cache->loaded = cpu_cache->previous = NULL;
+	}
+	list_splice_last(&magazines, &cache->depot_full);
+	list_splice_last(&magazines, &cache->depot_empty);
+
+	LIST_FOR_EACH_ENTRY(magazine, &magazines, list)
+		magazine_unload(cache, magazine);
+
+	list_splice_last(&slabs, &cache->slabs_full);
+	list_splice_last(&slabs, &cache->slabs_partial);
+	list_splice_last(&slabs, &cache->slabs_free);
+	cache->num_free_slabs = 0;
+
+	spin_unlock(&cache->lock);
+
+	magazine_free_list(&magazines);
+	slab_destroy_list(cache, &slabs);
+}
+
+
+void kmem_cache_set_free_limit(struct kmem_cache_s* cache, unsigned int free_slabs_limit)
+{
+	list_t slabs;
+	LIST_INIT(slabs);
+
+	spin_lock(&cache->lock);
+	cache->free_slabs_limit = free_slabs_limit;
+	slab_trim(cache, &slabs);
+	spin_unlock(&cache->lock);
+
+	slab_destroy_list(cache, &slabs);
+}
+
+
+void kmem_reap(void)
+{
+	kmem_cache_t* cache;
+
+	/* A read lock, as freeing the slabs may run out of memory and reap again */
+	read_lock(&cache_list_lock);
+
+	LIST_FOR_EACH_ENTRY(cache, &cache_list, list)
+		kmem_cache_reap(cache);
+
+	read_unlock(&cache_list_lock);
+}
+
+
+void kmem_reap_idle(void)
+{
+	kmem_cache_t* cache;
+
+	read_lock(&cache_list_lock);
+
+	/* The active flags are only hints, so they're checked without the cache's lock */
+	LIST_FOR_EACH_ENTRY(cache, &cache_list, list)
+	{
+		bool active = cache->active;
+		cache->active = false;
+
+		for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+			active |= cache->cpu_caches[cpu].active;
+			cache->cpu_caches[cpu].active = false;
+		}
+
+		if (!active)
+			kmem_cache_reap(cache);
+	}
+
+	read_unlock(&cache_list_lock);
+}
+
+
+void kmem_cache_print(void)
+{
+	kmem_cache_t* cache;
+
+	read_lock(&cache_list_lock);
+
+	LIST_FOR_EACH_ENTRY(cache, &cache_list, list) {
+		printf("%s (%u): %u grows, %u reaps, %u free slabs\n", cache->name, cache->obj_size,
+			cache->stats.grows, cache->stats.reaps, cache->num_free_slabs);
+	}
+
+	read_unlock(&cache_list_lock);
+}
+
+
+/* Helper Functions */
+
+
+/**
+ * Allocates an object from the slabs of a cache, with the cache's lock held.
+ * 
+ * @param cache the cache to allocate the object from
+ * 
+ * @return the object or NULL if the cache wasn't able to grow
+*/
+static void* slab_alloc_obj(kmem_cache_t* cache)
 {
 	slab_t* slab = slab_get(cache);
 
@@ -188,24 +585,34 @@ void* kmem_cache_alloc(struct kmem_cache_s* cache)
 		return NULL;
 
 	void* buf = ((unsigned char*) slab->s_mem) + slab->free[--slab->num_free] * cache->obj_size;
+	cache->active = true;
 
 	/* If the slab was free, move it to partial list */
 	if (slab->num_free == cache->objs_per_slab - 1) {
-		ASSERT(list_remove(&cache->slabs_free, &slab->list));
-		list_add_last(&cache->slabs_partial,  &slab->list);
+		cache->num_free_slabs--;
+		list_del(&slab->list);
+		list_add_last(&cache->slabs_partial, &slab->list);
 	}
 
 	/* If no free buffers remain, move the slab from partial list to the full list */
 	if (slab->num_free == 0) {
-		ASSERT(list_remove(&cache->slabs_partial, &slab->list));
-		list_add_last(&cache->slabs_full,  &slab->list);
+		list_del(&slab->list);
+		list_add_last(&cache->slabs_full, &slab->list);
 	}
 
 	return buf;
 }
 
 
-void kmem_cache_free(kmem_cache_t* cache, void* ptr)
+/**
+ * Frees an object to its slab, with the cache's lock held.
+ * 
+ * The slabs past the cache's free limit must then be given back with slab_trim().
+ * 
+ * @param cache the cache the object belongs to
+ * @param ptr the object
+*/
+static void slab_free_obj(kmem_cache_t* cache, void* ptr)
 {
 	slab_t* slab = virt_to_page(ptr)->slab;
 
@@ -217,38 +624,247 @@ void kmem_cache_free(kmem_cache_t* cache, void* ptr)
 
 	/* If the freed object belonged to a full list, move it to partial */
 	if (slab->num_free == 1) {
-		ASSERT(list_remove(&cache->slabs_full, &slab->list));
+		list_del(&slab->list);
 		list_add_last(&cache->slabs_partial, &slab->list);
 	}
 
-	/* If all objects are free, move slab to free list and reap the cache */
+	/* If all objects are free, move slab to free list */
 	if (slab->num_free == cache->objs_per_slab) {
-		ASSERT(list_remove(&cache->slabs_partial, &slab->list));
+		list_del(&slab->list);
 		list_add_last(&cache->slabs_free, &slab->list);
-		kmem_cache_reap(cache);
+		cache->num_free_slabs++;
 	}
 }
 
+/**
+ * Frees objects that belong to the same slab, moving the slab at most once, with
+ * the cache's lock held.
+ * 
+ * The slabs past the cache's free limit must then be given back with slab_trim().
+ * 
+ * @param cache the cache the objects belong to
+ * @param slab the slab the objects belong to
+ * @param objs the objects
+ * @param num_objs the number of objects
+*/
+static void slab_free_run(kmem_cache_t* cache, slab_t* slab, void** objs, size_t num_objs)
+{
+	bool was_full = slab->num_free == 0;
+	uintptr_t slab_start = ((uintptr_t) slab->s_mem);
+
+	for (size_t i = 0; i < num_objs; i++)
+		slab->free[(slab->num_free)++] = ((uintptr_t) objs[i] - slab_start) / cache->obj_size;
 
-void kmem_cache_destroy(struct kmem_cache_s* cache)
+	if (slab->num_free == cache->objs_per_slab) {
+		list_del(&slab->list);
+		list_add_last(&cache->slabs_free, &slab->list);
+		cache->num_free_slabs++;
+	}
+	else if (was_full) {
+		list_del(&slab->list);
+		list_add_last(&cache->slabs_partial, &slab->list);
+	}
+}
+
+/**
+ * Takes the least recently freed slabs past a cache's free limit off its lists,
+ * with the cache's lock held.
+ * 
+ * They're destroyed with slab_destroy_list() once the lock is dropped.
+ * 
+ * @param cache the cache
+ * @param slabs the list the slabs are moved to
+*/
+static void slab_trim(kmem_cache_t* cache, list_t* slabs)
+{
+	while (cache->num_free_slabs > cache->free_slabs_limit)
+	{
+		list_add_last(slabs, list_remove_first(&cache->slabs_free));
+
+		cache->num_free_slabs--;
+		cache->stats.reaps++;
+	}
+}
+
+
+/**
+ * Allocates an object from the current CPU's magazines, exchanging them with the
+ * depot if needed.
+ * 
+ * @param cache the cache to allocate the object from
+ * 
+ * @return the object or NULL if the magazines and depot are empty
+*/
+static void* magazine_alloc_obj(kmem_cache_t* cache)
 {
-	list_t* list;
+	kmem_cpu_cache_t* cpu_cache = &cache->cpu_caches[smp_cpu_id()];
+	magazine_t* loaded = cpu_cache->loaded;
+	magazine_t* previous = cpu_cache->previous;
+
+	magazine_resize_check(cache);
+
+	/* Only written when it changes, so the CPU doesn't dirty the line on every operation */
+	if (!cpu_cache->active)
+		cpu_cache->active = true;
 
-	void slab_destroy_fe(list_t* entry) {
-		ASSERT(list_remove(list, entry));
-		slab_destroy(cache, (slab_t*) entry);
+	if (loaded != NULL && loaded->rounds > 0)
+		return loaded->objs[--loaded->rounds];
+
+	/* The previous magazine is full, swap it with the empty loaded one */
+	if (previous != NULL && previous->rounds > 0) {
+		cpu_cache->loaded = previous;
+		cpu_cache->previous = loaded;
+		return previous->objs[--previous->rounds];
 	}
 
-	list = &cache->slabs_full;
-	list_for_each(list, slab_destroy_fe);
-	list = &cache->slabs_partial;
-	list_for_each(list, slab_destroy_fe);
-	list = &cache->slabs_free;
-	list_for_each(list, slab_destroy_fe);
+	/* Both are empty, exchange the previous one for a full one from the depot */
+	spin_lock(&cache->lock);
+
+	magazine_t* full = depot_get(cache, &cache->depot_full);
+	if (full != NULL && previous != NULL)
+		depot_put(cache, &cache->depot_empty, previous);
+
+	spin_unlock(&cache->lock);
+
+	if (full == NULL)
+		return NULL;
+
+	cpu_cache->previous = loaded;
+	cpu_cache->loaded = full;
+	return full->objs[--full->rounds];
 }
 
+/**
+ * Frees an object to the current CPU's magazines, exchanging them with the depot
+ * if needed.
+ * 
+ * @param cache the cache the object belongs to
+ * @param ptr the object
+ * 
+ * @return true if the object was freed, false if no empty magazine could be found
+*/
+static bool magazine_free_obj(kmem_cache_t* cache, void* ptr)
+{
+	kmem_cpu_cache_t* cpu_cache = &cache->cpu_caches[smp_cpu_id()];
+	magazine_t* loaded = cpu_cache->loaded;
+	magazine_t* previous = cpu_cache->previous;
+
+	magazine_resize_check(cache);
+
+	if (!cpu_cache->active)
+		cpu_cache->active = true;
+
+	if (loaded != NULL && loaded->rounds < cache->magazine_size) {
+		loaded->objs[loaded->rounds++] = ptr;
+		return true;
+	}
+
+	/* The previous magazine is empty, swap it with the full loaded one */
+	if (previous != NULL && previous->rounds == 0) {
+		cpu_cache->loaded = previous;
+		cpu_cache->previous = loaded;
+		previous->objs[previous->rounds++] = ptr;
+		return true;
+	}
+
+	/* Both are full, exchange the previous one for an empty one from the depot */
+	spin_lock(&cache->lock);
+	magazine_t* empty = depot_get(cache, &cache->depot_empty);
+	spin_unlock(&cache->lock);
+
+	if (empty == NULL) {
+		empty = kmem_cache_alloc(&magazine_cache);
+		if (empty == NULL)
+			return false;
+		empty->rounds = 0;
+	}
+
+	if (previous != NULL) {
+		spin_lock(&cache->lock);
+		depot_put(cache, &cache->depot_full, previous);
+		spin_unlock(&cache->lock);
+	}
+
+	cpu_cache->previous = loaded;
+	cpu_cache->loaded = empty;
+	empty->objs[empty->rounds++] = ptr;
+	return true;
+}
+
+
+/**
+ * Takes a magazine from one of the depot's lists, with the cache's lock held.
+ * 
+ * @param cache the cache the depot belongs to
+ * @param depot the depot list
+ * 
+ * @return the magazine or NULL if the list is empty
+*/
+static magazine_t* depot_get(kmem_cache_t* cache, list_t* depot)
+{
+	cache->depot_ops++;
+	cache->active = true;
+
+	return (magazine_t*) list_remove_first(depot);
+}
+
+/**
+ * Puts a magazine in one of the depot's lists, with the cache's lock held.
+ * 
+ * @param cache the cache the depot belongs to
+ * @param depot the depot list
+ * @param magazine the magazine
+*/
+static void depot_put(kmem_cache_t* cache, list_t* depot, magazine_t* magazine)
+{
+	cache->depot_ops++;
+	cache->active = true;
+
+	list_add_last(depot, &magazine->list);
+}
+
+/**
+ * Gives the objects of a magazine back to their slabs, with the cache's lock held.
+ * 
+ * @param cache the cache the magazine belongs to
+ * @param magazine the magazine
+*/
+static void magazine_unload(kmem_cache_t* cache, magazine_t* magazine)
+{
+	while (magazine->rounds > 0)
+		slab_free_obj(cache, magazine->objs[--magazine->rounds]);
+}
+
+/**
+ * Frees a list of empty magazines.
+ * 
+ * @param magazines the list of magazines
+*/
+static void magazine_free_list(list_t* magazines)
+{
+	magazine_t* magazine;
+
+	while ((magazine = (magazine_t*) list_remove_first(magazines)) != NULL)
+		kmem_cache_free(&magazine_cache, magazine);
+}
+
+/**
+ * Doubles the size of a cache's magazines if its depot is contended.
+ * 
+ * @param cache the cache
+*/
+static void magazine_resize_check(kmem_cache_t* cache)
+{
+	if (++cache->magazine_ops < MAGAZINE_RESIZE_INTERVAL)
+		return;
+
+	if (cache->depot_ops * MAGAZINE_CONTENTION_RATIO > cache->magazine_ops)
+		cache->magazine_size = MIN(cache->magazine_size * 2, MAGAZINE_MAX_SIZE);
+
+	cache->magazine_ops = 0;
+	cache->depot_ops = 0;
+}
 
-/* Helper Functions */
 
 
 /**
@@ -257,18 +873,50 @@ void kmem_cache_destroy(struct kmem_cache_s* cache)
  * @param cache the cache to be initialized
  * @param name the name of the cache
  * @param obj_size the size of the cache's objects
+ * @param align the alignment of the cache's objects, or 0 for none
+ * @param flags the cache's SLAB_* flags
  * @param constructor the constructor function for the cache's objects
  * @param destructor the destructor function for the cache's objects
 */
-static void init_cache(kmem_cache_t* cache, const char* name, size_t obj_size, void (*constructor)(void*, size_t), void (*destructor)(void*, size_t))
+static void init_cache(kmem_cache_t* cache, const char* name, size_t obj_size, size_t align, unsigned int flags, void (*constructor)(void*, size_t), void (*destructor)(void*, size_t))
 {
+	spin_lock_init(&cache->lock, cache->name);
+
 	/* Initialize slabs lists */
 	LIST_INIT(cache->slabs_full);
 	LIST_INIT(cache->slabs_partial);
 	LIST_INIT(cache->slabs_free);
 
+	cache->num_free_slabs = 0;
+	cache->free_slabs_limit = DEFAULT_FREE_SLABS_LIMIT;
+	cache->active = false;
+	cache->stats.grows = 0;
+	cache->stats.reaps = 0;
+
+	/* Initialize magazines and depot */
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+		cache->cpu_caches[cpu].loaded = cache->cpu_caches[cpu].previous = NULL;
+		cache->cpu_caches[cpu].active = false;
+	}
+
+	LIST_INIT(cache->depot_full);
+	LIST_INIT(cache->depot_empty);
+
+	cache->magazine_size = flags & SLAB_NO_MAGAZINES ? 0 : MAGAZINE_INITIAL_SIZE;
+	cache->magazine_ops = 0;
+	cache->depot_ops = 0;
+
 	/* Set given parameters */
+	if (flags & SLAB_HWCACHE_ALIGN)
+		align = MAX(align, (size_t) L1_CACHE_BYTES);
+	if (align == 0)
+		align = 1;
+
+	obj_size = ALIGN_UP(obj_size, align);
+
 	cache->obj_size = obj_size;
+	cache->align = align;
+	cache->flags = flags;
 	cache->constructor = constructor;
 	cache->destructor = destructor;
 	
@@ -276,6 +924,8 @@ static void init_cache(kmem_cache_t* cache, const char* name, size_t obj_size, v
 	cache->name[CACHE_NAMELEN - 1] = '\0';
 
 	/* Calculate remaining parameters */
+	unsigned int remaining;
+
 	if (OFF_SLAB(cache))
 	{
 		/* Make sure each slab has at least OFF_SLAB_MIN_OBJS_PER_SLAB objs */
@@ -288,6 +938,7 @@ static void init_cache(kmem_cache_t* cache, const char* name, size_t obj_size, v
 		}
 
 		cache->pages_per_slab = DIV_CEIL(obj_size * cache->objs_per_slab, PAGE_SIZE);
+		remaining = cache->pages_per_slab * PAGE_SIZE - obj_size * cache->objs_per_slab;
 	}
 	
 	else
@@ -297,14 +948,21 @@ static void init_cache(kmem_cache_t* cache, const char* name, size_t obj_size, v
 		size_t slab_size = cache->pages_per_slab * PAGE_SIZE;
 
 		cache->objs_per_slab = slab_size / obj_size;
-		unsigned int remaining = slab_size % obj_size;
+		remaining = slab_size % obj_size;
 
 		/* Decrease slab space for objs until there's enough space for slab_t */
 		while (remaining < SIZE_OF_SLAB_T(cache)) {
 			cache->objs_per_slab--;
 			remaining += obj_size;
 		}
+
+		remaining -= SIZE_OF_SLAB_T(cache);
 	}
+
+	/* The remaining space is used to color the slabs instead of being wasted at the end */
+	cache->color_off = MAX(align, (size_t) L1_CACHE_BYTES);
+	cache->num_colors = remaining / cache->color_off + 1;
+	cache->color_next = 0;
 }
 
 
@@ -313,7 +971,8 @@ static void init_cache(kmem_cache_t* cache, const char* name, size_t obj_size, v
  * 
  * @param size the size of the object
  * 
- * @return the most suitable general cache for the given size
+ * @return the most suitable general cache for the given size or NULL if the
+ * size is 0 or larger than the largest general cache
 */
 static kmem_cache_t* general_cache(size_t size)
 {
@@ -321,18 +980,17 @@ static kmem_cache_t* general_cache(size_t size)
 	if (size == 0)
 		return NULL;
 
-	kmem_cache_t* cache = NULL;
-	
-	/* Search backwards in the general caches' until one doesn't fit or smallest is reached */
-	for (int i = NUM_GENERAL_CACHES - 1; i >= 0; i--)
-	{
-		if (size > general_caches[i]->obj_size)
-			break;
+	if (size <= SMALL_SIZE_MAX)
+		return general_caches[size_index[SIZE_INDEX(size)]];
 
-		cache = general_caches[i];
-	}
+	/* Large sizes are powers of 2, so the index follows from the size's order */
+	unsigned int order = 32 - __builtin_clz(size - 1);
+	unsigned int index = NUM_SMALL_CACHES + order - SMALL_SIZE_ORDER - 1;
 
-	return cache;
+	if (index >= NUM_GENERAL_CACHES)
+		return NULL;
+
+	return general_caches[index];
 }
 
 
@@ -340,6 +998,8 @@ static kmem_cache_t* general_cache(size_t size)
  * Returns a non-full slab from a cache, prioritizing partial ones.
  * Automatically grows the cache if no available slabs are found.
  * 
+ * Called with the cache's lock held, which is dropped while growing it.
+ * 
  * @param cache the cache from where to get the slab
  * 
  * @return a non-full slab or NULL if no available slabs are found
@@ -375,8 +1035,11 @@ static slab_t* slab_get(kmem_cache_t* cache)
 */
 static void slab_destroy(kmem_cache_t* cache, slab_t* slab)
 {
+	/* The color offset is always smaller than a page */
+	void* slab_mem = (void*) ALIGN_DOWN((uintptr_t) slab->s_mem, PAGE_SIZE);
+
 	/* Remove cache and slab from corresponding pages */
-	page_t* page = virt_to_page(slab->s_mem);
+	page_t* page = virt_to_page(slab_mem);
 	for (unsigned int i = 0; i < cache->pages_per_slab; i++) {
 		page->cache = NULL;
 		page->slab = NULL;
@@ -387,8 +1050,25 @@ static void slab_destroy(kmem_cache_t* cache, slab_t* slab)
 		for (unsigned int i = 0; i < cache->objs_per_slab; i++)
 			cache->destructor(((unsigned char*) (slab->s_mem)) + i * cache->obj_size, cache->obj_size);
 
-	free_pages(V2P(slab->s_mem), cache->pages_per_slab);
+	free_pages(V2P(slab_mem), cache->pages_per_slab);
 
 	if (OFF_SLAB(cache))
 		kmem_free(slab);
 }
+
+/**
+ * Destroys every slab in one of a cache's slab lists, leaving it empty.
+ * 
+ * @param cache the cache that the slabs belong to
+ * @param slabs the list of slabs
+*/
+static void slab_destroy_list(kmem_cache_t* cache, list_t* slabs)
+{
+	slab_t* slab;
+	slab_t* next_slab;
+
+	LIST_FOR_EACH_ENTRY_SAFE(slab, next_slab, slabs, list) {
+		list_del(&slab->list);
+		slab_destroy(cache, slab);
+	}
+}
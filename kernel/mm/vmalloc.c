@@ -0,0 +1,328 @@
+/**
+ * Code for the vmalloc allocator.
+ * 
+ * Large buffers are built from single pages mapped into a reserved range of
+ * kernel space, so they never need physically contiguous memory. The pages
+ * can come from high memory, which isn't otherwise mapped by the kernel.
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/mm/vmalloc.h>
+#include <kernel/mm/mm.h>
+#include <kernel/mm/fault.h>
+#include <kernel/ds/list.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/utils.h>
+#include <kernel/system.h>
+
+/* Must be defined: PAGE_SIZE */
+#ifdef __i386__
+#include <kernel/arch/i386/paging.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+
+/* Unmapped pages left after each area, so overruns fault instead of corrupting the next one */
+#define GUARD_NUM_PAGES		1
+
+
+/* Area flags */
+#define VM_LAZY				(1 << 0)	/* Pages are mapped on first touch, by vmalloc_fault() */
+#define VM_IOREMAP			(1 << 1)	/* Maps device memory, whose frames aren't freed */
+
+
+typedef struct vm_area_s {
+	list_t list;
+	uintptr_t addr;
+	size_t num_pages;		/* Not counting the guard pages */
+	unsigned int flags;
+} vm_area_t;
+
+/* Areas in use, sorted by address */
+static list_t vm_area_list;
+
+/* Taken for reading by the page fault handler's lookups and for writing to add or remove areas */
+static rwlock_t vm_area_lock;
+
+/* Serializes mapping the pages of lazy areas, so a page faulted on twice is only mapped once */
+static spinlock_t vm_fault_lock;
+
+
+static vm_area_t* vm_area_alloc(size_t num_pages, unsigned int flags);
+static void vm_area_free(vm_area_t* area);
+static vm_area_t* vm_area_find(uintptr_t addr);
+static vm_area_t* vm_area_lookup(uintptr_t addr);
+static void vm_area_unmap(vm_area_t* area);
+
+
+/* Global Functions */
+
+void vmalloc_init(void)
+{
+	LIST_INIT(vm_area_list);
+	rwlock_init(&vm_area_lock, "vm_area");
+	spin_lock_init(&vm_fault_lock, "vm_fault");
+}
+
+
+void* vmalloc(size_t size)
+{
+	if (size == 0)
+		return NULL;
+
+	size_t num_pages = DIV_CEIL(size, PAGE_SIZE);
+
+	vm_area_t* area = vm_area_alloc(num_pages, 0);
+	if (area == NULL)
+		return NULL;
+
+	for (size_t i = 0; i < num_pages; i++)
+	{
+		page_t* page = alloc_frame(PA_HIGHMEM);
+		paging_map_kernel_page(area->addr + i * PAGE_SIZE, page_to_phys(page), PAGE_WRITE | PAGE_GLOBAL);
+	}
+
+	return (void*) area->addr;
+}
+
+void* vmalloc_lazy(size_t size)
+{
+	if (size == 0)
+		return NULL;
+
+	vm_area_t* area = vm_area_alloc(DIV_CEIL(size, PAGE_SIZE), VM_LAZY);
+	if (area == NULL)
+		return NULL;
+
+	return (void*) area->addr;
+}
+
+void vfree(void* addr)
+{
+	if (addr == NULL)
+		return;
+
+	read_lock(&vm_area_lock);
+	vm_area_t* area = vm_area_find((uintptr_t) addr);
+	read_unlock(&vm_area_lock);
+
+	ASSERT(area != NULL);
+
+	vm_area_unmap(area);
+	vm_area_free(area);
+}
+
+
+void* ioremap(phys_addr_t paddr, size_t size)
+{
+	if (size == 0)
+		return NULL;
+
+	size_t offset = (size_t) (paddr & (PAGE_SIZE - 1));
+	size_t num_pages = DIV_CEIL(offset + size, PAGE_SIZE);
+
+	vm_area_t* area = vm_area_alloc(num_pages, VM_IOREMAP);
+	if (area == NULL)
+		return NULL;
+
+	/* Device registers must not be cached */
+	for (size_t i = 0; i < num_pages; i++)
+		paging_map_kernel_page(area->addr + i * PAGE_SIZE, paddr - offset + i * PAGE_SIZE,
+			PAGE_WRITE | PAGE_CACHEDISABLE | PAGE_WRITETHROUGH | PAGE_GLOBAL);
+
+	return (void*) (area->addr + offset);
+}
+
+void iounmap(void* addr)
+{
+	if (addr == NULL)
+		return;
+
+	read_lock(&vm_area_lock);
+	vm_area_t* area = vm_area_find(ALIGN_DOWN((uintptr_t) addr, PAGE_SIZE));
+	read_unlock(&vm_area_lock);
+
+	ASSERT(area != NULL && (area->flags & VM_IOREMAP));
+
+	vm_area_unmap(area);
+	vm_area_free(area);
+}
+
+
+unsigned int vmalloc_fault(uintptr_t addr)
+{
+	read_lock(&vm_area_lock);
+	vm_area_t* area = vm_area_lookup(addr);
+	bool lazy = area != NULL && (area->flags & VM_LAZY);
+	read_unlock(&vm_area_lock);
+
+	if (!lazy)
+		return PF_BAD_ADDRESS;
+
+	uintptr_t vaddr = ALIGN_DOWN(addr, PAGE_SIZE);
+
+	if (paging_kernel_page_phys(vaddr) != 0) {
+		tlb_invalidate_page(vaddr);
+		return PF_SPURIOUS;
+	}
+
+	/* Allocated before taking the lock, which is then only held to check and map */
+	page_t* page = alloc_frame(PA_HIGHMEM | PA_ZERO);
+
+	uint32_t flags = spin_lock_irqsave(&vm_fault_lock);
+
+	/* Another fault on the same page may have mapped it meanwhile */
+	if (paging_kernel_page_phys(vaddr) != 0) {
+		spin_unlock_irqrestore(&vm_fault_lock, flags);
+		free_frame(page);
+		tlb_invalidate_page(vaddr);
+		return PF_SPURIOUS;
+	}
+
+	paging_map_kernel_page(vaddr, page_to_phys(page), PAGE_WRITE | PAGE_GLOBAL);
+
+	spin_unlock_irqrestore(&vm_fault_lock, flags);
+
+	return PF_DEMAND_ZERO;
+}
+
+
+void* kvmalloc(size_t size)
+{
+	if (size <= PAGE_SIZE)
+		return kmalloc(size);
+
+	return vmalloc(size);
+}
+
+void kvfree(void* addr)
+{
+	if (is_vmalloc_addr(addr))
+		vfree(addr);
+	else if (addr != NULL)
+		kfree(addr);
+}
+
+
+/* Helper Functions */
+
+/**
+ * Reserves a range of virtual addresses in the first large enough gap.
+ * 
+ * @param num_pages the number of pages of the range
+ * @param flags the area flags
+ * 
+ * @return the area describing the range or NULL if no gap is large enough
+*/
+static vm_area_t* vm_area_alloc(size_t num_pages, unsigned int flags)
+{
+	size_t size = (num_pages + GUARD_NUM_PAGES) * PAGE_SIZE;
+	uintptr_t addr = VMALLOC_START;
+	vm_area_t* curr;
+
+	/* Allocated up front, so the lock isn't held while kmalloc() may reap memory */
+	vm_area_t* area = kmalloc(sizeof(vm_area_t));
+
+	write_lock(&vm_area_lock);
+
+	/* Find the first area that leaves a large enough gap before it */
+	LIST_FOR_EACH_ENTRY(curr, &vm_area_list, list) {
+		if (curr->addr - addr >= size)
+			break;
+
+		addr = curr->addr + (curr->num_pages + GUARD_NUM_PAGES) * PAGE_SIZE;
+	}
+
+	if (VMALLOC_END - addr < size) {
+		write_unlock(&vm_area_lock);
+		kfree(area);
+		return NULL;
+	}
+
+	area->addr = addr;
+	area->num_pages = num_pages;
+	area->flags = flags;
+
+	/* Insert before curr, which is the list head if the loop didn't break */
+	list_add_last(&curr->list, &area->list);
+
+	write_unlock(&vm_area_lock);
+
+	return area;
+}
+
+/**
+ * Releases the range of virtual addresses of an area, which must already be unmapped.
+ * 
+ * @param area the area
+*/
+static void vm_area_free(vm_area_t* area)
+{
+	write_lock(&vm_area_lock);
+	list_del(&area->list);
+	write_unlock(&vm_area_lock);
+
+	kfree(area);
+}
+
+/**
+ * Returns the area starting at a given address, with vm_area_lock held.
+ * 
+ * @param addr the address
+ * 
+ * @return the area or NULL if no area starts at addr
+*/
+static vm_area_t* vm_area_find(uintptr_t addr)
+{
+	vm_area_t* area;
+
+	LIST_FOR_EACH_ENTRY(area, &vm_area_list, list) {
+		if (area->addr == addr)
+			return area;
+	}
+
+	return NULL;
+}
+
+/**
+ * Returns the area containing a given address, with vm_area_lock held.
+ * 
+ * @param addr the address
+ * 
+ * @return the area or NULL if addr isn't in any area, or is in a guard page
+*/
+static vm_area_t* vm_area_lookup(uintptr_t addr)
+{
+	vm_area_t* area;
+
+	LIST_FOR_EACH_ENTRY(area, &vm_area_list, list) {
+		if (addr < area->addr)
+			break;
+
+		if (addr < area->addr + area->num_pages * PAGE_SIZE)
+			return area;
+	}
+
+	return NULL;
+}
+
+/**
+ * Unmaps the pages of an area, freeing their page frames unless it maps device memory.
+ * 
+ * Pages of lazy areas that were never touched are skipped.
+ * 
+ * @param area the area
+*/
+static void vm_area_unmap(vm_area_t* area)
+{
+	tlb_batch_t batch;
+	tlb_batch_init(&batch);
+
+	paging_unmap_range(kernel_page_directory, area->addr, area->num_pages, !(area->flags & VM_IOREMAP), &batch);
+	tlb_batch_flush(&batch);
+}
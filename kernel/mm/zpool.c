@@ -0,0 +1,228 @@
+/**
+ * Code for the pool of pre-zeroed pages.
+ * 
+ * Each zone keeps a small number of free pages that have already been zeroed,
+ * so PA_ZERO allocations of a single page don't have to clear it on the spot.
+ * The pools are refilled from the idle loop of every CPU, which moves the cost of
+ * zeroing off the paths that are waiting for the memory.
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/mm/mm.h>
+#include <kernel/mm/highmem.h>
+#include <kernel/ds/list.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/system.h>
+
+/* Must be defined: PAGE_SIZE */
+#ifdef __i386__
+#include <kernel/arch/i386/paging.h>
+#include <kernel/arch/i386/system.h>
+#include <kernel/arch/i386/fpu.h>
+#include <kernel/arch/i386/cpu.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+
+#define ZPOOL_HIGH			128		/* The number of pages kept in each zone's pool */
+
+
+typedef struct zero_pool_s {
+	spinlock_t lock;
+	list_t pages;
+	unsigned int count;
+
+	struct {
+		unsigned long hits;
+		unsigned long misses;
+		unsigned long refills;			/* The number of pages zeroed by zpool_refill() */
+		uint64_t refill_cycles;
+	} stats;
+} zero_pool_t;
+
+static zero_pool_t zpools[NUM_ZONES];
+
+
+extern page_t* pcp_alloc(unsigned int zone_id, bool cold);
+extern void pcp_free(page_t* page, bool cold);
+
+
+void zpool_init(void);
+page_t* zpool_alloc(unsigned int zone_id);
+void zpool_drain_all(void);
+bool zpool_refill(unsigned int max_pages);
+void zpool_print(void);
+void zero_frame(page_t* page);
+
+
+/* Global Functions */
+
+/**
+ * Initializes the pool of every zone, which start out empty.
+*/
+void zpool_init(void)
+{
+	for (unsigned int zone_id = 0; zone_id < NUM_ZONES; zone_id++) {
+		spin_lock_init(&zpools[zone_id].lock, "zpool");
+		LIST_INIT(zpools[zone_id].pages);
+		zpools[zone_id].count = 0;
+	}
+}
+
+
+/**
+ * Takes a zeroed page from a zone's pool.
+ * 
+ * @param zone_id the zone
+ * 
+ * @return the page or NULL if the pool is empty
+*/
+page_t* zpool_alloc(unsigned int zone_id)
+{
+	zero_pool_t* zpool = &zpools[zone_id];
+
+	spin_lock(&zpool->lock);
+
+	list_t* entry = list_remove_first(&zpool->pages);
+	if (entry == NULL)
+		zpool->stats.misses++;
+	else {
+		zpool->count--;
+		zpool->stats.hits++;
+	}
+
+	spin_unlock(&zpool->lock);
+
+	return (page_t*) entry;
+}
+
+/**
+ * Gives every page in the pools back to the page allocator.
+ * 
+ * Used when the buddy allocator runs out of memory.
+*/
+void zpool_drain_all(void)
+{
+	for (unsigned int zone_id = 0; zone_id < NUM_ZONES; zone_id++)
+	{
+		zero_pool_t* zpool = &zpools[zone_id];
+		list_t pages;
+		list_t* entry;
+
+		LIST_INIT(pages);
+
+		spin_lock(&zpool->lock);
+		list_splice_last(&pages, &zpool->pages);
+		zpool->count = 0;
+		spin_unlock(&zpool->lock);
+
+		while ((entry = list_remove_first(&pages)) != NULL)
+			pcp_free((page_t*) entry, true);
+	}
+}
+
+
+/**
+ * Zeroes free pages into the pools that aren't full.
+ * 
+ * @param max_pages the maximum number of pages to zero
+ * 
+ * @return true if any page was zeroed, false if the pools are full or there's
+ * no free memory to fill them with
+*/
+bool zpool_refill(unsigned int max_pages)
+{
+	unsigned int num_zeroed = 0;
+
+	for (unsigned int zone_id = 0; zone_id < NUM_ZONES; zone_id++)
+	{
+		zero_pool_t* zpool = &zpools[zone_id];
+		uint64_t start = rdtsc();
+		unsigned int num_pages = 0;
+
+		/*
+		 * The page is zeroed without the lock, so CPUs refilling at the same time
+		 * may overfill the pool by a few pages, which is harmless.
+		*/
+		while (zpool->count < ZPOOL_HIGH && num_zeroed + num_pages < max_pages)
+		{
+			/* Cold pages, their contents are about to be overwritten anyway */
+			page_t* page = pcp_alloc(zone_id, true);
+			if (page == NULL)
+				break;
+
+			zero_frame(page);
+
+			spin_lock(&zpool->lock);
+			list_add_last(&zpool->pages, &page->list);
+			zpool->count++;
+			spin_unlock(&zpool->lock);
+
+			num_pages++;
+		}
+
+		if (num_pages > 0) {
+			spin_lock(&zpool->lock);
+			zpool->stats.refills += num_pages;
+			zpool->stats.refill_cycles += rdtsc() - start;
+			spin_unlock(&zpool->lock);
+
+			num_zeroed += num_pages;
+		}
+	}
+
+	return num_zeroed > 0;
+}
+
+
+/**
+ * Prints the counters of the pools that have been used.
+*/
+void zpool_print(void)
+{
+	for (unsigned int zone_id = 0; zone_id < NUM_ZONES; zone_id++)
+	{
+		zero_pool_t* zpool = &zpools[zone_id];
+		unsigned long num_allocs = zpool->stats.hits + zpool->stats.misses;
+
+		if (num_allocs + zpool->stats.refills == 0)
+			continue;
+
+		printf("zone %u: %u pages, %u hits, %u misses (%u%% hit rate), %u pages zeroed, %llu cycles/page\n",
+			zone_id, zpool->count, zpool->stats.hits, zpool->stats.misses,
+			num_allocs ? zpool->stats.hits * 100 / num_allocs : 0, zpool->stats.refills,
+			zpool->stats.refills ? zpool->stats.refill_cycles / zpool->stats.refills : 0);
+	}
+}
+
+
+/**
+ * Zeroes a page frame, mapping it temporarily if it's in high memory.
+ * 
+ * With SSE2, the page is zeroed with non-temporal stores, as the pages are
+ * mostly zeroed ahead of time and shouldn't push useful data out of the cache.
+ * 
+ * @param page the page
+*/
+void zero_frame(page_t* page)
+{
+	void* vaddr = kmap_atomic(page);
+
+#ifdef __i386__
+	if ((cpu_info.features_edx & CPUID_EDX_SSE2) && kernel_fpu_usable()) {
+		kernel_fpu_begin();
+		sse2_clear_page(vaddr, PAGE_SIZE);
+		kernel_fpu_end();
+	}
+	else
+#endif
+		memset(vaddr, 0, PAGE_SIZE);
+
+	kunmap_atomic(vaddr);
+}
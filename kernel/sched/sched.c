@@ -0,0 +1,517 @@
+/**
+ * Code for kernel threads and the scheduler.
+ * 
+ * Each CPU has an O(1) runqueue made of two priority arrays, each with a list of
+ * ready threads per priority and a bitmap of the non-empty lists, so picking the
+ * next thread is a bit scan. Threads that use up their time slice go to the expired
+ * array, and the arrays are swapped once the active one is empty, so lower
+ * priorities still get to run.
+ * 
+ * The timer tick charges the current thread's time slice and marks it for
+ * preemption, which happens on the way out of the interrupt handler, unless
+ * preemption is disabled.
+ * 
+ * Threads don't migrate. New threads go to the CPU with the fewest threads, and
+ * a wakeup puts the thread back in its own CPU's runqueue, sending that CPU a
+ * reschedule IPI if the thread should run right away. Other CPUs only ever add
+ * to a runqueue, under its lock, and only its own CPU takes threads off it, so
+ * the lock is dropped before switching.
+ * 
+ * Refer to:
+ * https://www.kernel.org/doc/gorman/html/understand/ (Linux 2.6 O(1) scheduler)
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/sched/sched.h>
+#include <kernel/mm/mm.h>
+#include <kernel/ds/list.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/smp.h>
+#include <kernel/system.h>
+
+#ifdef __i386__
+#include <kernel/arch/i386/context.h>
+#include <kernel/arch/i386/fpu.h>
+#include <kernel/arch/i386/system.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+
+/* Higher priorities get longer time slices, from 17 ticks down to 2 */
+#define TIME_SLICE(prio)	(2 + (NUM_PRIORITIES - 1 - (prio)) / 2)
+
+#define THREAD_STACK_SIZE	(THREAD_STACK_PAGES * PAGE_SIZE)
+
+
+typedef struct prio_array_s {
+	uint32_t bitmap;					/* Bit n is set if queues[n] isn't empty */
+	list_t queues[NUM_PRIORITIES];
+	unsigned int num_threads;
+} prio_array_t;
+
+typedef struct runqueue_s {
+	spinlock_t lock;
+
+	prio_array_t arrays[2];
+	prio_array_t* active;
+	prio_array_t* expired;
+
+	thread_t* curr;
+	thread_t* idle;
+	thread_t* zombie;					/* A dead thread whose stack is freed after the switch */
+
+	volatile bool need_resched;			/* Also set by other CPUs, see activate_thread() */
+
+	struct {
+		unsigned long switches;
+		unsigned long preemptions;
+		unsigned long array_swaps;
+	} stats;
+} runqueue_t;
+
+static runqueue_t runqueues[MAX_CPUS];
+
+static struct kmem_cache_s* thread_cache;
+static unsigned int next_thread_id;
+
+volatile uint64_t jiffies;
+unsigned int preempt_counts[MAX_CPUS];
+
+
+void sched_init(void);
+void sched_init_cpu(void);
+thread_t* thread_create(const char* name, void (*func)(void*), void* arg, unsigned int priority);
+thread_t* thread_create_on(unsigned int cpu, const char* name, void (*func)(void*), void* arg, unsigned int priority);
+thread_t* thread_current(void);
+void thread_yield(void);
+void thread_exit(void);
+void thread_sleep_ns(uint64_t ns);
+void thread_block(void);
+void thread_wake(thread_t* thread);
+void schedule(void);
+void sched_preempt(void);
+bool sched_need_resched(void);
+void sched_tick(void);
+void sched_print(void);
+
+static void thread_start(void* arg);
+static void finish_switch(runqueue_t* rq);
+static thread_t* pick_next_thread(runqueue_t* rq);
+static bool activate_thread(runqueue_t* rq, thread_t* thread);
+static void enqueue_thread(prio_array_t* array, thread_t* thread);
+static unsigned int select_cpu(void);
+static void sleep_timeout(void* arg);
+static void init_prio_array(prio_array_t* array);
+
+
+/* Global Functions */
+
+void sched_init(void)
+{
+	thread_cache = kmem_cache_create("thread", sizeof(thread_t), 0, 0, NULL, NULL);
+
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		runqueue_t* rq = &runqueues[cpu];
+
+		spin_lock_init(&rq->lock, "runqueue");
+		init_prio_array(&rq->arrays[0]);
+		init_prio_array(&rq->arrays[1]);
+		rq->active = &rq->arrays[0];
+		rq->expired = &rq->arrays[1];
+	}
+
+	sched_init_cpu();
+}
+
+void sched_init_cpu(void)
+{
+	/* The boot context becomes the idle thread, which is never in a runqueue */
+	thread_t* idle = kmem_cache_alloc(thread_cache);
+	idle->stack = NULL;
+	idle->fpu_state = NULL;
+	idle->id = __atomic_fetch_add(&next_thread_id, 1, __ATOMIC_RELAXED);
+	idle->name = "idle";
+	idle->cpu = smp_cpu_id();
+	idle->state = THREAD_RUNNING;
+	idle->priority = NUM_PRIORITIES - 1;
+	idle->time_slice = 0;
+
+	runqueue_t* rq = &runqueues[smp_cpu_id()];
+	rq->idle = idle;
+	rq->curr = idle;
+}
+
+
+thread_t* thread_create(const char* name, void (*func)(void*), void* arg, unsigned int priority)
+{
+	return thread_create_on(select_cpu(), name, func, arg, priority);
+}
+
+thread_t* thread_create_on(unsigned int cpu, const char* name, void (*func)(void*), void* arg, unsigned int priority)
+{
+	ASSERT(priority < NUM_PRIORITIES && cpu < num_cpus);
+
+	thread_t* thread = kmem_cache_alloc(thread_cache);
+	if (thread == NULL)
+		return NULL;
+
+	thread->stack = (void*) P2V((uintptr_t) alloc_pages(THREAD_STACK_PAGES, PA_KERNEL));
+	thread->esp = context_init_stack((uint8_t*) thread->stack + THREAD_STACK_SIZE, thread_start, thread);
+
+	thread->fpu_state = NULL;
+	timer_setup(&thread->sleep_timer, sleep_timeout, thread);
+	thread->name = name;
+	thread->priority = priority;
+	thread->time_slice = TIME_SLICE(priority);
+	thread->func = func;
+	thread->arg = arg;
+	thread->id = __atomic_fetch_add(&next_thread_id, 1, __ATOMIC_RELAXED);
+	thread->cpu = cpu;
+
+	runqueue_t* rq = &runqueues[cpu];
+	uint32_t flags = spin_lock_irqsave(&rq->lock);
+
+	bool resched = activate_thread(rq, thread);
+	spin_unlock(&rq->lock);
+
+	if (resched && cpu != smp_cpu_id())
+		smp_send_reschedule(cpu);
+
+	irq_restore(flags);
+
+	return thread;
+}
+
+thread_t* thread_current(void)
+{
+	return runqueues[smp_cpu_id()].curr;
+}
+
+
+void thread_yield(void)
+{
+	schedule();
+}
+
+void thread_exit(void)
+{
+	IRQ_OFF;
+
+	runqueue_t* rq = &runqueues[smp_cpu_id()];
+	ASSERT(rq->curr != rq->idle);
+
+	rq->curr->state = THREAD_DEAD;
+	rq->zombie = rq->curr;
+
+	schedule();
+
+	PANIC("Dead thread was scheduled");
+}
+
+
+void thread_sleep_ns(uint64_t ns)
+{
+	uint32_t flags = irq_save();
+
+	thread_t* thread = thread_current();
+	ASSERT(thread->stack != NULL);
+
+	timer_add(&thread->sleep_timer, ktime_get_ns() + ns);
+	thread->state = THREAD_BLOCKED;
+
+	schedule();
+	irq_restore(flags);
+}
+
+void thread_block(void)
+{
+	ASSERT(!irqs_enabled());
+
+	thread_current()->state = THREAD_BLOCKED;
+	schedule();
+}
+
+void thread_wake(thread_t* thread)
+{
+	runqueue_t* rq = &runqueues[thread->cpu];
+	uint32_t flags = spin_lock_irqsave(&rq->lock);
+
+	/*
+	 * The thread may not have switched out yet. It's then put back in the runqueue
+	 * before its CPU gets to schedule(), which leaves it there
+	*/
+	bool resched = thread->state == THREAD_BLOCKED && activate_thread(rq, thread);
+	spin_unlock(&rq->lock);
+
+	if (resched && thread->cpu != smp_cpu_id())
+		smp_send_reschedule(thread->cpu);
+
+	irq_restore(flags);
+}
+
+
+void schedule(void)
+{
+	ASSERT(preempt_counts[smp_cpu_id()] == 0);
+
+	runqueue_t* rq = &runqueues[smp_cpu_id()];
+	uint32_t flags = spin_lock_irqsave(&rq->lock);
+
+	thread_t* prev = rq->curr;
+
+	rq->need_resched = false;
+
+	/* Put the thread back in the runqueue, in the expired array if its time slice is used up */
+	if (prev->state == THREAD_RUNNING && prev != rq->idle)
+	{
+		prev->state = THREAD_READY;
+
+		if (prev->time_slice == 0) {
+			prev->time_slice = TIME_SLICE(prev->priority);
+			enqueue_thread(rq->expired, prev);
+		}
+		else
+			enqueue_thread(rq->active, prev);
+	}
+
+	thread_t* next = pick_next_thread(rq);
+	next->state = THREAD_RUNNING;
+
+	if (next != prev) {
+		rq->curr = next;
+		rq->stats.switches++;
+	}
+
+	/* Interrupts stay disabled until the switch is done */
+	spin_unlock(&rq->lock);
+
+	if (next != prev)
+	{
+		if (next->stack != NULL)
+			tss_set_kernel_stack((uint32_t) next->stack + THREAD_STACK_SIZE);
+
+		fpu_switch(next);
+
+		switch_context(&prev->esp, next->esp);
+
+		/* Running as prev again, possibly on behalf of another thread's switch */
+		finish_switch(&runqueues[smp_cpu_id()]);
+	}
+
+	irq_restore(flags);
+}
+
+void sched_preempt(void)
+{
+	unsigned int cpu = smp_cpu_id();
+
+	if (!runqueues[cpu].need_resched || preempt_counts[cpu] > 0 || runqueues[cpu].curr == runqueues[cpu].idle)
+		return;
+
+	runqueues[cpu].stats.preemptions++;
+	schedule();
+}
+
+bool sched_need_resched(void)
+{
+	return runqueues[smp_cpu_id()].need_resched;
+}
+
+
+void sched_tick(void)
+{
+	runqueue_t* rq = &runqueues[smp_cpu_id()];
+
+	if (smp_cpu_id() == 0)
+		jiffies++;
+
+	if (rq->curr == rq->idle) {
+		if (rq->active->num_threads + rq->expired->num_threads > 0)
+			rq->need_resched = true;
+		return;
+	}
+
+	if (rq->curr->time_slice > 0 && --rq->curr->time_slice == 0)
+		rq->need_resched = true;
+}
+
+
+void sched_print(void)
+{
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		runqueue_t* rq = &runqueues[cpu];
+
+		if (rq->stats.switches == 0)
+			continue;
+
+		printf("cpu%u: %u ready, %u switches, %u preemptions, %u array swaps\n", cpu,
+			rq->active->num_threads + rq->expired->num_threads, rq->stats.switches,
+			rq->stats.preemptions, rq->stats.array_swaps);
+	}
+}
+
+
+/* Helper Functions */
+
+/**
+ * The function new threads start in, with interrupts disabled.
+ * 
+ * @param arg the thread
+*/
+static void thread_start(void* arg)
+{
+	thread_t* thread = arg;
+
+	finish_switch(&runqueues[smp_cpu_id()]);
+	IRQ_ON;
+
+	thread->func(thread->arg);
+
+	thread_exit();
+}
+
+/**
+ * Frees the thread that exited before the switch, now that its stack isn't in use.
+ * 
+ * @param rq the runqueue of the current CPU
+*/
+static void finish_switch(runqueue_t* rq)
+{
+	thread_t* zombie = rq->zombie;
+	if (zombie == NULL)
+		return;
+
+	rq->zombie = NULL;
+
+	fpu_release(zombie);
+	free_pages((void*) V2P((uintptr_t) zombie->stack), THREAD_STACK_PAGES);
+	kmem_cache_free(thread_cache, zombie);
+}
+
+/**
+ * Removes the highest priority ready thread from the runqueue.
+ * 
+ * @param rq the runqueue
+ * 
+ * @return the thread, or the idle thread if none are ready
+*/
+static thread_t* pick_next_thread(runqueue_t* rq)
+{
+	if (rq->active->num_threads == 0)
+	{
+		prio_array_t* array = rq->active;
+		rq->active = rq->expired;
+		rq->expired = array;
+
+		if (rq->active->num_threads == 0)
+			return rq->idle;
+
+		rq->stats.array_swaps++;
+	}
+
+	prio_array_t* array = rq->active;
+	unsigned int prio = __builtin_ctz(array->bitmap);
+
+	thread_t* thread = (thread_t*) list_remove_first(&array->queues[prio]);
+
+	if (LIST_IS_EMPTY(array->queues[prio]))
+		array->bitmap &= ~(1U << prio);
+
+	array->num_threads--;
+
+	return thread;
+}
+
+/**
+ * Makes a thread ready in its runqueue, marking the CPU for preemption if the
+ * thread should run before the current one.
+ * 
+ * @param rq the runqueue of the thread's CPU, locked
+ * @param thread the thread
+ * 
+ * @return true if the CPU was marked for preemption, false otherwise
+*/
+static bool activate_thread(runqueue_t* rq, thread_t* thread)
+{
+	thread->state = THREAD_READY;
+	enqueue_thread(rq->active, thread);
+
+	if (thread->priority >= rq->curr->priority && rq->curr != rq->idle)
+		return false;
+
+	rq->need_resched = true;
+	return true;
+}
+
+/**
+ * Adds a thread to the tail of its priority's list.
+ * 
+ * @param array the priority array
+ * @param thread the thread
+*/
+static void enqueue_thread(prio_array_t* array, thread_t* thread)
+{
+	list_add_last(&array->queues[thread->priority], &thread->list);
+	array->bitmap |= 1U << thread->priority;
+	array->num_threads++;
+}
+
+/**
+ * Picks the online CPU with the fewest running and ready threads, preferring the
+ * current one. The counts are read without the runqueue locks, as a hint.
+ * 
+ * @return the ID of the CPU
+*/
+static unsigned int select_cpu(void)
+{
+	unsigned int self = smp_cpu_id();
+	unsigned int best = self;
+	unsigned int best_load = UINT32_MAX;
+
+	for (unsigned int i = 0; i < num_cpus; i++)
+	{
+		/* Starting from the current CPU, so it wins ties */
+		unsigned int cpu = (self + i) % num_cpus;
+		runqueue_t* rq = &runqueues[cpu];
+
+		unsigned int load = rq->arrays[0].num_threads + rq->arrays[1].num_threads + (rq->curr != rq->idle);
+
+		if (load < best_load) {
+			best = cpu;
+			best_load = load;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Wakes up a thread at the end of thread_sleep_ns().
+ * 
+ * @param arg the thread
+*/
+static void sleep_timeout(void* arg)
+{
+	thread_wake(arg);
+}
+
+/**
+ * Initializes an empty priority array.
+ * 
+ * @param array the priority array
+*/
+static void init_prio_array(prio_array_t* array)
+{
+	array->bitmap = 0;
+	array->num_threads = 0;
+
+	for (unsigned int prio = 0; prio < NUM_PRIORITIES; prio++)
+		LIST_INIT(array->queues[prio]);
+}
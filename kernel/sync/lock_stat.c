@@ -0,0 +1,114 @@
+/**
+ * Code for the lock statistics.
+ * 
+ * Each lock keeps its own counters, which it updates while held. A lock is added
+ * to a global list the first time it's taken, so only the locks that were used
+ * are printed.
+ * 
+ * @author Samuel Pires
+*/
+
+#ifdef CONFIG_LOCK_STAT
+
+#include <kernel/sync/lock_stat.h>
+#include <kernel/ds/list.h>
+
+#ifdef __i386__
+#include <kernel/arch/i386/system.h>
+#include <kernel/arch/i386/drivers/serial.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+
+/* Locks are only ever added, at the end, so the list can be walked without the lock */
+static list_t lock_stats = {&lock_stats, &lock_stats};
+
+/*
+ * Protects additions to lock_stats. It's a plain flag rather than a spinlock, which
+ * would record statistics of its own while they're being recorded.
+*/
+static volatile bool lock_stats_busy;
+
+
+void lock_stat_record(lock_stat_t* stat, bool contended, uint64_t wait_cycles);
+void lock_stat_print(void);
+
+static void lock_stat_add(lock_stat_t* stat);
+static void serial_out(char c, void* arg);
+
+
+/* Global Functions */
+
+void lock_stat_record(lock_stat_t* stat, bool contended, uint64_t wait_cycles)
+{
+	if (stat->name == NULL)
+		return;
+
+	if (LIST_IS_NULL(stat->list))
+		lock_stat_add(stat);
+
+	stat->acquisitions++;
+
+	if (contended) {
+		stat->contentions++;
+		stat->wait_cycles += wait_cycles;
+	}
+}
+
+
+void lock_stat_print(void)
+{
+	lock_stat_t* stat;
+
+	fctprintf(serial_out, NULL, "lock statistics:\n");
+
+	LIST_FOR_EACH_ENTRY(stat, &lock_stats, list) {
+		fctprintf(serial_out, NULL, "%s: %lu acquisitions, %lu contended (%lu%%), %llu wait cycles avg\n",
+			stat->name, stat->acquisitions, stat->contentions,
+			stat->acquisitions ? stat->contentions * 100 / stat->acquisitions : 0,
+			stat->contentions ? stat->wait_cycles / stat->contentions : 0);
+	}
+}
+
+
+/* Helper Functions */
+
+/**
+ * Adds a lock to the list of locks that have been taken, if it isn't already.
+ * 
+ * Interrupts are disabled meanwhile, as their handlers may take locks too.
+ * 
+ * @param stat the statistics of the lock
+*/
+static void lock_stat_add(lock_stat_t* stat)
+{
+	uint32_t flags = irq_save();
+
+	while (__atomic_test_and_set(&lock_stats_busy, __ATOMIC_ACQUIRE))
+		cpu_relax();
+
+	/* Readers of a reader-writer lock may race to add it */
+	if (LIST_IS_NULL(stat->list))
+		list_add_last(&lock_stats, &stat->list);
+
+	__atomic_clear(&lock_stats_busy, __ATOMIC_RELEASE);
+	irq_restore(flags);
+}
+
+/**
+ * Writes a character to the serial port, for fctprintf().
+ * 
+ * @param c the character
+ * @param arg unused
+*/
+static void serial_out(char c, void* arg)
+{
+	(void) arg;
+
+	serial_writechar(c);
+}
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * Code for mutexes.
+ * 
+ * A mutex is a flag and a FIFO list of blocked threads, both protected by a
+ * spinlock. Releasing a mutex that has waiters hands it straight over to the
+ * first one, instead of letting the woken thread race for it again, so waiters
+ * are served in order and can't be starved by threads that never blocked.
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/sync/mutex.h>
+#include <kernel/sync/spinlock.h>
+#include <kernel/sync/lock_stat.h>
+#include <kernel/sched/sched.h>
+#include <kernel/ds/list.h>
+#include <kernel/system.h>
+
+#ifdef __i386__
+#include <kernel/arch/i386/system.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+void mutex_init(mutex_t* mutex, const char* name);
+void mutex_lock(mutex_t* mutex);
+bool mutex_trylock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+
+/* Global Functions */
+
+void mutex_init(mutex_t* mutex, const char* name)
+{
+	mutex->locked = false;
+	mutex->owner = NULL;
+
+	spin_lock_init(&mutex->wait_lock, NULL);
+	LIST_INIT(mutex->waiters);
+
+#ifdef CONFIG_LOCK_STAT
+	mutex->stat = (lock_stat_t) LOCK_STAT_INIT(name);
+#else
+	(void) name;
+#endif
+}
+
+
+void mutex_lock(mutex_t* mutex)
+{
+	thread_t* thread = thread_current();
+	uint32_t flags = spin_lock_irqsave(&mutex->wait_lock);
+
+	if (!mutex->locked)
+	{
+		mutex->locked = true;
+		mutex->owner = thread;
+#ifdef CONFIG_LOCK_STAT
+		lock_stat_record(&mutex->stat, false, 0);
+#endif
+
+		spin_unlock_irqrestore(&mutex->wait_lock, flags);
+		return;
+	}
+
+	ASSERT(mutex->owner != thread);
+
+#ifdef CONFIG_LOCK_STAT
+	uint64_t start = rdtsc();
+#endif
+
+	/* Blocked before the wait lock is dropped, and interrupts stay disabled until the switch */
+	list_add_last(&mutex->waiters, &thread->list);
+	thread->state = THREAD_BLOCKED;
+	spin_unlock(&mutex->wait_lock);
+
+	schedule();
+
+	/* mutex_unlock() made this thread the owner before waking it up */
+#ifdef CONFIG_LOCK_STAT
+	lock_stat_record(&mutex->stat, true, rdtsc() - start);
+#endif
+
+	irq_restore(flags);
+}
+
+bool mutex_trylock(mutex_t* mutex)
+{
+	bool taken = false;
+	uint32_t flags = spin_lock_irqsave(&mutex->wait_lock);
+
+	if (!mutex->locked) {
+		mutex->locked = true;
+		mutex->owner = thread_current();
+		taken = true;
+#ifdef CONFIG_LOCK_STAT
+		lock_stat_record(&mutex->stat, false, 0);
+#endif
+	}
+
+	spin_unlock_irqrestore(&mutex->wait_lock, flags);
+
+	return taken;
+}
+
+void mutex_unlock(mutex_t* mutex)
+{
+	uint32_t flags = spin_lock_irqsave(&mutex->wait_lock);
+
+	ASSERT(mutex->locked && mutex->owner == thread_current());
+
+	thread_t* next = (thread_t*) list_remove_first(&mutex->waiters);
+
+	if (next != NULL)
+		mutex->owner = next;
+	else {
+		mutex->locked = false;
+		mutex->owner = NULL;
+	}
+
+	spin_unlock_irqrestore(&mutex->wait_lock, flags);
+
+	if (next != NULL)
+		thread_wake(next);
+}
@@ -0,0 +1,215 @@
+/**
+ * Code for spinlocks and reader-writer spinlocks.
+ * 
+ * Spinlocks are ticket locks: taking one is a single atomic increment of the next
+ * ticket, and releasing it serves the following one, so the waiting CPUs get the
+ * lock in the order they asked for it instead of whoever wins the cache line.
+ * 
+ * Refer to:
+ * https://lwn.net/Articles/267968/ (Ticket spinlocks)
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/sync/spinlock.h>
+#include <kernel/sync/lock_stat.h>
+#include <kernel/sched/preempt.h>
+
+#ifdef __i386__
+#include <kernel/arch/i386/system.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef CONFIG_LOCK_STAT
+#define STAT_CLOCK()						rdtsc()
+#define STAT_RECORD(lock,contended,start)	lock_stat_record(&(lock)->stat, contended, (contended) ? rdtsc() - (start) : 0)
+#else
+#define STAT_CLOCK()						0
+#define STAT_RECORD(lock,contended,start)	((void) (start))
+#endif
+
+
+void spin_lock_init(spinlock_t* lock, const char* name);
+void spin_lock(spinlock_t* lock);
+bool spin_trylock(spinlock_t* lock);
+void spin_unlock(spinlock_t* lock);
+uint32_t spin_lock_irqsave(spinlock_t* lock);
+void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags);
+
+void rwlock_init(rwlock_t* lock, const char* name);
+void read_lock(rwlock_t* lock);
+void read_unlock(rwlock_t* lock);
+void write_lock(rwlock_t* lock);
+void write_unlock(rwlock_t* lock);
+
+static inline void ticket_release(spinlock_t* lock);
+
+
+/* Global Functions */
+
+void spin_lock_init(spinlock_t* lock, const char* name)
+{
+	lock->owner = 0;
+	lock->next = 0;
+
+#ifdef CONFIG_LOCK_STAT
+	lock->stat = (lock_stat_t) LOCK_STAT_INIT(name);
+#else
+	(void) name;
+#endif
+}
+
+
+void spin_lock(spinlock_t* lock)
+{
+	preempt_disable();
+
+	uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+
+	if (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) == ticket) {
+		STAT_RECORD(lock, false, 0);
+		return;
+	}
+
+	uint64_t start = STAT_CLOCK();
+
+	while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
+		cpu_relax();
+
+	STAT_RECORD(lock, true, start);
+}
+
+bool spin_trylock(spinlock_t* lock)
+{
+	preempt_disable();
+
+	/* Only take a ticket if it would be served right away */
+	uint16_t owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+	uint16_t ticket = owner;
+
+	if (__atomic_compare_exchange_n(&lock->next, &ticket, (uint16_t) (owner + 1), false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		STAT_RECORD(lock, false, 0);
+		return true;
+	}
+
+	preempt_enable();
+	return false;
+}
+
+void spin_unlock(spinlock_t* lock)
+{
+	ticket_release(lock);
+	preempt_enable();
+}
+
+
+uint32_t spin_lock_irqsave(spinlock_t* lock)
+{
+	uint32_t flags = irq_save();
+	spin_lock(lock);
+
+	return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags)
+{
+	ticket_release(lock);
+	irq_restore(flags);
+
+	/* Once interrupts are back on, so a switch deferred while holding the lock isn't missed */
+	preempt_enable();
+}
+
+
+void rwlock_init(rwlock_t* lock, const char* name)
+{
+	lock->count = 0;
+
+#ifdef CONFIG_LOCK_STAT
+	lock->stat = (lock_stat_t) LOCK_STAT_INIT(name);
+#else
+	(void) name;
+#endif
+}
+
+
+void read_lock(rwlock_t* lock)
+{
+	bool contended = false;
+	uint64_t start = 0;
+
+	preempt_disable();
+
+	while (1)
+	{
+		int32_t count = __atomic_load_n(&lock->count, __ATOMIC_RELAXED);
+
+		if (count >= 0 && __atomic_compare_exchange_n(&lock->count, &count, count + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+
+		/* Only waiting for a writer counts, not losing the race against other readers */
+		if (count < 0 && !contended) {
+			contended = true;
+			start = STAT_CLOCK();
+		}
+
+		cpu_relax();
+	}
+
+	STAT_RECORD(lock, contended, start);
+}
+
+void read_unlock(rwlock_t* lock)
+{
+	__atomic_fetch_sub(&lock->count, 1, __ATOMIC_RELEASE);
+	preempt_enable();
+}
+
+
+void write_lock(rwlock_t* lock)
+{
+	bool contended = false;
+	uint64_t start = 0;
+
+	preempt_disable();
+
+	while (1)
+	{
+		int32_t count = 0;
+
+		if (__atomic_compare_exchange_n(&lock->count, &count, -1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+
+		if (!contended) {
+			contended = true;
+			start = STAT_CLOCK();
+		}
+
+		cpu_relax();
+	}
+
+	STAT_RECORD(lock, contended, start);
+}
+
+void write_unlock(rwlock_t* lock)
+{
+	__atomic_store_n(&lock->count, 0, __ATOMIC_RELEASE);
+	preempt_enable();
+}
+
+
+/* Helper Functions */
+
+/**
+ * Serves the next ticket of a spinlock, releasing it.
+ * 
+ * @param lock the lock
+*/
+static inline void ticket_release(spinlock_t* lock)
+{
+	/* Only the holder writes owner, so a plain increment is enough */
+	__atomic_store_n(&lock->owner, (uint16_t) (lock->owner + 1), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,95 @@
+/**
+ * Code for reading the time.
+ * 
+ * The time is read from a clocksource, a free running counter of known frequency,
+ * which is converted to nanoseconds with a multiplication and a shift, so reading
+ * it takes no lock, division or port access. The wall-clock time is the monotonic
+ * time plus an offset, set from the RTC at boot.
+ * 
+ * Refer to:
+ * https://www.kernel.org/doc/html/latest/timers/timekeeping.html
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/time/ktime.h>
+#include <kernel/system.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+static clocksource_t* clocksource;
+static uint64_t base_cycles;			/* The counter's value when it was registered */
+static uint64_t real_offset;			/* The wall-clock time at monotonic time 0 */
+
+
+void clocksource_register(clocksource_t* cs, uint32_t khz);
+void ktime_set_real(uint64_t seconds);
+
+uint64_t ktime_get_ns(void);
+uint64_t ktime_get_real(void);
+uint64_t ktime_get_real_seconds(void);
+
+uint64_t mktime64(unsigned int year, unsigned int month, unsigned int day, unsigned int hour, unsigned int min, unsigned int sec);
+
+
+/* Global Functions */
+
+void clocksource_register(clocksource_t* cs, uint32_t khz)
+{
+	ASSERT(khz > 0);
+
+	/* The largest shift whose multiplier fits in 32 bits, for the most precision */
+	uint32_t shift = 32;
+	while (shift > 0 && ((NSEC_PER_MSEC << shift) / khz) > UINT32_MAX)
+		shift--;
+
+	cs->shift = shift;
+	cs->mult = (uint32_t) ((NSEC_PER_MSEC << shift) / khz);
+
+	base_cycles = cs->read();
+	clocksource = cs;
+}
+
+void ktime_set_real(uint64_t seconds)
+{
+	real_offset = seconds * NSEC_PER_SEC - ktime_get_ns();
+}
+
+
+uint64_t ktime_get_ns(void)
+{
+	uint64_t cycles = clocksource->read() - base_cycles;
+	uint64_t high = cycles >> 32;
+	uint64_t low = (uint32_t) cycles;
+
+	/* Split so the products fit in 64 bits */
+	return ((high * clocksource->mult) << (32 - clocksource->shift)) + ((low * clocksource->mult) >> clocksource->shift);
+}
+
+uint64_t ktime_get_real(void)
+{
+	return ktime_get_ns() + real_offset;
+}
+
+uint64_t ktime_get_real_seconds(void)
+{
+	return ktime_get_real() / NSEC_PER_SEC;
+}
+
+
+uint64_t mktime64(unsigned int year, unsigned int month, unsigned int day, unsigned int hour, unsigned int min, unsigned int sec)
+{
+	/* Count the years from March, so the leap day is the last day of the year */
+	if (month <= 2) {
+		month += 12;
+		year--;
+	}
+
+	uint64_t days = (uint64_t) year * 365 + year / 4 - year / 100 + year / 400
+		+ 367 * (month - 2) / 12 + day - 719499;
+
+	return ((days * 24 + hour) * 60 + min) * 60 + sec;
+}
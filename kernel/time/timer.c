@@ -0,0 +1,292 @@
+/**
+ * Code for kernel timers and the scheduler's tick.
+ * 
+ * Pending timers are kept in a list sorted by expiry time, and the clock event
+ * device is programmed in one-shot mode for the first one, so timers fire with
+ * the precision of the device rather than that of the tick. The tick itself is
+ * just a timer that re-arms itself every 1/HZ seconds, and is stopped while the
+ * CPU is idle, so an idle CPU is only woken up by the timers it actually has.
+ * 
+ * Refer to:
+ * https://www.kernel.org/doc/html/latest/timers/highres.html
+ * https://www.kernel.org/doc/html/latest/timers/no_hz.html
+ * 
+ * @author Samuel Pires
+*/
+
+#include <kernel/time/timer.h>
+#include <kernel/time/ktime.h>
+#include <kernel/sched/sched.h>
+#include <kernel/ds/list.h>
+#include <kernel/smp.h>
+#include <kernel/system.h>
+
+#ifdef __i386__
+#include <kernel/arch/i386/system.h>
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+
+#define TICK_NSEC			(NSEC_PER_SEC / HZ)
+
+
+typedef struct timer_base_s {
+	list_t timers;					/* Pending timers, sorted by expiry time */
+
+	ktimer_t tick;
+	bool tick_stopped;
+
+	struct {
+		unsigned long events;		/* The number of timer interrupts */
+		unsigned long expired;		/* The number of timers run */
+		unsigned long idle_stops;
+		unsigned long skipped_ticks;
+	} stats;
+} timer_base_t;
+
+static timer_base_t timer_bases[MAX_CPUS];
+
+static clock_event_t* clock_event;
+
+
+void timer_init(clock_event_t* dev);
+void timer_init_cpu(void);
+void clock_event_config(clock_event_t* dev, uint32_t freq, uint32_t min_ticks, uint32_t max_ticks);
+
+void timer_setup(ktimer_t* timer, void (*func)(void*), void* arg);
+void timer_add(ktimer_t* timer, uint64_t expires);
+bool timer_del(ktimer_t* timer);
+void timer_interrupt(void);
+
+void tick_nohz_idle_enter(void);
+void tick_nohz_idle_exit(void);
+void timer_print(void);
+
+static void tick_handler(void* arg);
+static void program_next_event(timer_base_t* base, uint64_t now);
+
+
+/* Global Functions */
+
+void timer_init(clock_event_t* dev)
+{
+	clock_event = dev;
+
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++) {
+		LIST_INIT(timer_bases[cpu].timers);
+		timer_setup(&timer_bases[cpu].tick, tick_handler, NULL);
+	}
+
+	timer_init_cpu();
+}
+
+void timer_init_cpu(void)
+{
+	timer_add(&timer_bases[smp_cpu_id()].tick, ktime_get_ns() + TICK_NSEC);
+}
+
+void clock_event_config(clock_event_t* dev, uint32_t freq, uint32_t min_ticks, uint32_t max_ticks)
+{
+	dev->mult = (uint32_t) (((uint64_t) freq << CLOCK_EVENT_SHIFT) / NSEC_PER_SEC);
+	dev->min_delta_ns = ((uint64_t) min_ticks << CLOCK_EVENT_SHIFT) / dev->mult + 1;
+
+	/* Capped so (ns * mult) can't overflow, an idle CPU still wakes up once a second */
+	dev->max_delta_ns = ((uint64_t) max_ticks << CLOCK_EVENT_SHIFT) / dev->mult;
+	if (dev->max_delta_ns > NSEC_PER_SEC)
+		dev->max_delta_ns = NSEC_PER_SEC;
+}
+
+void timer_setup(ktimer_t* timer, void (*func)(void*), void* arg)
+{
+	timer->pending = false;
+	timer->func = func;
+	timer->arg = arg;
+}
+
+void timer_add(ktimer_t* timer, uint64_t expires)
+{
+	uint32_t flags = irq_save();
+	timer_base_t* base = &timer_bases[smp_cpu_id()];
+
+	if (timer->pending)
+		list_del(&timer->list);
+
+	timer->expires = expires;
+	timer->pending = true;
+
+	/* Insert it after the timers that expire before it */
+	list_t* pos = &base->timers;
+	ktimer_t* curr;
+
+	LIST_FOR_EACH_ENTRY(curr, &base->timers, list) {
+		if (curr->expires > expires)
+			break;
+		pos = &curr->list;
+	}
+
+	list_add_first(pos, &timer->list);
+
+	/* The device only needs to be reprogrammed if it's now the first timer */
+	if (pos == &base->timers)
+		program_next_event(base, ktime_get_ns());
+
+	irq_restore(flags);
+}
+
+bool timer_del(ktimer_t* timer)
+{
+	uint32_t flags = irq_save();
+	bool pending = timer->pending;
+
+	/* The device is left programmed, the interrupt finds nothing to run if it was first */
+	if (pending) {
+		list_del(&timer->list);
+		timer->pending = false;
+	}
+
+	irq_restore(flags);
+
+	return pending;
+}
+
+
+void timer_interrupt(void)
+{
+	timer_base_t* base = &timer_bases[smp_cpu_id()];
+	uint64_t now = ktime_get_ns();
+
+	base->stats.events++;
+
+	while (!LIST_IS_EMPTY(base->timers))
+	{
+		ktimer_t* timer = LIST_ENTRY(base->timers.next, ktimer_t, list);
+		if (timer->expires > now)
+			break;
+
+		list_del(&timer->list);
+		timer->pending = false;
+		base->stats.expired++;
+
+		timer->func(timer->arg);
+	}
+
+	program_next_event(base, now);
+}
+
+
+void tick_nohz_idle_enter(void)
+{
+	timer_base_t* base = &timer_bases[smp_cpu_id()];
+
+	if (base->tick_stopped)
+		return;
+
+	/* The tick's expiry time is kept, so the skipped ticks can be counted */
+	timer_del(&base->tick);
+	base->tick_stopped = true;
+	base->stats.idle_stops++;
+
+	program_next_event(base, ktime_get_ns());
+}
+
+void tick_nohz_idle_exit(void)
+{
+	uint32_t flags = irq_save();
+	timer_base_t* base = &timer_bases[smp_cpu_id()];
+
+	if (base->tick_stopped)
+	{
+		uint64_t now = ktime_get_ns();
+		uint64_t next_tick = base->tick.expires;
+
+		if (now >= next_tick) {
+			unsigned long skipped = (now - next_tick) / TICK_NSEC + 1;
+
+			if (smp_cpu_id() == 0)
+				jiffies += skipped;
+			base->stats.skipped_ticks += skipped;
+			next_tick += skipped * TICK_NSEC;
+		}
+
+		base->tick_stopped = false;
+		timer_add(&base->tick, next_tick);
+	}
+
+	irq_restore(flags);
+}
+
+
+void timer_print(void)
+{
+	for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		timer_base_t* base = &timer_bases[cpu];
+
+		if (base->stats.events == 0)
+			continue;
+
+		printf("cpu%u %s: %u interrupts, %u timers run, %u idle stops, %u ticks skipped\n",
+			cpu, clock_event->name, base->stats.events, base->stats.expired,
+			base->stats.idle_stops, base->stats.skipped_ticks);
+	}
+}
+
+
+/* Helper Functions */
+
+/**
+ * Counts a tick for the scheduler and re-arms itself for the next one.
+ * 
+ * Ticks missed while interrupts were disabled are added to jiffies, which only
+ * the boot CPU's tick advances.
+ * 
+ * @param arg unused
+*/
+static void tick_handler(void* arg)
+{
+	(void) arg;
+
+	timer_base_t* base = &timer_bases[smp_cpu_id()];
+	uint64_t now = ktime_get_ns();
+	uint64_t next_tick = base->tick.expires + TICK_NSEC;
+
+	if (now >= next_tick) {
+		unsigned long missed = (now - next_tick) / TICK_NSEC + 1;
+
+		if (smp_cpu_id() == 0)
+			jiffies += missed;
+		next_tick += missed * TICK_NSEC;
+	}
+
+	timer_add(&base->tick, next_tick);
+	sched_tick();
+}
+
+/**
+ * Programs the clock event device for the first pending timer, or stops it if
+ * there's none.
+ * 
+ * @param base the timers of the current CPU
+ * @param now the current time
+*/
+static void program_next_event(timer_base_t* base, uint64_t now)
+{
+	if (LIST_IS_EMPTY(base->timers)) {
+		clock_event->stop();
+		return;
+	}
+
+	ktimer_t* timer = LIST_ENTRY(base->timers.next, ktimer_t, list);
+	uint64_t delta = timer->expires > now ? timer->expires - now : 0;
+
+	if (delta < clock_event->min_delta_ns)
+		delta = clock_event->min_delta_ns;
+	if (delta > clock_event->max_delta_ns)
+		delta = clock_event->max_delta_ns;
+
+	clock_event->set_next_event((uint32_t) ((delta * clock_event->mult) >> CLOCK_EVENT_SHIFT));
+}
@@ -1,8 +1,20 @@
 #include <string.h>
+#include <stdint.h>
+
+#include "word.h"
 
 int memcmp(const void* aptr, const void* bptr, size_t size) {
 	const unsigned char* a = (const unsigned char*) aptr;
 	const unsigned char* b = (const unsigned char*) bptr;
+
+	/* Skip the equal words, the reads stay within the buffers so they can be unaligned */
+	for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+		if (*(const unaligned_u32*) a != *(const unaligned_u32*) b)
+			break;
+		a += WORD_SIZE;
+		b += WORD_SIZE;
+	}
+
 	for (size_t i = 0; i < size; i++) {
 		if (a[i] < b[i])
 			return -1;
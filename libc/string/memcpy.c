@@ -1,9 +1,84 @@
 #include <string.h>
+#include <stdint.h>
+
+#include "word.h"
+
+/*
+ * Copies and fills at least this large use non-temporal stores, so they don't
+ * evict the whole cache. Set at boot if the CPU supports SSE2, must be at least 16.
+ */
+size_t __mem_nt_threshold = SIZE_MAX;
+
+#ifdef __i386__
+/* Copies less than 16 bytes without a loop */
+static inline void copy_small(unsigned char* dst, const unsigned char* src, size_t size) {
+	if (size & 8) {
+		*(unaligned_u32*) dst = *(const unaligned_u32*) src;
+		*(unaligned_u32*) (dst + 4) = *(const unaligned_u32*) (src + 4);
+		dst += 8;
+		src += 8;
+	}
+	if (size & 4) {
+		*(unaligned_u32*) dst = *(const unaligned_u32*) src;
+		dst += 4;
+		src += 4;
+	}
+	if (size & 2) {
+		*(unaligned_u16*) dst = *(const unaligned_u16*) src;
+		dst += 2;
+		src += 2;
+	}
+	if (size & 1)
+		*dst = *src;
+}
+#endif
 
 void* memcpy(void* restrict dstptr, const void* restrict srcptr, size_t size) {
 	unsigned char* dst = (unsigned char*) dstptr;
 	const unsigned char* src = (const unsigned char*) srcptr;
+#ifdef __i386__
+	if (size >= 16) {
+		/* Align the destination, so none of the stores cross a cache line */
+		size_t head = -(uintptr_t) dst & 3;
+		copy_small(dst, src, head);
+		dst += head;
+		src += head;
+		size -= head;
+
+		size_t num_dwords = size / 4;
+
+		if (size >= __mem_nt_threshold) {
+			size_t num_blocks = num_dwords / 4;
+			num_dwords %= 4;
+
+			asm volatile(
+				"1:\n\t"
+				"prefetchnta [esi + 512]\n\t"
+				"mov eax, [esi]\n\t"
+				"mov edx, [esi + 4]\n\t"
+				"movnti [edi], eax\n\t"
+				"movnti [edi + 4], edx\n\t"
+				"mov eax, [esi + 8]\n\t"
+				"mov edx, [esi + 12]\n\t"
+				"movnti [edi + 8], eax\n\t"
+				"movnti [edi + 12], edx\n\t"
+				"add esi, 16\n\t"
+				"add edi, 16\n\t"
+				"dec ecx\n\t"
+				"jnz 1b\n\t"
+				"sfence"
+				: "+D" (dst), "+S" (src), "+c" (num_blocks)
+				:
+				: "eax", "edx", "memory", "cc");
+		}
+
+		asm volatile("rep movsd" : "+D" (dst), "+S" (src), "+c" (num_dwords) : : "memory");
+		size %= 4;
+	}
+	copy_small(dst, src, size);
+#else
 	for (size_t i = 0; i < size; i++)
 		dst[i] = src[i];
+#endif
 	return dstptr;
 }
@@ -1,8 +1,59 @@
 #include <string.h>
+#include <stdint.h>
 
 void* memmove(void* dstptr, const void* srcptr, size_t size) {
 	unsigned char* dst = (unsigned char*) dstptr;
 	const unsigned char* src = (const unsigned char*) srcptr;
+#ifdef __i386__
+	/* Buffers that don't overlap can take all of memcpy's paths */
+	if ((uintptr_t) dst - (uintptr_t) src >= size && (uintptr_t) src - (uintptr_t) dst >= size)
+		return memcpy(dstptr, srcptr, size);
+
+	/*
+	 * The string instructions move one element at a time, so each is read before
+	 * it's overwritten as long as the copy goes away from the overlap.
+	 */
+	if (dst < src) {
+		/* Align the destination */
+		size_t head = size >= 16 ? -(uintptr_t) dst & 3 : 0;
+		size_t num_dwords = (size - head) / 4;
+		size_t tail = (size - head) % 4;
+
+		asm volatile(
+			"rep movsb\n\t"
+			"mov ecx, %3\n\t"
+			"rep movsd\n\t"
+			"mov ecx, %4\n\t"
+			"rep movsb"
+			: "+D" (dst), "+S" (src), "+c" (head)
+			: "r" (num_dwords), "r" (tail)
+			: "memory");
+	} else if (dst > src) {
+		/* Copy backward from the end, aligning the end of the destination */
+		size_t head = size >= 16 ? (uintptr_t) (dst + size) & 3 : 0;
+		size_t num_dwords = (size - head) / 4;
+		size_t tail = (size - head) % 4;
+
+		dst += size - 1;
+		src += size - 1;
+
+		asm volatile(
+			"std\n\t"
+			"rep movsb\n\t"
+			"sub edi, 3\n\t"
+			"sub esi, 3\n\t"
+			"mov ecx, %3\n\t"
+			"rep movsd\n\t"
+			"add edi, 3\n\t"
+			"add esi, 3\n\t"
+			"mov ecx, %4\n\t"
+			"rep movsb\n\t"
+			"cld"
+			: "+D" (dst), "+S" (src), "+c" (head)
+			: "r" (num_dwords), "r" (tail)
+			: "memory", "cc");
+	}
+#else
 	if (dst < src) {
 		for (size_t i = 0; i < size; i++)
 			dst[i] = src[i];
@@ -10,5 +61,6 @@ void* memmove(void* dstptr, const void* srcptr, size_t size) {
 		for (size_t i = size; i != 0; i--)
 			dst[i-1] = src[i-1];
 	}
+#endif
 	return dstptr;
 }
@@ -1,8 +1,71 @@
 #include <string.h>
+#include <stdint.h>
+
+#include "word.h"
+
+extern size_t __mem_nt_threshold;
+
+#ifdef __i386__
+/* Fills less than 16 bytes without a loop */
+static inline void set_small(unsigned char* buf, uint32_t fill, size_t size) {
+	if (size & 8) {
+		*(unaligned_u32*) buf = fill;
+		*(unaligned_u32*) (buf + 4) = fill;
+		buf += 8;
+	}
+	if (size & 4) {
+		*(unaligned_u32*) buf = fill;
+		buf += 4;
+	}
+	if (size & 2) {
+		*(unaligned_u16*) buf = (uint16_t) fill;
+		buf += 2;
+	}
+	if (size & 1)
+		*buf = (unsigned char) fill;
+}
+#endif
 
 void* memset(void* bufptr, int value, size_t size) {
 	unsigned char* buf = (unsigned char*) bufptr;
+#ifdef __i386__
+	uint32_t fill = (unsigned char) value * 0x01010101U;
+
+	if (size >= 16) {
+		/* Align the buffer, so none of the stores cross a cache line */
+		size_t head = -(uintptr_t) buf & 3;
+		set_small(buf, fill, head);
+		buf += head;
+		size -= head;
+
+		size_t num_dwords = size / 4;
+
+		if (size >= __mem_nt_threshold) {
+			size_t num_blocks = num_dwords / 4;
+			num_dwords %= 4;
+
+			asm volatile(
+				"1:\n\t"
+				"movnti [edi], eax\n\t"
+				"movnti [edi + 4], eax\n\t"
+				"movnti [edi + 8], eax\n\t"
+				"movnti [edi + 12], eax\n\t"
+				"add edi, 16\n\t"
+				"dec ecx\n\t"
+				"jnz 1b\n\t"
+				"sfence"
+				: "+D" (buf), "+c" (num_blocks)
+				: "a" (fill)
+				: "memory", "cc");
+		}
+
+		asm volatile("rep stosd" : "+D" (buf), "+c" (num_dwords) : "a" (fill) : "memory");
+		size %= 4;
+	}
+	set_small(buf, fill, size);
+#else
 	for (size_t i = 0; i < size; i++)
 		buf[i] = (unsigned char) value;
+#endif
 	return bufptr;
 }
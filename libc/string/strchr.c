@@ -1,9 +1,20 @@
 #include <string.h>
+#include <stdint.h>
+
+#include "word.h"
 
 char* strchr(const char* str, int c) {
-	while (*str) {
-		if (*str == c) return (char*)str;
-		str++;
+	/* Align to a word, so the word reads can't cross into an unmapped page */
+	for (; !WORD_ALIGNED(str); str++) {
+		if (*str == (char) c) return (char*)str;
+		if (!*str) return NULL;
 	}
-	return NULL;
+
+	const word_t* w = (const word_t*) str;
+	while (!HAS_ZERO(*w) && !HAS_BYTE(*w, c))
+		w++;
+
+	for (str = (const char*) w; *str != (char) c; str++)
+		if (!*str) return NULL;
+	return (char*)str;
 }
@@ -1,8 +1,21 @@
 #include <string.h>
+#include <stdint.h>
+
+#include "word.h"
 
 size_t strlen(const char* str) {
-	size_t len = 0;
-	while (str[len])
-		len++;
-	return len;
+	const char* s = str;
+
+	/* Align to a word, so the word reads can't cross into an unmapped page */
+	for (; !WORD_ALIGNED(s); s++)
+		if (!*s)
+			return s - str;
+
+	const word_t* w = (const word_t*) s;
+	while (!HAS_ZERO(*w))
+		w++;
+
+	for (s = (const char*) w; *s; s++)
+		;
+	return s - str;
 }
@@ -1,9 +1,41 @@
 #include <string.h>
+#include <stdint.h>
+
+#include "word.h"
 
 int strncmp(const char* str1, const char* str2, size_t size) {
-	for (size_t i = 0; i < size; i++) {
-		if (str1[i] != str2[i]) return str1[i] - str2[i];
-		if (!str1[i]) break;
+	const unsigned char* s1 = (const unsigned char*) str1;
+	const unsigned char* s2 = (const unsigned char*) str2;
+
+	/* Align the first string, the second one is read unaligned if needed */
+	for (; size > 0 && !WORD_ALIGNED(s1); size--, s1++, s2++) {
+		if (*s1 != *s2) return *s1 - *s2;
+		if (!*s1) return 0;
+	}
+
+	while (size >= WORD_SIZE) {
+		/* An unaligned word of the second string could cross into an unmapped page */
+		if (CROSSES_PAGE(s2)) {
+			for (size_t i = 0; i < WORD_SIZE; i++, s1++, s2++) {
+				if (*s1 != *s2) return *s1 - *s2;
+				if (!*s1) return 0;
+			}
+			size -= WORD_SIZE;
+			continue;
+		}
+
+		word_t w1 = *(const word_t*) s1;
+		if (w1 != *(const unaligned_u32*) s2 || HAS_ZERO(w1))
+			break;
+
+		s1 += WORD_SIZE;
+		s2 += WORD_SIZE;
+		size -= WORD_SIZE;
+	}
+
+	for (; size > 0; size--, s1++, s2++) {
+		if (*s1 != *s2) return *s1 - *s2;
+		if (!*s1) break;
 	}
 	return 0;
 }
@@ -1,10 +1,33 @@
 #include <string.h>
+#include <stdint.h>
+
+#include "word.h"
 
 char* strrchr(const char* str, int c) {
+	if ((char) c == '\0')
+		return (char*)str + strlen(str);
+
 	const char* last = NULL;
-	while (*str) {
-		if (*str == c) last = str;
-		str++;
+
+	/* Align to a word, so the word reads can't cross into an unmapped page */
+	for (; !WORD_ALIGNED(str); str++) {
+		if (!*str) return (char*)last;
+		if (*str == (char) c) last = str;
 	}
+
+	/* Only remember the last word that has c, it's searched once the end is found */
+	const word_t* w = (const word_t*) str;
+	const word_t* last_word = NULL;
+
+	for (; !HAS_ZERO(*w); w++)
+		if (HAS_BYTE(*w, c))
+			last_word = w;
+
+	if (last_word != NULL)
+		for (str = (const char*) last_word; str < (const char*) (last_word + 1); str++)
+			if (*str == (char) c) last = str;
+
+	for (str = (const char*) w; *str; str++)
+		if (*str == (char) c) last = str;
 	return (char*)last;
 }
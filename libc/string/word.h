@@ -0,0 +1,35 @@
+#ifndef _WORD_H
+#define _WORD_H 1
+
+#include <stdint.h>
+
+/*
+ * Helpers for the string functions that work a word at a time.
+ *
+ * Aligned word reads never cross a page boundary, so reading past the end of
+ * a string up to the end of its last word can't fault.
+ */
+
+typedef uint32_t __attribute__((may_alias)) word_t;
+typedef uint32_t __attribute__((may_alias, aligned(1))) unaligned_u32;
+typedef uint16_t __attribute__((may_alias, aligned(1))) unaligned_u16;
+
+#define WORD_SIZE			sizeof(word_t)
+#define WORD_ALIGNED(p)		(((uintptr_t) (p) & (WORD_SIZE - 1)) == 0)
+
+#define ONES				0x01010101U
+#define HIGHS				0x80808080U
+
+/* Non-zero if any byte of the word is zero */
+#define HAS_ZERO(w)			(((w) - ONES) & ~(w) & HIGHS)
+
+#define REPEAT_BYTE(c)		((unsigned char) (c) * ONES)
+
+/* Non-zero if any byte of the word is c */
+#define HAS_BYTE(w, c)		HAS_ZERO((w) ^ REPEAT_BYTE(c))
+
+/* The smallest page size, a word read that crosses it may fault */
+#define PAGE_BOUNDARY		4096
+#define CROSSES_PAGE(p)		(((uintptr_t) (p) & (PAGE_BOUNDARY - 1)) > PAGE_BOUNDARY - WORD_SIZE)
+
+#endif
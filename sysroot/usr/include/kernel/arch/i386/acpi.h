@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* The header every ACPI table starts with */
+typedef struct acpi_sdt_header_s {
+	char signature[4];
+	uint32_t length;			/* Including the header */
+	uint8_t revision;
+	uint8_t checksum;			/* The bytes of the table sum to 0 */
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__ ((packed)) acpi_sdt_header_t;
+
+
+/* Multiple APIC Description Table, lists the interrupt controllers */
+typedef struct acpi_madt_s {
+	acpi_sdt_header_t header;
+	uint32_t lapic_addr;
+	uint32_t flags;
+	uint8_t entries[];			/* Entries of variable length, each starting with its type and length */
+} __attribute__ ((packed)) acpi_madt_t;
+
+#define MADT_TYPE_LAPIC			0
+
+typedef struct madt_lapic_s {
+	uint8_t type;
+	uint8_t length;
+	uint8_t acpi_cpu_id;
+	uint8_t apic_id;
+	uint32_t flags;
+} __attribute__ ((packed)) madt_lapic_t;
+
+#define MADT_LAPIC_ENABLED		(1 << 0)
+
+
+/**
+ * 	Finds the Root System Description Table, through the RSDP in the BIOS area.
+ * 
+ * 	@return true if the tables were found, false otherwise
+*/
+bool acpi_init(void);
+
+/**
+ * 	Finds and maps an ACPI table.
+ * 
+ * 	@param signature the table's 4 character signature, e.g. "APIC"
+ * 
+ * 	@return the table or NULL if it doesn't exist or its checksum is wrong
+*/
+acpi_sdt_header_t* acpi_find_table(const char* signature);
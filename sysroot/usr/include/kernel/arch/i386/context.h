@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#define EFLAGS_RESERVED		(1 << 1)	/* Always set */
+#define EFLAGS_IF			(1 << 9)
+
+
+/**
+ * Saves the callee-saved registers and flags on the current stack and switches
+ * to another stack saved by this function or set up by context_init_stack().
+ * 
+ * @param prev_esp where the current stack pointer is saved
+ * @param next_esp the stack pointer to switch to
+*/
+void switch_context(uint32_t* prev_esp, uint32_t next_esp);
+
+/**
+ * Sets the stack the CPU switches to when an interrupt arrives in user mode.
+ * 
+ * @param esp0 the top of the kernel stack
+*/
+void tss_set_kernel_stack(uint32_t esp0);
+
+/**
+ * Sets up a new stack so that switching to it calls entry(arg) with interrupts
+ * disabled.
+ * 
+ * @param stack_top the top of the stack
+ * @param entry the function to start in, which must not return
+ * @param arg the argument given to entry
+ * 
+ * @return the stack pointer to give to switch_context()
+*/
+static inline uint32_t context_init_stack(void* stack_top, void (*entry)(void*), void* arg)
+{
+	uint32_t* sp = (uint32_t*) stack_top;
+
+	*--sp = (uint32_t) arg;
+	*--sp = 0;						/* entry's return address */
+	*--sp = (uint32_t) entry;		/* switch_context()'s return address */
+	*--sp = 0;						/* ebp */
+	*--sp = 0;						/* ebx */
+	*--sp = 0;						/* esi */
+	*--sp = 0;						/* edi */
+	*--sp = EFLAGS_RESERVED;
+
+	return (uint32_t) sp;
+}
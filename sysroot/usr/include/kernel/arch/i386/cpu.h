@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+/* CPUID leaf 1 EDX feature bits */
+#define CPUID_EDX_TSC		(1 << 4)
+#define CPUID_EDX_MSR		(1 << 5)
+#define CPUID_EDX_APIC		(1 << 9)
+#define CPUID_EDX_FXSR		(1 << 24)
+#define CPUID_EDX_SSE		(1 << 25)
+#define CPUID_EDX_SSE2		(1 << 26)
+
+
+typedef struct cpu_info_s {
+	char vendor[13];
+	uint32_t max_leaf;
+	uint32_t features_ecx;		/* CPUID leaf 1 ECX */
+	uint32_t features_edx;		/* CPUID leaf 1 EDX */
+} cpu_info_t;
+
+extern cpu_info_t cpu_info;
+
+
+/**
+ * Executes the CPUID instruction.
+ * 
+ * @param leaf the leaf to query
+ * @param eax where EAX is stored
+ * @param ebx where EBX is stored
+ * @param ecx where ECX is stored
+ * @param edx where EDX is stored
+*/
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx)
+{
+	asm volatile("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (0));
+}
+
+/**
+ * Reads a Model Specific Register.
+ * 
+ * @param msr the register
+ * 
+ * @return the value of the register
+*/
+static inline uint64_t rdmsr(uint32_t msr)
+{
+	uint32_t low, high;
+	asm volatile("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+	return ((uint64_t) high << 32) | low;
+}
+
+/**
+ * Writes a Model Specific Register.
+ * 
+ * @param msr the register
+ * @param value the value to write
+*/
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+	asm volatile("wrmsr" : : "c" (msr), "a" ((uint32_t) value), "d" ((uint32_t) (value >> 32)));
+}
+
+/**
+ * Detects the features of the CPU and picks the implementations that depend on them.
+*/
+void cpu_init(void);
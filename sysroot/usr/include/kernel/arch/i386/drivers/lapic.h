@@ -0,0 +1,107 @@
+#pragma once
+
+#include <kernel/time/timer.h>
+
+/* Must be defined: phys_addr_t */
+#include <kernel/arch/i386/paging.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Interrupt vectors, after the PIC's */
+#define LAPIC_TIMER_VECTOR		48
+#define LAPIC_TLB_VECTOR		49		/* TLB shootdowns, see tlb_batch_flush() */
+#define LAPIC_RESCHED_VECTOR	50		/* Wakes a CPU up to run a thread placed on it, see thread_wake() */
+#define LAPIC_SPURIOUS_VECTOR	63		/* The low 4 bits must be set on older CPUs */
+
+/**
+ * 	Maps and enables the local APIC of the current CPU.
+ * 
+ * 	@return true if the CPU has a local APIC, false otherwise
+*/
+bool lapic_init(void);
+
+/**
+ * 	Returns true if lapic_init() succeeded.
+ * 
+ * 	@return true if the local APIC is mapped, false otherwise
+*/
+bool lapic_available(void);
+
+/**
+ * 	Sends an EOI to the local APIC.
+*/
+void lapic_eoi(void);
+
+/**
+ * 	Returns the ID of the current CPU's local APIC.
+ * 
+ * 	@return the local APIC ID
+*/
+uint32_t lapic_id(void);
+
+/**
+ * 	Sends an INIT IPI, which resets another CPU into its wait-for-SIPI state.
+ * 
+ * 	@param apic_id the local APIC ID of the CPU
+ * 
+ * 	@return true if the IPI was delivered, false if it timed out
+*/
+bool lapic_send_init(uint32_t apic_id);
+
+/**
+ * 	Sends a STARTUP IPI, which starts a CPU in real mode at the given address.
+ * 
+ * 	@param apic_id the local APIC ID of the CPU
+ * 	@param addr the address, page aligned and below 1MB
+ * 
+ * 	@return true if the IPI was delivered, false if it timed out
+*/
+bool lapic_send_startup(uint32_t apic_id, phys_addr_t addr);
+
+/**
+ * 	Sends an interrupt to every CPU but the current one.
+ * 
+ * 	@param vector the interrupt vector
+ * 
+ * 	@return true if the IPI was delivered, false if it timed out
+*/
+bool lapic_send_ipi_others(uint8_t vector);
+
+/**
+ * 	Sends an interrupt to one CPU.
+ * 
+ * 	@param apic_id the local APIC ID of the CPU
+ * 	@param vector the interrupt vector
+ * 
+ * 	@return true if the IPI was delivered, false if it timed out
+*/
+bool lapic_send_ipi_to(uint32_t apic_id, uint8_t vector);
+
+/**
+ * 	Starts the local APIC timer counting down from its maximum, without raising
+ * 	an interrupt, to measure its frequency.
+*/
+void lapic_timer_calibrate_start(void);
+
+/**
+ * 	Stops the count started by lapic_timer_calibrate_start().
+ * 
+ * 	@return the number of timer ticks that have elapsed
+*/
+uint32_t lapic_timer_calibrate_end(void);
+
+/**
+ * 	Sets up the local APIC timer as a one-shot clock event device.
+ * 
+ * 	@param freq the frequency of the timer in Hz, as measured by the calibration
+ * 
+ * 	@return the clock event device
+*/
+clock_event_t* lapic_clock_event_init(uint32_t freq);
+
+/**
+ * 	Puts the current CPU's local APIC timer in one-shot mode, for the CPUs started
+ * 	after lapic_clock_event_init(), which all share its clock event device.
+*/
+void lapic_timer_setup(void);
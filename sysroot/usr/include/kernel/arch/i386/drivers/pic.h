@@ -14,6 +14,13 @@ void pic_init(void);
 */
 void pic_set_mask(uint16_t mask);
 
+/**
+ * 	Unmasks a single IRQ, leaving the others as they are.
+ * 
+ * 	@param irq the IRQ to unmask
+*/
+void pic_unmask_irq(uint8_t irq);
+
 /**
  * 	Sends a EOI to the PIC.
  * 
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <kernel/time/timer.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The frequency of the PIT's input clock */
+#define PIT_FREQUENCY	1193182
+
+/**
+ * 	Sets up channel 0 of the PIT as a one-shot clock event device and unmasks IRQ0.
+ * 
+ * 	Only used when there's no local APIC timer, as each event takes several slow
+ * 	port writes and can't be more than 55ms away.
+ * 
+ * 	@return the clock event device
+*/
+clock_event_t* pit_clock_event_init(void);
+
+/**
+ * 	Starts channel 2 of the PIT counting down, without raising an interrupt.
+ * 
+ * 	Used to calibrate the other timers against the PIT's known frequency.
+ * 
+ * 	@param count the number of PIT ticks to count
+*/
+void pit_channel2_start(uint16_t count);
+
+/**
+ * 	Returns true once channel 2 has counted down to 0.
+ * 
+ * 	@return true if the count started by pit_channel2_start() has elapsed
+*/
+bool pit_channel2_done(void);
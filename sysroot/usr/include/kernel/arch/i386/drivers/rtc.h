@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * 	Reads the date and time from the CMOS Real-Time Clock.
+ * 
+ * 	The RTC is assumed to be kept in UTC.
+ * 
+ * 	@return the number of seconds since the Unix epoch
+*/
+uint64_t rtc_read_time(void);
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CR0_MP				(1 << 1)	/* wait/fwait also trap when TS is set */
+#define CR0_EM				(1 << 2)	/* Emulate the FPU, must be clear to use SSE */
+#define CR0_TS				(1 << 3)	/* The next FPU/SSE instruction raises #NM */
+#define CR0_NE				(1 << 5)	/* Report FPU errors as exceptions */
+
+#define CR4_OSFXSR			(1 << 9)	/* fxsave/fxrstor save the SSE state and SSE is enabled */
+#define CR4_OSXMMEXCPT		(1 << 10)	/* Report SIMD floating-point errors as #XM */
+
+#define FPU_STATE_SIZE		512			/* The size of the fxsave area */
+#define FPU_STATE_ALIGN		16
+
+#define MXCSR_DEFAULT		0x1F80		/* All SIMD exceptions masked */
+
+struct thread_s;
+
+
+/**
+ * Enables the FPU and SSE if the CPU supports fxsave.
+ * 
+ * Called by cpu_init(), before any thread exists.
+*/
+void fpu_enable(void);
+
+/**
+ * Sets up the lazy saving of the FPU state, which needs the slab allocator.
+*/
+void fpu_init(void);
+
+/**
+ * Enables the FPU and SSE on a CPU started after fpu_init(), which doesn't own
+ * the registers until a thread uses them.
+*/
+void fpu_init_cpu(void);
+
+/**
+ * Arms CR0.TS if the thread being switched to doesn't own the FPU registers,
+ * so its first FPU/SSE instruction traps and loads its state.
+ * 
+ * @param next the thread being switched to
+*/
+void fpu_switch(struct thread_s* next);
+
+/**
+ * Handles #NM, giving the FPU registers to the current thread.
+*/
+void fpu_handle_nm(void);
+
+/**
+ * Releases the FPU state of a thread that exited.
+ * 
+ * @param thread the thread
+*/
+void fpu_release(struct thread_s* thread);
+
+
+/**
+ * Returns true if the kernel can use the FPU/SSE registers right now, which
+ * isn't the case in an interrupt handler that interrupted kernel_fpu_begin().
+ * 
+ * @return true if kernel_fpu_begin() may be called
+*/
+bool kernel_fpu_usable(void);
+
+/**
+ * Lets the kernel use the FPU/SSE registers, saving the state of the thread
+ * that owns them. Preemption is disabled until kernel_fpu_end().
+ * 
+ * Must only be called if kernel_fpu_usable() returns true.
+*/
+void kernel_fpu_begin(void);
+
+/**
+ * Ends the use of the FPU/SSE registers by the kernel.
+*/
+void kernel_fpu_end(void);
+
+
+static inline uint32_t read_cr0(void)
+{
+	uint32_t cr0;
+	asm volatile("mov %0, cr0" : "=r" (cr0));
+	return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0)
+{
+	asm volatile("mov cr0, %0" : : "r" (cr0) : "memory");
+}
+
+/* Clears CR0.TS */
+static inline void clts(void)
+{
+	asm volatile("clts" : : : "memory");
+}
+
+/* Sets CR0.TS */
+static inline void stts(void)
+{
+	write_cr0(read_cr0() | CR0_TS);
+}
+
+
+/**
+ * Zeroes a page with non-temporal SSE2 stores, which don't bring it into the cache.
+ * 
+ * Must be called between kernel_fpu_begin() and kernel_fpu_end().
+ * 
+ * @param addr the page, 16-byte aligned
+ * @param size the size of the page, a multiple of 64
+*/
+static inline void sse2_clear_page(void* addr, uint32_t size)
+{
+	/* The kernel is built without SSE, so xmm0 can't be listed as clobbered, nor is it used by the compiler */
+	asm volatile(
+		"pxor xmm0, xmm0\n\t"
+		"1:\n\t"
+		"movntdq [%0], xmm0\n\t"
+		"movntdq [%0 + 16], xmm0\n\t"
+		"movntdq [%0 + 32], xmm0\n\t"
+		"movntdq [%0 + 48], xmm0\n\t"
+		"add %0, 64\n\t"
+		"sub %1, 64\n\t"
+		"jnz 1b\n\t"
+		"sfence"
+		: "+r" (addr), "+r" (size) : : "memory", "cc");
+}
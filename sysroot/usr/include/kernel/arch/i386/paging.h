@@ -1,19 +1,60 @@
 #pragma once
 
+#include <kernel/ds/list.h>
+
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 #define PAGE_SIZE				4096
 
 #define PD_ALIGNMENT			4096
 #define PT_ALIGNMENT			4096
 
+/*
+ * With CONFIG_X86_PAE (make PAE=1) the tables have 512 64-bit entries, and
+ * 4 page directories, contiguous in memory, are pointed to by a page directory
+ * pointer table. PDE indexes below span the 4 directories, so they work the
+ * same in both modes.
+*/
+#ifdef CONFIG_X86_PAE
+
+#define PDE_SIZE				8
+#define PD_NUM_ENTRIES			512
+#define NUM_PDS					4
+#define PDPT_ALIGNMENT			32
+
+#define PTE_SIZE				8
+#define PT_NUM_ENTRIES 			512
+
+#define PHYS_ADDR_MASK			0x000FFFFFFFFFF000ULL
+
+typedef uint64_t pde_t;
+typedef uint64_t pte_t;
+typedef uint64_t pdpte_t;
+
+/* Physical addresses can be above 4GB */
+typedef uint64_t phys_addr_t;
+
+#else
+
 #define PDE_SIZE				4
 #define PD_NUM_ENTRIES			1024
-#define PD_SIZE					(PDE_SIZE * PD_NUM_ENTRIES)
+#define NUM_PDS					1
 
 #define PTE_SIZE				4
 #define PT_NUM_ENTRIES 			1024
+
+#define PHYS_ADDR_MASK			0xFFFFF000UL
+
+typedef uint32_t pde_t;
+typedef uint32_t pte_t;
+
+typedef uintptr_t phys_addr_t;
+
+#endif
+
+#define PD_SIZE					(PDE_SIZE * PD_NUM_ENTRIES)
 #define PT_SIZE 				(PTE_SIZE * PT_NUM_ENTRIES)
 #define PT_ADDRESSABLE_RANGE	(PT_NUM_ENTRIES * PAGE_SIZE)
 
@@ -22,8 +63,8 @@
 
 #define ADDR_TO_PTE_INDEX(a)	(((a) % PT_ADDRESSABLE_RANGE) / PAGE_SIZE)
 
-#define PDE_ADDR_FIELD(pde) 	((pde) & 0xFFFFF000)
-#define PTE_ADDR_FIELD(pte)		((unsigned long) (pte) & 0xFFFFF000)
+#define PDE_ADDR_FIELD(pde) 	((pde) & PHYS_ADDR_MASK)
+#define PTE_ADDR_FIELD(pte)		((phys_addr_t) (pte) & PHYS_ADDR_MASK)
 
 #define PDE(a,f)				((a) | (f))
 #define PTE(a,f)				((a) | (f))
@@ -55,6 +96,10 @@
  * 	bit 2      - User/Supervisor
  * 	bit 1      - Read/Write
  * 	bit 0      - Present
+ * 
+ * With PAE, entries are 64 bits wide, bits 51:12 hold the address and bit 63
+ * is Execute Disable. The 4 page directory pointer table entries only have the
+ * Present, Write through and Cache disable bits.
 */
 
 /* PDE/PTE Flags */
@@ -66,8 +111,16 @@
 #define PAGE_ACCESSED 		(1 << 5)
 #define PAGE_DIRTY 			(1 << 6)
 #define PAGE_PAT			(1 << 7)	/* Page Attribute Table */
+#define PAGE_LARGE			(1 << 7)	/* The PDE maps a 4MB (2MB with PAE) page */
 #define PAGE_GLOBAL			(1 << 8)
 
+/* Page fault error code bits */
+#define PF_ERR_PRESENT		(1 << 0)	/* Set for protection violations, clear for non-present pages */
+#define PF_ERR_WRITE		(1 << 1)	/* The access was a write */
+#define PF_ERR_USER			(1 << 2)	/* The access was made in user mode */
+#define PF_ERR_RSVD			(1 << 3)	/* A reserved bit was set in a paging structure */
+#define PF_ERR_FETCH		(1 << 4)	/* The access was an instruction fetch */
+
 /**
  * Invalidates a page from the TLB.
  * 
@@ -76,3 +129,176 @@
 static inline void tlb_invalidate_page(unsigned long addr) {
 	asm volatile("invlpg [%0]" :: "r" (addr));
 }
+
+/**
+ * Invalidates every non-global page from the TLB by reloading CR3.
+*/
+static inline void tlb_flush_all(void) {
+	unsigned long cr3;
+	asm volatile("mov %0, cr3" : "=r" (cr3));
+	asm volatile("mov cr3, %0" :: "r" (cr3) : "memory");
+}
+
+#define CR4_PGE				(1 << 7)
+
+/**
+ * Invalidates every page from the TLB, including global ones, by toggling CR4.PGE.
+*/
+static inline void tlb_flush_global(void) {
+	unsigned long cr4;
+	asm volatile("mov %0, cr4" : "=r" (cr4));
+	asm volatile("mov cr4, %0" :: "r" (cr4 & ~CR4_PGE) : "memory");
+	asm volatile("mov cr4, %0" :: "r" (cr4) : "memory");
+}
+
+
+/* Past this many pages, flushing the whole TLB is cheaper than an invlpg per page */
+#define TLB_BATCH_SIZE		32
+
+/**
+ * Gathers the TLB invalidations of a series of page table changes, so they're
+ * done at once by tlb_batch_flush().
+*/
+typedef struct tlb_batch_s {
+	uintptr_t addrs[TLB_BATCH_SIZE];
+	unsigned int num_addrs;
+	bool flush_all;			/* More than TLB_BATCH_SIZE pages were added */
+	bool global;			/* Global pages were added, which reloading CR3 doesn't flush */
+	list_t frames;			/* Page frames to free once the TLB is flushed */
+} tlb_batch_t;
+
+struct page_s;
+
+/* The kernel's page directories, contiguous and preallocated in boot.S */
+extern pde_t kernel_page_directory[];
+
+
+/**
+ * Initializes the pool page tables are allocated from.
+*/
+void paging_init(void);
+
+
+/**
+ * Initializes an empty TLB batch.
+ * 
+ * @param batch the batch
+*/
+void tlb_batch_init(tlb_batch_t* batch);
+
+/**
+ * Adds a page whose entry changed to a TLB batch.
+ * 
+ * @param batch the batch
+ * @param vaddr the virtual address of the page
+ * @param old_pte the page's previous entry
+*/
+void tlb_batch_add(tlb_batch_t* batch, uintptr_t vaddr, pte_t old_pte);
+
+/**
+ * Adds a page frame to be freed once a TLB batch is flushed, as stale TLB
+ * entries may still point to it until then.
+ * 
+ * @param batch the batch
+ * @param page the page frame
+*/
+void tlb_batch_free_frame(tlb_batch_t* batch, struct page_s* page);
+
+/**
+ * Invalidates the pages of a TLB batch, with a single TLB flush if there are
+ * more than TLB_BATCH_SIZE, and frees its page frames. The batch is left empty.
+ * 
+ * Once the other CPUs are started, they're sent the invalidations too, and the
+ * frames are only freed after they've all done them. As the caller waits for
+ * them, it must not hold a lock they may spin on with interrupts disabled.
+ * 
+ * @param batch the batch
+*/
+void tlb_batch_flush(tlb_batch_t* batch);
+
+/**
+ * Does the invalidations sent to the current CPU by tlb_batch_flush(), if any.
+ * 
+ * Called by the TLB shootdown interrupt handler.
+*/
+void tlb_shootdown_interrupt(void);
+
+
+/**
+ * Returns the page table entry of a virtual address.
+ * 
+ * @param pd the page directory
+ * @param vaddr the virtual address
+ * @param create true to allocate the page table if it doesn't exist
+ * 
+ * @return the entry or NULL if the page table doesn't exist and couldn't be created
+*/
+pte_t* paging_walk(pde_t* pd, uintptr_t vaddr, bool create);
+
+/**
+ * Maps a range of contiguous page frames, allocating page tables as needed.
+ * 
+ * @param pd the page directory
+ * @param vaddr the virtual address of the first page
+ * @param paddr the physical address of the first page frame
+ * @param num_pages the number of pages
+ * @param flags the PTE flags
+ * @param batch the batch the replaced mappings are added to
+ * 
+ * @return 0 on success or -1 if a page table couldn't be allocated
+*/
+int paging_map_range(pde_t* pd, uintptr_t vaddr, phys_addr_t paddr, size_t num_pages, unsigned int flags, tlb_batch_t* batch);
+
+/**
+ * Unmaps a range of pages, skipping the ones that aren't mapped.
+ * 
+ * @param pd the page directory
+ * @param vaddr the virtual address of the first page
+ * @param num_pages the number of pages
+ * @param free_frames true to free the page frames once the batch is flushed
+ * @param batch the batch the unmapped pages are added to
+*/
+void paging_unmap_range(pde_t* pd, uintptr_t vaddr, size_t num_pages, bool free_frames, tlb_batch_t* batch);
+
+/**
+ * Changes the flags of a range of mapped pages, skipping the ones that aren't mapped.
+ * 
+ * @param pd the page directory
+ * @param vaddr the virtual address of the first page
+ * @param num_pages the number of pages
+ * @param flags the new PTE flags
+ * @param batch the batch the changed pages are added to
+*/
+void paging_protect_range(pde_t* pd, uintptr_t vaddr, size_t num_pages, unsigned int flags, tlb_batch_t* batch);
+
+
+/**
+ * Maps a page in kernel space above low memory, using the page tables preallocated at boot.
+ * 
+ * Only the current CPU's TLB is invalidated if the page was mapped, so replacing
+ * a mapping other CPUs may use must go through a TLB batch.
+ * 
+ * @param vaddr the virtual address of the page, above the low memory direct map
+ * @param paddr the physical address of the page frame
+ * @param flags the PTE flags
+*/
+void paging_map_kernel_page(uintptr_t vaddr, phys_addr_t paddr, unsigned int flags);
+
+/**
+ * Unmaps a page in kernel space and invalidates it from the TLB.
+ * 
+ * Only the current CPU's TLB is invalidated, so it's meant for mappings no other
+ * CPU uses, like the kmap_atomic() slots. Others must be unmapped with a TLB batch.
+ * 
+ * @param vaddr the virtual address of the page, above the low memory direct map
+*/
+void paging_unmap_kernel_page(uintptr_t vaddr);
+
+/**
+ * Returns the physical address a page in kernel space is mapped to.
+ * 
+ * @param vaddr the virtual address of the page, above the low memory direct map
+ * 
+ * @return the physical address of the page frame or 0 if the page isn't mapped
+*/
+phys_addr_t paging_kernel_page_phys(uintptr_t vaddr);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* The selector of the per-CPU data segment, which gs holds in kernel mode */
+#define PERCPU_SELECTOR		(6 * 8)		/* Must match gdt.S and isr.S */
+
+
+/*
+ * The data local to a CPU. Each CPU's GDT has a data segment whose base is that
+ * CPU's area, so it's read through gs without having to know the CPU's ID first.
+*/
+typedef struct cpu_local_s {
+	struct cpu_local_s* self;		/* gs-relative accesses can't take the area's address */
+	unsigned int id;
+	uint32_t apic_id;
+} cpu_local_t;
+
+extern cpu_local_t cpu_locals[];
+
+
+/**
+ * Returns the ID of the current CPU from its per-CPU area.
+ * 
+ * @return the ID of the current CPU
+*/
+static inline unsigned int percpu_read_id(void)
+{
+	unsigned int id;
+	asm volatile("mov %0, gs:[%c1]" : "=r" (id) : "i" (offsetof(cpu_local_t, id)));
+	return id;
+}
+
+/**
+ * Returns the per-CPU area of the current CPU.
+ * 
+ * @return the per-CPU area
+*/
+static inline cpu_local_t* percpu_self(void)
+{
+	cpu_local_t* self;
+	asm volatile("mov %0, gs:[%c1]" : "=r" (self) : "i" (offsetof(cpu_local_t, self)));
+	return self;
+}
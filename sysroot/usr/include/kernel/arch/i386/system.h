@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define BOCHS_MAGIC_BREAKPOINT	{ asm volatile("xchg bx, bx"::); }
 
 #define IRQ_OFF { asm volatile ("cli"); }
@@ -7,3 +10,70 @@
 
 #define HALT 	{ asm volatile ("hlt"); }
 #define STOP 	{ while(1) HALT; }
+
+/**
+ * Disables interrupts, returning whether they were enabled.
+ * 
+ * @return the flags register before interrupts were disabled
+*/
+static inline uint32_t irq_save(void)
+{
+	uint32_t flags;
+	asm volatile("pushfd\n\t" "pop %0\n\t" "cli" : "=r" (flags) : : "memory");
+	return flags;
+}
+
+/**
+ * Restores the interrupt flag saved by irq_save().
+ * 
+ * @param flags the flags returned by irq_save()
+*/
+static inline void irq_restore(uint32_t flags)
+{
+	asm volatile("push %0\n\t" "popfd" : : "r" (flags) : "memory", "cc");
+}
+
+/**
+ * Returns true if interrupts are enabled.
+ * 
+ * @return true if the interrupt flag is set, false otherwise
+*/
+static inline bool irqs_enabled(void)
+{
+	uint32_t flags;
+	asm volatile("pushfd\n\t" "pop %0" : "=r" (flags));
+	return flags & (1 << 9);
+}
+
+/**
+ * Hints the CPU that it's spinning on a lock, which saves power and avoids the
+ * pipeline flush when the loop exits.
+*/
+static inline void cpu_relax(void)
+{
+	asm volatile("pause" : : : "memory");
+}
+
+/**
+ * Reads the Time Stamp Counter.
+ * 
+ * @return the number of cycles since the processor was reset
+*/
+static inline uint64_t rdtsc(void)
+{
+	uint32_t low, high;
+	asm volatile("rdtsc" : "=a" (low), "=d" (high));
+	return ((uint64_t) high << 32) | low;
+}
+
+/**
+ * Reads CR2, which holds the address that caused the last page fault.
+ * 
+ * @return the faulting address
+*/
+static inline uintptr_t read_cr2(void)
+{
+	uintptr_t cr2;
+	asm volatile("mov %0, cr2" : "=r" (cr2));
+	return cr2;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Boot-time benchmarks.
+ * 
+ * They are only built when KERNEL_BENCH is defined (make BENCH=1).
+*/
+
+#ifdef KERNEL_BENCH
+
+/**
+ * Runs all the benchmarks, printing their results.
+*/
+void bench_run_all(void);
+
+/**
+ * Prints the result of a benchmark.
+ * 
+ * @param name the name of the benchmark
+ * @param cycles the number of cycles the benchmark took
+ * @param num_ops the number of operations done in that time
+*/
+void bench_report(const char* name, uint64_t cycles, unsigned long num_ops);
+
+
+/**
+ * Compares the buddy allocator against the bitmap allocator.
+*/
+void bench_page_alloc(void);
+
+/**
+ * Reports the internal fragmentation of each kmalloc size class, compared to
+ * power of 2 classes, and times kmalloc/kfree.
+*/
+void bench_kmalloc(void);
+
+/**
+ * Compares allocating and freeing objects one at a time against the bulk API.
+*/
+void bench_slab_bulk(void);
+
+/**
+ * Times kmap_atomic() and kmap() on high memory pages.
+*/
+void bench_kmap(void);
+
+/**
+ * Compares random accesses over up to 256MB of low memory through the global large
+ * page direct map against 4KB mappings, with and without CR3 reloads in between.
+*/
+void bench_tlb(void);
+
+/**
+ * Compares unmapping pages with an invlpg each against a batched TLB flush.
+*/
+void bench_tlb_batch(void);
+
+/**
+ * Compares zeroed page allocations with and without the pool of pre-zeroed pages.
+*/
+void bench_zero_pool(void);
+
+/**
+ * Times memcpy(), memmove() and memset() over a range of buffer sizes.
+*/
+void bench_mem(void);
+
+/**
+ * Compares the string functions against byte-at-a-time loops on names and paths.
+*/
+void bench_string(void);
+
+/**
+ * Compares eagerly mapped vmalloc buffers against demand-zero ones.
+*/
+void bench_page_fault(void);
+
+/**
+ * Times switching between two threads and creating short-lived ones.
+*/
+void bench_context_switch(void);
+
+/**
+ * Times kernel_fpu_begin()/kernel_fpu_end() and compares zeroing pages with
+ * memset() against SSE2 non-temporal stores.
+*/
+void bench_fpu(void);
+
+/**
+ * Measures how late threads are woken up from short sleeps.
+*/
+void bench_wakeup_latency(void);
+
+/**
+ * Times the uncontended spinlock, reader-writer lock and mutex operations, and
+ * a mutex handed back and forth between two threads.
+*/
+void bench_locks(void);
+
+#endif
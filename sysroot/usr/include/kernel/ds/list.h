@@ -1,5 +1,7 @@
 #pragma once
 
+#include <kernel/utils.h>
+
 #include <stddef.h>
 #include <stdbool.h>
 
@@ -16,12 +18,36 @@
 /* Clears all entries from a list */
 #define LIST_CLEAR(list)	({ ((list_t) (list)).next = ((list_t) (list)).prev = &(list); })
 
+/* Returns the struct of the given type that contains the entry as the given member */
+#define LIST_ENTRY(entry,type,member)	CONTAINER_OF(entry, type, member)
+
+/* Iterates over the structs of a list, pos being a pointer to the struct type */
+#define LIST_FOR_EACH_ENTRY(pos,head,member) \
+	for (pos = LIST_ENTRY((head)->next, __typeof__(*pos), member); \
+		&pos->member != (head); \
+		pos = LIST_ENTRY(pos->member.next, __typeof__(*pos), member))
+
+/* Iterates over the structs of a list, allowing pos to be removed from it */
+#define LIST_FOR_EACH_ENTRY_SAFE(pos,next_pos,head,member) \
+	for (pos = LIST_ENTRY((head)->next, __typeof__(*pos), member), \
+		next_pos = LIST_ENTRY(pos->member.next, __typeof__(*pos), member); \
+		&pos->member != (head); \
+		pos = next_pos, next_pos = LIST_ENTRY(next_pos->member.next, __typeof__(*pos), member))
+
 
 typedef struct list_s {
 	struct list_s *prev, *next;
 } list_t;
 
 
+/**
+ * Adds a new entry to the start of a list.
+ * 
+ * @param head the head of the list
+ * @param new the new entry to be added
+*/
+void list_add_first(list_t* head, list_t* new);
+
 /**
  * Adds a new entry to the end of a list.
  * 
@@ -42,6 +68,8 @@ list_t* list_remove_first(list_t* head);
 /**
  * Removes a specific entry from a list.
  * 
+ * The list is searched for the entry, use list_del() if it's known to be in it.
+ * 
  * @param head the head of the list
  * @param entry the entry to be removed
  * 
@@ -49,6 +77,21 @@ list_t* list_remove_first(list_t* head);
 */
 list_t* list_remove(list_t* head, list_t* entry);
 
+/**
+ * Removes an entry from the list it's in, in constant time.
+ * 
+ * @param entry the entry to be removed
+*/
+void list_del(list_t* entry);
+
+/**
+ * Moves all entries of a list to the end of another.
+ * 
+ * @param head the head of the list to move the entries to
+ * @param list the list to move the entries from, left empty
+*/
+void list_splice_last(list_t* head, list_t* list);
+
 /**
  * Runs a function in each element of a list.
  * 
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+
+/* Page fault types */
+#define PF_DEMAND_ZERO		0	/* A page of a lazily mapped area was touched for the first time */
+#define PF_SPURIOUS			1	/* The page was already mapped, e.g. through a stale TLB entry */
+#define PF_PROTECTION		2	/* The access isn't allowed by the page's protection */
+#define PF_BAD_ADDRESS		3	/* The address isn't in any area */
+#define NUM_PF_TYPES		4
+
+
+/**
+ * Handles a page fault, mapping a zeroed page if the address belongs to a lazily
+ * mapped area.
+ * 
+ * Faults that can't be resolved cause a kernel panic.
+ * 
+ * @param addr the faulting address
+ * @param error_code the error code pushed by the CPU
+*/
+void page_fault_handler(uintptr_t addr, unsigned int error_code);
+
+/**
+ * Prints the number of page faults of each type and how long they took to handle.
+*/
+void page_fault_print_stats(void);
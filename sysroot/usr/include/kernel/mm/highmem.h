@@ -0,0 +1,60 @@
+#pragma once
+
+#include <kernel/mm/mm.h>
+#include <kernel/mm/vmalloc.h>
+#include <kernel/smp.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* The window where kmap() maps high memory pages, right after the vmalloc range */
+#define PKMAP_BASE			VMALLOC_END
+#define LAST_PKMAP			1024
+#define PKMAP_ADDR(nr)		(PKMAP_BASE + (nr) * PAGE_SIZE)
+#define PKMAP_NR(v)			(((uintptr_t) (v) - PKMAP_BASE) / PAGE_SIZE)
+
+/* The per-CPU slots where kmap_atomic() maps pages, right after the pkmap window */
+#define FIXMAP_BASE			PKMAP_ADDR(LAST_PKMAP)
+#define KM_TYPE_NR			16		/* The number of nested atomic mappings per CPU */
+#define FIXMAP_ADDR(cpu,i)	(FIXMAP_BASE + ((cpu) * KM_TYPE_NR + (i)) * PAGE_SIZE)
+#define FIXMAP_END			FIXMAP_ADDR(MAX_CPUS, 0)
+
+#define PageHighMem(page)	(page_to_pfn(page) >= HIGH_MEM_PFN)
+
+
+/**
+ * Maps a page into kernel space until kunmap() is called.
+ * 
+ * Low memory pages are always mapped, so their direct mapping is returned.
+ * 
+ * @param page the page
+ * 
+ * @return the virtual address of the page
+*/
+void* kmap(page_t* page);
+
+/**
+ * Releases a mapping made by kmap().
+ * 
+ * @param page the page
+*/
+void kunmap(page_t* page);
+
+/**
+ * Maps a page into one of the current CPU's slots, for short uses.
+ * 
+ * Mappings are nested, and must be released in reverse order with kunmap_atomic().
+ * 
+ * @param page the page
+ * 
+ * @return the virtual address of the page
+*/
+void* kmap_atomic(page_t* page);
+
+/**
+ * Releases the last mapping made by kmap_atomic().
+ * 
+ * @param vaddr the virtual address returned by kmap_atomic()
+*/
+void kunmap_atomic(void* vaddr);
@@ -11,6 +11,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 extern char _kernel_offset;
 
@@ -23,28 +24,88 @@ extern char _kernel_offset;
 typedef struct page_s
 {
 	list_t list;
+	unsigned int flags;
 
 	union {
 		struct {
 			void* cache;
 			void* slab;
 		};
+		unsigned int order;		/* Order of the free block headed by this page */
 	};
+
+	/*
+	 * The pkmap slot of a high memory page while PG_KMAPPED is set. Kept out of the
+	 * union, as the mapping is cached after kunmap() and outlives the allocation.
+	*/
+	unsigned int pkmap_nr;
 } page_t;
 
+/* Page flags */
+#define PG_BUDDY	(1 << 0)	/* The page heads a free block of the buddy allocator */
+#define PG_KMAPPED	(1 << 1)	/* The high memory page is mapped by kmap() */
+
 
 #define HIGH_MEM_START		(896 * (1 << 20))	/* 896MB */
 #define HIGH_MEM_PFN		(HIGH_MEM_START / PAGE_SIZE)
 
-page_t* mem_map;
-size_t mem_map_length;
 
-#define phys_to_page(p)		((page_t*) (mem_map + ((uintptr_t)(p)) / PAGE_SIZE))
-#define virt_to_page(v)		((page_t*) (phys_to_page(V2P((uintptr_t)(v)))))
+/*
+ * Sparse memory model: physical memory is split into sections, and page_t arrays
+ * are only created for the sections that have available memory.
+ * Sections are larger than the buddy allocator's largest block, so a block and
+ * its buddy are always in the same section.
+*/
+#define SECTION_SHIFT		27
+#define SECTION_SIZE		(1UL << SECTION_SHIFT)		/* 128MB */
+#define PAGES_PER_SECTION	(SECTION_SIZE / PAGE_SIZE)
+
+#ifdef CONFIG_X86_PAE
+#define MAX_PHYSMEM_BITS	36
+#else
+#define MAX_PHYSMEM_BITS	32
+#endif
+
+#define SECTIONS_BITS		(MAX_PHYSMEM_BITS - SECTION_SHIFT)
+#define NUM_SECTIONS		(1UL << SECTIONS_BITS)
+
+/* The section number of a page is kept in the top bits of its flags */
+#define PG_SECTION_SHIFT	(32 - SECTIONS_BITS)
+
+/*
+ * The page_t array of each section, minus the section's first page frame number,
+ * so it can be indexed with the page frame number directly. NULL if the section
+ * has no memory.
+*/
+extern page_t* mem_section[NUM_SECTIONS];
+
+/* One past the last page frame number */
+extern unsigned long max_pfn;
+
+#define pfn_to_section_nr(pfn)		((unsigned long) (pfn) / PAGES_PER_SECTION)
+#define page_to_section_nr(page)	((page)->flags >> PG_SECTION_SHIFT)
+
+#define pfn_valid(pfn)		((pfn) < max_pfn && mem_section[pfn_to_section_nr(pfn)] != NULL)
+
+#define pfn_to_page(pfn)	((page_t*) (mem_section[pfn_to_section_nr(pfn)] + (pfn)))
+#define page_to_pfn(page)	((unsigned long) ((page) - mem_section[page_to_section_nr(page)]))
+
+#define phys_to_page(p)		pfn_to_page(((uintptr_t)(p)) / PAGE_SIZE)
+#define virt_to_page(v)		phys_to_page(V2P((uintptr_t)(v)))
+
+#define page_to_phys(page)	((phys_addr_t) page_to_pfn(page) * PAGE_SIZE)
+
+
+/* Memory zones */
+#define ZONE_NORMAL			0	/* Low memory, permanently mapped by the kernel */
+#define ZONE_HIGHMEM		1	/* Memory above HIGH_MEM_START */
+#define NUM_ZONES			2
 
 
 /* Page allocation flags */
 #define PA_HIGHMEM	(1 << 0)
+#define PA_COLD		(1 << 1)	/* The page won't be touched by the CPU soon (e.g. DMA buffers) */
+#define PA_ZERO		(1 << 2)	/* Zero the pages, single pages are taken pre-zeroed when possible */
 
 #define PA_KERNEL	0
 
@@ -59,9 +120,35 @@ void mm_init(multiboot_info_t* mbi);
 
 /* Page allocation functions */
 
+/**
+ * Allocates a contiguous number of page frames.
+ * 
+ * Unlike alloc_pages(), high memory frames may be above 4GB when PAE is enabled.
+ * 
+ * @param num_pages the number of contiguous pages to allocate
+ * @param flags the allocation flags
+ * 
+ * @return the descriptor of the first page
+*/
+page_t* alloc_frames(size_t num_pages, unsigned char flags);
+
+/**
+ * Frees a contiguous number of page frames.
+ * 
+ * @param page the descriptor of the first page
+ * @param num_pages the number of contiguous pages
+*/
+void free_frames(page_t* page, size_t num_pages);
+
+#define alloc_frame(flags) alloc_frames(1, flags)
+
+#define free_frame(page) free_frames(page, 1)
+
 /**
  * Allocates a contiguous number of pages.
  * 
+ * When PAE is enabled, PA_HIGHMEM is ignored, as high memory may be above 4GB.
+ * 
  * @param num_pages the number of contiguous pages to allocate
  * 
  * @return the address of the first page
@@ -80,6 +167,49 @@ void free_pages(void* page_addr, size_t num_pages);
 
 #define free_page(page_addr) free_pages(page_addr, 1)
 
+/**
+ * Frees a page whose contents aren't expected to be in the CPU's cache.
+ * 
+ * @param page_addr the address of the page
+*/
+void free_page_cold(void* page_addr);
+
+
+/* Per-CPU page list functions */
+
+/**
+ * Sets the watermarks and batch size of the per-CPU page lists.
+ * 
+ * @param low the number of pages at which the lists are refilled
+ * @param high the number of pages at which the lists are drained
+ * @param batch the number of pages moved on each refill or drain
+*/
+void pcp_set_watermarks(unsigned int low, unsigned int high, unsigned int batch);
+
+/**
+ * Prints the counters of the per-CPU page lists.
+*/
+void pcp_print(void);
+
+
+/* Zeroed page pool functions */
+
+/**
+ * Zeroes free pages into the pools of pre-zeroed pages that aren't full.
+ * 
+ * Meant to be called from the idle loop.
+ * 
+ * @param max_pages the maximum number of pages to zero
+ * 
+ * @return true if any page was zeroed, false if there was nothing to do
+*/
+bool zpool_refill(unsigned int max_pages);
+
+/**
+ * Prints the counters of the pools of pre-zeroed pages.
+*/
+void zpool_print(void);
+
 
 
 /* General memory allocation functions */
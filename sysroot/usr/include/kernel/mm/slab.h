@@ -5,6 +5,15 @@
 #include <string.h>
 
 
+/* The size of a line of the L1 data cache */
+#define L1_CACHE_BYTES		64
+
+/* Cache flags */
+#define SLAB_HWCACHE_ALIGN	(1 << 0)	/* Align the objects to L1_CACHE_BYTES */
+#define SLAB_NO_MAGAZINES	(1 << 1)	/* Don't cache the objects in per-CPU magazines */
+#define SLAB_ZERO			(1 << 2)	/* New slabs are zeroed, taking pre-zeroed pages when possible */
+
+
 /**
  * Initializes the slab allocator.
 */
@@ -15,12 +24,15 @@ void kmem_cache_init(void);
  * 
  * @param name the name of the cache
  * @param obj_size the size of the cache's objects
+ * @param align the alignment of the cache's objects, a power of 2 no larger than
+ * a page, or 0 for none
+ * @param flags the cache's SLAB_* flags
  * @param constructor the constructor function for the cache's objects
  * @param destructor the destructor function for the cache's objects
  * 
  * @return the created cache
 */
-struct kmem_cache_s* kmem_cache_create(const char* name, size_t obj_size, void (*constructor)(void*, size_t), void (*destructor)(void*, size_t));
+struct kmem_cache_s* kmem_cache_create(const char* name, size_t obj_size, size_t align, unsigned int flags, void (*constructor)(void*, size_t), void (*destructor)(void*, size_t));
 
 /**
  * Destroys a cache.
@@ -46,6 +58,62 @@ void* kmem_cache_alloc(struct kmem_cache_s* cache);
 */
 void kmem_cache_free(struct kmem_cache_s* cache, void* bufp);
 
+/**
+ * Sets the number of free slabs a cache keeps instead of giving them back to
+ * the page allocator, so it doesn't have to grow again right away.
+ * 
+ * @param cache the cache
+ * @param free_slabs_limit the number of free slabs to keep
+*/
+void kmem_cache_set_free_limit(struct kmem_cache_s* cache, unsigned int free_slabs_limit);
+
+/**
+ * Gives the memory cached by every cache back to the page allocator.
+ * 
+ * Called when memory is low.
+*/
+void kmem_reap(void);
+
+/**
+ * Gives the memory cached by the caches that weren't used since the last call
+ * back to the page allocator.
+ * 
+ * Called periodically by the idle loop of the boot CPU.
+*/
+void kmem_reap_idle(void);
+
+/**
+ * Prints the grow and reap counters of every cache.
+*/
+void kmem_cache_print(void);
+
+/**
+ * Allocates several buffers from a cache.
+ * 
+ * The buffers are taken from the slabs in batches, bypassing the per-CPU magazines,
+ * so each slab is moved between lists at most once.
+ * 
+ * @param cache the cache to allocate the buffers from
+ * @param num_objs the number of buffers to allocate
+ * @param objs the array where the buffers' addresses are stored
+ * 
+ * @return num_objs or 0 if not enough memory could be allocated, in which case
+ * no buffers are allocated
+*/
+size_t kmem_cache_alloc_bulk(struct kmem_cache_s* cache, size_t num_objs, void** objs);
+
+/**
+ * Frees several buffers of a cache.
+ * 
+ * Buffers from the same slab should be next to each other, so the slab is only
+ * moved between lists once.
+ * 
+ * @param cache the cache to free the buffers from
+ * @param num_objs the number of buffers to free
+ * @param objs the buffers
+*/
+void kmem_cache_free_bulk(struct kmem_cache_s* cache, size_t num_objs, void** objs);
+
 /**
  * Allocates a buffer from a cache.
  * 
@@ -63,6 +131,15 @@ void* kmem_alloc(size_t size);
 */
 void kmem_free(void* ptr);
 
+/**
+ * Returns the usable size of a buffer, which is the size of its cache's objects.
+ * 
+ * @param ptr the buffer
+ * 
+ * @return the usable size of the buffer
+*/
+size_t kmem_size(void* ptr);
+
 
 
 /**
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <kernel/mm/mm.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+/* The kernel virtual range where non-contiguous allocations are mapped */
+#define VMALLOC_START		(KERNEL_OFFSET + HIGH_MEM_START)
+#define VMALLOC_END			0xFF800000
+
+#define is_vmalloc_addr(v)	((uintptr_t) (v) >= VMALLOC_START && (uintptr_t) (v) < VMALLOC_END)
+
+
+/**
+ * Initializes the vmalloc allocator.
+*/
+void vmalloc_init(void);
+
+/**
+ * Allocates a virtually contiguous buffer, made of pages that don't need to be
+ * physically contiguous.
+ * 
+ * @param size the size of the buffer
+ * 
+ * @return the page aligned address of the buffer or NULL if size is 0 or the
+ * vmalloc range has no large enough gap
+*/
+void* vmalloc(size_t size);
+
+/**
+ * Reserves a virtually contiguous buffer whose pages are only allocated, and
+ * zeroed, when first touched.
+ * 
+ * @param size the size of the buffer
+ * 
+ * @return the page aligned address of the buffer or NULL if size is 0 or the
+ * vmalloc range has no large enough gap
+*/
+void* vmalloc_lazy(size_t size);
+
+/**
+ * Frees a buffer allocated with vmalloc() or vmalloc_lazy().
+ * 
+ * @param addr the address of the buffer
+*/
+void vfree(void* addr);
+
+/**
+ * Handles a page fault on a non-present page of the vmalloc range.
+ * 
+ * @param addr the faulting address
+ * 
+ * @return the type of the fault, PF_DEMAND_ZERO if a zeroed page was mapped
+*/
+unsigned int vmalloc_fault(uintptr_t addr);
+
+
+/**
+ * Maps device memory into the vmalloc range, uncached.
+ * 
+ * @param paddr the physical address of the memory
+ * @param size the size of the memory
+ * 
+ * @return the virtual address of paddr or NULL if the vmalloc range has no
+ * large enough gap
+*/
+void* ioremap(phys_addr_t paddr, size_t size);
+
+/**
+ * Unmaps device memory mapped by ioremap().
+ * 
+ * @param addr the address returned by ioremap()
+*/
+void iounmap(void* addr);
+
+
+/**
+ * Allocates a buffer with kmalloc() if it's at most a page, or vmalloc() otherwise.
+ * 
+ * @param size the size of the buffer
+ * 
+ * @return the address of the buffer
+*/
+void* kvmalloc(size_t size);
+
+/**
+ * Frees a buffer allocated with kvmalloc().
+ * 
+ * @param addr the address of the buffer
+*/
+void kvfree(void* addr);
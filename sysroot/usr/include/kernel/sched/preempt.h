@@ -0,0 +1,37 @@
+#pragma once
+
+#include <kernel/smp.h>
+
+#ifdef __i386__
+#include <kernel/arch/i386/system.h>
+#endif
+
+
+/* Preemption is disabled while the current CPU's count isn't 0 */
+extern unsigned int preempt_counts[MAX_CPUS];
+
+/* Defined by the scheduler, see sched.h */
+void sched_preempt(void);
+
+
+/**
+ * Disables preemption on the current CPU. Calls can be nested.
+*/
+static inline void preempt_disable(void)
+{
+	preempt_counts[smp_cpu_id()]++;
+	asm volatile("" : : : "memory");
+}
+
+/**
+ * Enables preemption on the current CPU again, switching threads if one was
+ * deferred in the meantime. With interrupts disabled, the switch is left to
+ * the next interrupt handler's exit.
+*/
+static inline void preempt_enable(void)
+{
+	asm volatile("" : : : "memory");
+
+	if (--preempt_counts[smp_cpu_id()] == 0 && irqs_enabled())
+		sched_preempt();
+}
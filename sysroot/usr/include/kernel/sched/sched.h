@@ -0,0 +1,183 @@
+#pragma once
+
+#include <kernel/ds/list.h>
+#include <kernel/time/timer.h>
+#include <kernel/sched/preempt.h>
+#include <kernel/smp.h>
+
+#ifdef __i386__
+#include <kernel/arch/i386/system.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* The frequency of the scheduler's timer tick */
+#define HZ					100
+
+/* Priorities, 0 is the highest */
+#define NUM_PRIORITIES		32
+#define PRIO_HIGH			8
+#define PRIO_DEFAULT		16
+#define PRIO_LOW			24
+
+#define THREAD_STACK_PAGES	2
+
+/* Thread states */
+#define THREAD_RUNNING		0
+#define THREAD_READY		1
+#define THREAD_BLOCKED		2
+#define THREAD_DEAD			3
+
+
+typedef struct thread_s {
+	list_t list;				/* Entry in a runqueue or a wait list */
+
+	uint32_t esp;				/* The saved stack pointer while switched out */
+	void* stack;				/* The lowest address of the kernel stack, NULL for the boot thread */
+
+	unsigned int id;
+	const char* name;
+	unsigned int cpu;			/* The CPU whose runqueue the thread is on, threads don't migrate */
+
+	unsigned int state;
+	unsigned int priority;
+	unsigned int time_slice;	/* The number of ticks left before being preempted */
+	ktimer_t sleep_timer;		/* Wakes the thread up from thread_sleep_ns() */
+
+	void* fpu_state;			/* The saved FPU/SSE registers, NULL until the thread uses them */
+
+	void (*func)(void*);
+	void* arg;
+} thread_t;
+
+
+/* The number of ticks since the scheduler was started, counted by the boot CPU */
+extern volatile uint64_t jiffies;
+
+
+/**
+ * Initializes the scheduler. Its tick is started by timer_init().
+ * 
+ * The caller's context becomes the current CPU's idle thread, which must end up
+ * running cpu_idle().
+*/
+void sched_init(void);
+
+/**
+ * Makes the caller's context the idle thread of a CPU started after sched_init().
+*/
+void sched_init_cpu(void);
+
+
+/* Thread functions */
+
+/**
+ * Creates a kernel thread and makes it ready to run on the online CPU with the
+ * fewest threads.
+ * 
+ * @param name the name of the thread
+ * @param func the function the thread runs
+ * @param arg the argument given to func
+ * @param priority the priority of the thread, lower values run first
+ * 
+ * @return the thread
+*/
+thread_t* thread_create(const char* name, void (*func)(void*), void* arg, unsigned int priority);
+
+/**
+ * Creates a kernel thread and makes it ready to run on the given CPU.
+ * 
+ * @param cpu the ID of the CPU, which must be online
+ * @param name the name of the thread
+ * @param func the function the thread runs
+ * @param arg the argument given to func
+ * @param priority the priority of the thread, lower values run first
+ * 
+ * @return the thread
+*/
+thread_t* thread_create_on(unsigned int cpu, const char* name, void (*func)(void*), void* arg, unsigned int priority);
+
+/**
+ * Returns the thread running on the current CPU.
+ * 
+ * @return the current thread
+*/
+thread_t* thread_current(void);
+
+/**
+ * Gives the CPU to the next ready thread of the same or a higher priority, if any.
+*/
+void thread_yield(void);
+
+/**
+ * Ends the current thread. Its stack is freed once another thread is running.
+*/
+void thread_exit(void) __attribute__ ((noreturn));
+
+/**
+ * Puts the current thread to sleep.
+ * 
+ * @param ns the number of nanoseconds to sleep for, rounded up to the
+ * precision of the clock event device
+*/
+void thread_sleep_ns(uint64_t ns);
+
+/**
+ * Blocks the current thread until thread_wake() is called on it.
+ * 
+ * Interrupts must be disabled by the caller, so a wakeup can't be missed
+ * between checking the condition it waits for and blocking. That doesn't stop
+ * other CPUs, so waits woken up from anywhere set the state under their own lock
+ * and call schedule() instead, as mutex_lock() does.
+*/
+void thread_block(void);
+
+/**
+ * Makes a blocked thread ready to run on its CPU, interrupting that CPU if the
+ * thread should preempt the one running there.
+ * 
+ * @param thread the thread
+*/
+void thread_wake(thread_t* thread);
+
+
+/* Scheduler functions */
+
+/**
+ * Switches to the next thread to run, putting the current one back in the runqueue
+ * unless it's blocked or dead.
+ * 
+ * Must not be called with preemption disabled.
+*/
+void schedule(void);
+
+/**
+ * Switches to another thread if the current one has been marked for preemption
+ * and preemption is enabled.
+ * 
+ * Called on the way out of interrupt handlers and when preemption is enabled again.
+ * The idle thread isn't preempted, it checks for a pending switch itself.
+*/
+void sched_preempt(void);
+
+/**
+ * Returns true if the current thread has been marked for preemption.
+ * 
+ * @return true if a switch is pending, false otherwise
+*/
+bool sched_need_resched(void);
+
+/**
+ * Handles a timer tick, charging the current thread's time slice.
+ * 
+ * Called from the tick's timer, with interrupts disabled.
+*/
+void sched_tick(void);
+
+/**
+ * Prints the counters of the scheduler.
+*/
+void sched_print(void);
+
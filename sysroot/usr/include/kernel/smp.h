@@ -0,0 +1,44 @@
+#pragma once
+
+/* The maximum number of CPUs supported by the kernel */
+#define MAX_CPUS	8
+
+#ifdef __i386__
+#include <kernel/arch/i386/percpu.h>
+#endif
+
+#include <stdbool.h>
+
+/* The number of CPUs running, CPU IDs go from 0 to num_cpus - 1 */
+extern unsigned int num_cpus;
+
+/* Set once every CPU has been started, the others run with interrupts disabled until then */
+extern volatile bool smp_booted;
+
+/**
+ * Starts the other CPUs, which wait in their idle loop for work.
+ * 
+ * Must be called once the scheduler and the timers are initialized.
+*/
+void smp_init(void);
+
+/**
+ * Interrupts another CPU so it picks up a thread that was made ready on it.
+ * 
+ * Must be called with interrupts disabled.
+ * 
+ * @param cpu the ID of the CPU
+*/
+void smp_send_reschedule(unsigned int cpu);
+
+/**
+ * Returns the ID of the CPU running the caller.
+ * 
+ * The boot CPU is 0, the others are numbered in the order they were started.
+ * 
+ * @return the ID of the current CPU
+*/
+static inline unsigned int smp_cpu_id(void)
+{
+	return percpu_read_id();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <kernel/ds/list.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+/**
+ * Per-lock contention statistics.
+ * 
+ * They are only kept when CONFIG_LOCK_STAT is defined (make LOCKSTAT=1). A lock is
+ * added to the list of locks the first time it's taken, so it must not be freed
+ * afterwards. Locks without a name aren't tracked.
+*/
+typedef struct lock_stat_s {
+	list_t list;					/* Entry in the list of locks, NULL until the lock is taken */
+	const char* name;
+
+	unsigned long acquisitions;
+	unsigned long contentions;		/* Acquisitions that had to wait */
+	uint64_t wait_cycles;			/* Total time spent waiting by the contended acquisitions */
+} lock_stat_t;
+
+#define LOCK_STAT_INIT(lock_name)	{ .list = {NULL, NULL}, .name = (lock_name) }
+
+
+#ifdef CONFIG_LOCK_STAT
+
+/**
+ * Records an acquisition of a lock.
+ * 
+ * Called with the lock held, which keeps the counters of spinlocks and mutexes
+ * exact. Readers of reader-writer locks update them concurrently, so those are
+ * approximate.
+ * 
+ * @param stat the statistics of the lock
+ * @param contended true if the lock was held by someone else when asked for
+ * @param wait_cycles the number of cycles spent waiting for the lock
+*/
+void lock_stat_record(lock_stat_t* stat, bool contended, uint64_t wait_cycles);
+
+/**
+ * Writes the statistics of every lock that has been taken to the serial port.
+*/
+void lock_stat_print(void);
+
+#endif
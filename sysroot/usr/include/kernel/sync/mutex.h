@@ -0,0 +1,70 @@
+#pragma once
+
+#include <kernel/sync/spinlock.h>
+#include <kernel/sync/lock_stat.h>
+#include <kernel/ds/list.h>
+
+#include <stdbool.h>
+
+
+struct thread_s;
+
+/*
+ * A sleeping lock for long critical sections, such as ones that wait on a device.
+ * Threads that find it held block instead of spinning, and are handed the mutex
+ * in the order they asked for it.
+ * 
+ * Mutexes can only be taken by threads, with no spinlocks held.
+*/
+typedef struct mutex_s {
+	bool locked;
+	struct thread_s* owner;
+
+	spinlock_t wait_lock;			/* Protects the fields above and the list of waiters */
+	list_t waiters;
+#ifdef CONFIG_LOCK_STAT
+	lock_stat_t stat;
+#endif
+} mutex_t;
+
+#ifdef CONFIG_LOCK_STAT
+#define MUTEX_INIT(mutex,lock_name)	{ .locked = false, .owner = NULL, .wait_lock = SPINLOCK_INIT(NULL), \
+	.waiters = {&(mutex).waiters, &(mutex).waiters}, .stat = LOCK_STAT_INIT(lock_name) }
+#else
+#define MUTEX_INIT(mutex,lock_name)	{ .locked = false, .owner = NULL, .wait_lock = SPINLOCK_INIT(NULL), \
+	.waiters = {&(mutex).waiters, &(mutex).waiters} }
+#endif
+
+
+/**
+ * Initializes an unlocked mutex.
+ * 
+ * @param mutex the mutex
+ * @param name the name the mutex's statistics are printed under
+*/
+void mutex_init(mutex_t* mutex, const char* name);
+
+/**
+ * Takes a mutex, blocking until it's released if it's held.
+ * 
+ * @param mutex the mutex
+*/
+void mutex_lock(mutex_t* mutex);
+
+/**
+ * Takes a mutex if it's free.
+ * 
+ * @param mutex the mutex
+ * 
+ * @return true if the mutex was taken, false if it's held
+*/
+bool mutex_trylock(mutex_t* mutex);
+
+/**
+ * Releases a mutex, handing it over to the first thread waiting for it.
+ * 
+ * Must be called by the thread that holds the mutex.
+ * 
+ * @param mutex the mutex
+*/
+void mutex_unlock(mutex_t* mutex);
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <kernel/sync/lock_stat.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * A ticket lock: each CPU takes the next ticket and spins until it's served, so
+ * the lock is handed out in the order it was asked for and no CPU starves.
+ * 
+ * Preemption is disabled while a spinlock is held, so the holder can't be switched
+ * out while others spin. Locks also taken by interrupt handlers must be taken with
+ * spin_lock_irqsave() everywhere else.
+*/
+typedef struct spinlock_s {
+	volatile uint16_t owner;		/* The ticket being served */
+	volatile uint16_t next;			/* The ticket given to the next CPU that asks */
+#ifdef CONFIG_LOCK_STAT
+	lock_stat_t stat;
+#endif
+} spinlock_t;
+
+/*
+ * A reader-writer spinlock: either any number of readers or a single writer.
+ * Readers aren't held back by a waiting writer, so a reader can take it again,
+ * but a steady stream of readers can keep a writer out.
+*/
+typedef struct rwlock_s {
+	volatile int32_t count;			/* The number of readers, or -1 while held by a writer */
+#ifdef CONFIG_LOCK_STAT
+	lock_stat_t stat;
+#endif
+} rwlock_t;
+
+#ifdef CONFIG_LOCK_STAT
+#define SPINLOCK_INIT(lock_name)	{ .owner = 0, .next = 0, .stat = LOCK_STAT_INIT(lock_name) }
+#define RWLOCK_INIT(lock_name)		{ .count = 0, .stat = LOCK_STAT_INIT(lock_name) }
+#else
+#define SPINLOCK_INIT(lock_name)	{ .owner = 0, .next = 0 }
+#define RWLOCK_INIT(lock_name)		{ .count = 0 }
+#endif
+
+
+/* Spinlock functions */
+
+/**
+ * Initializes an unlocked spinlock.
+ * 
+ * @param lock the lock
+ * @param name the name the lock's statistics are printed under, or NULL to keep none
+*/
+void spin_lock_init(spinlock_t* lock, const char* name);
+
+/**
+ * Takes a spinlock, spinning until it's free.
+ * 
+ * @param lock the lock
+*/
+void spin_lock(spinlock_t* lock);
+
+/**
+ * Takes a spinlock if it's free.
+ * 
+ * @param lock the lock
+ * 
+ * @return true if the lock was taken, false if it's held
+*/
+bool spin_trylock(spinlock_t* lock);
+
+/**
+ * Releases a spinlock.
+ * 
+ * @param lock the lock
+*/
+void spin_unlock(spinlock_t* lock);
+
+/**
+ * Disables interrupts on the current CPU and takes a spinlock.
+ * 
+ * @param lock the lock
+ * 
+ * @return the flags to give to spin_unlock_irqrestore()
+*/
+uint32_t spin_lock_irqsave(spinlock_t* lock);
+
+/**
+ * Releases a spinlock taken with spin_lock_irqsave() and restores the interrupt flag.
+ * 
+ * @param lock the lock
+ * @param flags the flags returned by spin_lock_irqsave()
+*/
+void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags);
+
+
+/* Reader-writer lock functions */
+
+/**
+ * Initializes an unlocked reader-writer lock.
+ * 
+ * @param lock the lock
+ * @param name the name the lock's statistics are printed under, or NULL to keep none
+*/
+void rwlock_init(rwlock_t* lock, const char* name);
+
+/**
+ * Takes a reader-writer lock for reading, spinning while a writer holds it.
+ * 
+ * @param lock the lock
+*/
+void read_lock(rwlock_t* lock);
+
+/**
+ * Releases a reader-writer lock taken for reading.
+ * 
+ * @param lock the lock
+*/
+void read_unlock(rwlock_t* lock);
+
+/**
+ * Takes a reader-writer lock for writing, spinning until there are no readers
+ * or writer.
+ * 
+ * @param lock the lock
+*/
+void write_lock(rwlock_t* lock);
+
+/**
+ * Releases a reader-writer lock taken for writing.
+ * 
+ * @param lock the lock
+*/
+void write_unlock(rwlock_t* lock);
@@ -5,3 +5,6 @@
 #define ASSERT(x) if(!(x)) panic("Assertion Failed: " #x, __FILE__, __LINE__)
 
 void panic(const char* msg, const char* file, int line) __attribute__ ((noreturn));
+
+/* Idle */
+void cpu_idle(void) __attribute__ ((noreturn));
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define NSEC_PER_USEC		1000ULL
+#define NSEC_PER_MSEC		1000000ULL
+#define NSEC_PER_SEC		1000000000ULL
+
+
+/* A free running counter the time is read from */
+typedef struct clocksource_s {
+	const char* name;
+	uint64_t (*read)(void);
+
+	/* ns = (cycles * mult) >> shift, set by clocksource_register() */
+	uint32_t mult;
+	uint32_t shift;
+} clocksource_t;
+
+
+/**
+ * Makes a counter the source of the time, which starts counting from 0.
+ * 
+ * @param cs the counter
+ * @param khz the frequency of the counter in kHz
+*/
+void clocksource_register(clocksource_t* cs, uint32_t khz);
+
+/**
+ * Sets the wall-clock time.
+ * 
+ * @param seconds the number of seconds since the Unix epoch
+*/
+void ktime_set_real(uint64_t seconds);
+
+
+/**
+ * Returns the monotonic time.
+ * 
+ * @return the number of nanoseconds since the clocksource was registered
+*/
+uint64_t ktime_get_ns(void);
+
+/**
+ * Returns the wall-clock time.
+ * 
+ * @return the number of nanoseconds since the Unix epoch
+*/
+uint64_t ktime_get_real(void);
+
+/**
+ * Returns the wall-clock time in seconds, as stored in file system timestamps.
+ * 
+ * @return the number of seconds since the Unix epoch
+*/
+uint64_t ktime_get_real_seconds(void);
+
+
+/**
+ * Converts a UTC date to the number of seconds since the Unix epoch.
+ * 
+ * @param year the year, e.g. 2024
+ * @param month the month, from 1 to 12
+ * @param day the day of the month, from 1
+ * @param hour the hour, from 0 to 23
+ * @param min the minute
+ * @param sec the second
+ * 
+ * @return the number of seconds since the Unix epoch
+*/
+uint64_t mktime64(unsigned int year, unsigned int month, unsigned int day, unsigned int hour, unsigned int min, unsigned int sec);
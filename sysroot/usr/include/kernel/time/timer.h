@@ -0,0 +1,114 @@
+#pragma once
+
+#include <kernel/ds/list.h>
+#include <kernel/time/ktime.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+
+/*
+ * A device that raises an interrupt after a given number of its ticks, which
+ * must call timer_interrupt().
+*/
+typedef struct clock_event_s {
+	const char* name;
+
+	/* ticks = (ns * mult) >> CLOCK_EVENT_SHIFT */
+	uint32_t mult;
+	uint64_t min_delta_ns;
+	uint64_t max_delta_ns;
+
+	void (*set_next_event)(uint32_t ticks);
+	void (*stop)(void);
+} clock_event_t;
+
+#define CLOCK_EVENT_SHIFT	24
+
+
+/* A function called once its expiry time has passed, with interrupts disabled */
+typedef struct ktimer_s {
+	list_t list;
+	uint64_t expires;		/* In nanoseconds, see ktime_get_ns() */
+	bool pending;
+
+	void (*func)(void* arg);
+	void* arg;
+} ktimer_t;
+
+
+/**
+ * Starts the timer subsystem, and the scheduler's tick.
+ * 
+ * A clocksource must already be registered.
+ * 
+ * @param dev the device used for timer interrupts
+*/
+void timer_init(clock_event_t* dev);
+
+/**
+ * Starts the scheduler's tick on a CPU started after timer_init().
+*/
+void timer_init_cpu(void);
+
+/**
+ * Sets the conversion factor and limits of a clock event device.
+ * 
+ * @param dev the device
+ * @param freq the frequency of the device's ticks in Hz
+ * @param min_ticks the smallest number of ticks that can be programmed
+ * @param max_ticks the largest number of ticks that can be programmed
+*/
+void clock_event_config(clock_event_t* dev, uint32_t freq, uint32_t min_ticks, uint32_t max_ticks);
+
+
+/**
+ * Initializes a timer.
+ * 
+ * @param timer the timer
+ * @param func the function called when it expires
+ * @param arg the argument given to func
+*/
+void timer_setup(ktimer_t* timer, void (*func)(void*), void* arg);
+
+/**
+ * Starts a timer, or moves it if it's already pending.
+ * 
+ * @param timer the timer
+ * @param expires the time at which it expires, in nanoseconds
+*/
+void timer_add(ktimer_t* timer, uint64_t expires);
+
+/**
+ * Stops a timer.
+ * 
+ * @param timer the timer
+ * 
+ * @return true if the timer was pending
+*/
+bool timer_del(ktimer_t* timer);
+
+/**
+ * Runs the expired timers and programs the device for the next one.
+ * 
+ * Called by the clock event device's interrupt handler.
+*/
+void timer_interrupt(void);
+
+
+/**
+ * Stops the periodic tick before the CPU halts in the idle loop, leaving only
+ * the pending timers to wake it up. Must be called with interrupts disabled.
+*/
+void tick_nohz_idle_enter(void);
+
+/**
+ * Restarts the periodic tick, accounting for the ticks that were skipped.
+*/
+void tick_nohz_idle_exit(void);
+
+/**
+ * Prints the counters of the timer subsystem.
+*/
+void timer_print(void);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <limits.h>
+#include <stddef.h>
 
 
 #define MAX(a,b) ({ __typeof__ (a) _a = (a); __typeof__ (b) _b = (b); _a > _b ? _a : _b; })
@@ -12,4 +13,7 @@
 
 #define UNSIGNED_SUM_OVERFLOWS(a,b) ({ __typeof__ (a) _a = (a); (_a > 0 && (b) > ULONG_MAX - _a); })
 
+/* Returns the struct of the given type that contains ptr as the given member */
+#define CONTAINER_OF(ptr,type,member)	((type*) ((char*) (ptr) - offsetof(type, member)))
+
 #define IS_POWER_OF_2(x)	({__typeof__ (x) _x = (x); (_x && !(_x & (_x - 1))); })